@@ -0,0 +1,14 @@
+#version 120
+
+varying vec2 fragTexCoord;
+uniform sampler2D atlas;
+
+void main()
+{
+	// the atlas is transparent around the robot
+	vec4 color = texture2D(atlas, fragTexCoord);
+	if (color.a < 0.5) {
+		discard;
+	}
+	gl_FragColor = color;
+}
@@ -0,0 +1,14 @@
+#version 120
+
+attribute vec3 position;
+attribute vec2 texCoord;
+varying vec2 fragTexCoord;
+uniform mat4 viewProjection;
+uniform mat4 model;
+
+
+void main()
+{
+	gl_Position = viewProjection * model * vec4(position, 1.0);
+	fragTexCoord = texCoord;
+}
@@ -0,0 +1,16 @@
+#version 150
+
+// One instance per view, the geometry shader applies that view's projection
+in vec3 position;
+in vec3 color;
+out vec3 vertexColor;
+flat out int vertexView;
+uniform mat4 model;
+
+
+void main()
+{
+	gl_Position = model * vec4(position, 1.0);
+	vertexColor = color;
+	vertexView = gl_InstanceID;
+}
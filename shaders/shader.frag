@@ -1,8 +1,9 @@
 #version 120
 
 varying vec3 fragColor;
+uniform vec3 tint;
 
 void main()
 {
-	gl_FragColor = vec4(fragColor, 1.0);
+	gl_FragColor = vec4(fragColor * tint, 1.0);
 }
@@ -1,13 +1,14 @@
 #version 120
 
-attribute vec3 position;
+attribute vec3 position;
 attribute vec3 color;
 varying vec3 fragColor;
-uniform mat4 mvp;
+uniform mat4 viewProjection;
+uniform mat4 model;
 
 
 void main()
 {
-	gl_Position = mvp * vec4(position, 1.0);
+	gl_Position = viewProjection * model * vec4(position, 1.0);
 	fragColor = color;
 }
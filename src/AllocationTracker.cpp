@@ -0,0 +1,396 @@
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#if defined(ROBOT_TRACK_ALLOCATIONS) && !defined(NDEBUG) && !defined(_WIN32)
+#define ROBOT_TRACK_CALL_SITES
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+
+static const char *tagNames[AllocTagCount] = {
+	"untagged", "input", "scene", "render", "animation", "pose", "joints", "shader"
+};
+
+static thread_local AllocationTag currentTag = AllocUntagged;
+
+AllocationScope::AllocationScope(AllocationTag tag)
+{
+	previous = currentTag;
+	currentTag = tag;
+}
+
+AllocationScope::~AllocationScope()
+{
+	currentTag = previous;
+}
+
+// Counters are plain atomics so the hooks never allocate themselves
+struct AtomicCounts
+{
+	std::atomic<uint64_t> allocations;
+	std::atomic<uint64_t> frees;
+	std::atomic<uint64_t> bytes;
+};
+
+static AtomicCounts tagCounts[AllocTagCount];
+static std::atomic<uint64_t> liveBytes(0);
+static std::atomic<uint64_t> peakBytes(0);
+
+static AllocationCounts frameStart[AllocTagCount];
+static FrameAllocations previousFrame;
+static FrameAllocations worstFrame;
+static uint64_t frames = 0;
+static uint64_t allocatingFrames = 0;
+
+static AllocationCounts Snapshot(int tag)
+{
+	AllocationCounts counts;
+	counts.allocations = tagCounts[tag].allocations.load(std::memory_order_relaxed);
+	counts.frees = tagCounts[tag].frees.load(std::memory_order_relaxed);
+	counts.bytes = tagCounts[tag].bytes.load(std::memory_order_relaxed);
+	return counts;
+}
+
+#ifdef ROBOT_TRACK_CALL_SITES
+
+// Frames kept above operator new. Containers reach it through several layers of
+// std::allocator and their own growth code, so the first frame outside the
+// standard library is picked when the dump is written, not here.
+static const int callSiteDepth = 10;
+
+// fixed size open addressing table keyed by a hash of the captured frames
+static const int callSiteCapacity = 4096;
+static std::atomic<uint64_t> callSiteKeys[callSiteCapacity];
+static void *callSiteFrames[callSiteCapacity][callSiteDepth];
+static std::atomic<int> callSiteFrameCounts[callSiteCapacity];
+static std::atomic<uint64_t> callSiteAllocations[callSiteCapacity];
+static std::atomic<uint64_t> callSiteBytes[callSiteCapacity];
+
+// backtrace can allocate the first time it unwinds; don't record that
+static thread_local bool capturingCallSite = false;
+
+// Called from the operator new bodies, so frame 0 is operator new itself.
+static inline __attribute__((always_inline)) void RecordCallSite(size_t size)
+{
+	if (capturingCallSite) {
+		return;
+	}
+	capturingCallSite = true;
+	void *frames[callSiteDepth + 1];
+	int frameCount = backtrace(frames, callSiteDepth + 1) - 1;
+	capturingCallSite = false;
+	if (frameCount <= 0) {
+		return;
+	}
+
+	// FNV-1a over the return addresses, 0 marks an empty slot
+	uint64_t key = 14695981039346656037ull;
+	for (int i = 1; i <= frameCount; i++) {
+		key = (key ^ (uintptr_t)frames[i]) * 1099511628211ull;
+	}
+	key = key ? key : 1;
+
+	size_t slot = key % callSiteCapacity;
+	for (int probe = 0; probe < callSiteCapacity; probe++) {
+		uint64_t expected = 0;
+		uint64_t current = callSiteKeys[slot].load(std::memory_order_acquire);
+		if (current == 0 && callSiteKeys[slot].compare_exchange_strong(expected, key)) {
+			memcpy(callSiteFrames[slot], frames + 1, sizeof(void *) * frameCount);
+			callSiteFrameCounts[slot].store(frameCount, std::memory_order_release);
+			current = key;
+		} else if (current == 0) {
+			current = expected;
+		}
+		if (current == key) {
+			callSiteAllocations[slot].fetch_add(1, std::memory_order_relaxed);
+			callSiteBytes[slot].fetch_add(size, std::memory_order_relaxed);
+			return;
+		}
+		slot = (slot + 1) % callSiteCapacity;
+	}
+}
+
+// std:: and __gnu_cxx:: functions by their mangled names, e.g. the allocator and vector growth
+static bool IsLibraryFrame(const char *symbol)
+{
+	return strncmp(symbol, "_ZNS", 4) == 0 || strncmp(symbol, "_ZNKS", 5) == 0 || strncmp(symbol, "_ZS", 3) == 0 ||
+		strncmp(symbol, "_ZN9__gnu_cxx", 13) == 0 || strncmp(symbol, "_ZNK9__gnu_cxx", 14) == 0;
+}
+
+// One frame as its symbol and its offset in the module, which addr2line takes for position independent executables
+static void WriteFrame(FILE *file, void *address)
+{
+	Dl_info info;
+	bool found = dladdr(address, &info) != 0;
+	const char *symbol = found && info.dli_sname ? info.dli_sname : "?";
+	const char *module = found && info.dli_fname ? info.dli_fname : "?";
+	uintptr_t offset = (uintptr_t)address - (found ? (uintptr_t)info.dli_fbase : 0);
+	fprintf(file, "{\"symbol\": \"%s\", \"module\": \"%s\", \"offset\": \"0x%llx\"}",
+		symbol, module, (unsigned long long)offset);
+}
+
+#endif
+
+#ifdef ROBOT_TRACK_ALLOCATIONS
+
+// Each block carries its size and tag in front of the user pointer so frees can
+// be attributed. 16 bytes keeps the user pointer aligned for any scalar type.
+struct AllocationHeader
+{
+	uint64_t size;
+	uint64_t tag;
+};
+
+static void *TrackedAllocate(size_t size)
+{
+	AllocationHeader *header = (AllocationHeader *)malloc(sizeof(AllocationHeader) + size);
+	if (!header) {
+		return 0;
+	}
+	header->size = size;
+	header->tag = currentTag;
+
+	tagCounts[currentTag].allocations.fetch_add(1, std::memory_order_relaxed);
+	tagCounts[currentTag].bytes.fetch_add(size, std::memory_order_relaxed);
+	uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+	}
+	return header + 1;
+}
+
+static void TrackedFree(void *pointer)
+{
+	if (!pointer) {
+		return;
+	}
+	AllocationHeader *header = (AllocationHeader *)pointer - 1;
+	tagCounts[header->tag].frees.fetch_add(1, std::memory_order_relaxed);
+	liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+	free(header);
+}
+
+void *operator new(size_t size)
+{
+	void *pointer = TrackedAllocate(size);
+#ifdef ROBOT_TRACK_CALL_SITES
+	RecordCallSite(size);
+#endif
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size)
+{
+	void *pointer = TrackedAllocate(size);
+#ifdef ROBOT_TRACK_CALL_SITES
+	RecordCallSite(size);
+#endif
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	void *pointer = TrackedAllocate(size);
+#ifdef ROBOT_TRACK_CALL_SITES
+	RecordCallSite(size);
+#endif
+	return pointer;
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	void *pointer = TrackedAllocate(size);
+#ifdef ROBOT_TRACK_CALL_SITES
+	RecordCallSite(size);
+#endif
+	return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+	TrackedFree(pointer);
+}
+
+bool AllocationTracker::enabled()
+{
+	return true;
+}
+
+#else
+
+bool AllocationTracker::enabled()
+{
+	return false;
+}
+
+#endif
+
+const char *AllocationTracker::tagName(AllocationTag tag)
+{
+	return tagNames[tag];
+}
+
+void AllocationTracker::beginFrame()
+{
+	for (int tag = 0; tag < AllocTagCount; tag++) {
+		frameStart[tag] = Snapshot(tag);
+	}
+	peakBytes.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void AllocationTracker::endFrame()
+{
+	FrameAllocations frame;
+	for (int tag = 0; tag < AllocTagCount; tag++) {
+		AllocationCounts now = Snapshot(tag);
+		AllocationCounts &delta = frame.byTag[tag];
+		delta.allocations = now.allocations - frameStart[tag].allocations;
+		delta.frees = now.frees - frameStart[tag].frees;
+		delta.bytes = now.bytes - frameStart[tag].bytes;
+		frame.total.allocations += delta.allocations;
+		frame.total.frees += delta.frees;
+		frame.total.bytes += delta.bytes;
+	}
+	frame.peakBytes = peakBytes.load(std::memory_order_relaxed);
+
+	previousFrame = frame;
+	frames++;
+	if (frame.total.allocations > 0) {
+		allocatingFrames++;
+	}
+	if (frame.total.allocations > worstFrame.total.allocations) {
+		worstFrame = frame;
+	}
+	worstFrame.peakBytes = std::max(worstFrame.peakBytes, frame.peakBytes);
+}
+
+const FrameAllocations &AllocationTracker::lastFrame()
+{
+	return previousFrame;
+}
+
+uint64_t AllocationTracker::framesMeasured()
+{
+	return frames;
+}
+
+uint64_t AllocationTracker::framesWithAllocations()
+{
+	return allocatingFrames;
+}
+
+void AllocationTracker::printStats()
+{
+	if (!enabled()) {
+		return;
+	}
+
+	std::cout << "Allocations: " << allocatingFrames << " of " << frames << " frames allocated, worst frame "
+		<< worstFrame.total.allocations << " allocations / " << worstFrame.total.bytes << " bytes, peak heap "
+		<< worstFrame.peakBytes << " bytes" << std::endl;
+	for (int tag = 0; tag < AllocTagCount; tag++) {
+		AllocationCounts counts = Snapshot(tag);
+		if (counts.allocations == 0) {
+			continue;
+		}
+		std::cout << "  " << tagNames[tag] << ": " << counts.allocations << " allocations, "
+			<< counts.bytes << " bytes, " << worstFrame.byTag[tag].allocations << " in the worst frame" << std::endl;
+	}
+}
+
+static void WriteCounts(FILE *file, const AllocationCounts &counts)
+{
+	fprintf(file, "{\"allocations\": %llu, \"frees\": %llu, \"bytes\": %llu}",
+		(unsigned long long)counts.allocations, (unsigned long long)counts.frees, (unsigned long long)counts.bytes);
+}
+
+bool AllocationTracker::writeDump(const char *fileName)
+{
+	FILE *file = fopen(fileName, "w");
+	if (!file) {
+		std::cerr << "Failed to open the allocation dump:" << fileName << std::endl;
+		return false;
+	}
+
+	fprintf(file, "{\n  \"enabled\": %s,\n", enabled() ? "true" : "false");
+	fprintf(file, "  \"frames\": %llu,\n  \"frames_with_allocations\": %llu,\n",
+		(unsigned long long)frames, (unsigned long long)allocatingFrames);
+	fprintf(file, "  \"peak_bytes\": %llu,\n", (unsigned long long)worstFrame.peakBytes);
+
+	fprintf(file, "  \"last_frame\": ");
+	WriteCounts(file, previousFrame.total);
+	fprintf(file, ",\n  \"worst_frame\": ");
+	WriteCounts(file, worstFrame.total);
+
+	fprintf(file, ",\n  \"tags\": {");
+	for (int tag = 0; tag < AllocTagCount; tag++) {
+		fprintf(file, "%s\n    \"%s\": {\"total\": ", tag ? "," : "", tagNames[tag]);
+		WriteCounts(file, Snapshot(tag));
+		fprintf(file, ", \"worst_frame\": ");
+		WriteCounts(file, worstFrame.byTag[tag]);
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n  },\n  \"call_sites\": [");
+
+#ifdef ROBOT_TRACK_CALL_SITES
+	bool first = true;
+	for (int slot = 0; slot < callSiteCapacity; slot++) {
+		int frameCount = callSiteFrameCounts[slot].load(std::memory_order_acquire);
+		if (frameCount == 0) {
+			continue;
+		}
+
+		// the site is the first caller outside the standard library
+		int site = 0;
+		for (; site < frameCount - 1; site++) {
+			Dl_info info;
+			if (!dladdr(callSiteFrames[slot][site], &info) || !info.dli_sname || !IsLibraryFrame(info.dli_sname)) {
+				break;
+			}
+		}
+
+		fprintf(file, "%s\n    {\"site\": ", first ? "" : ",");
+		WriteFrame(file, callSiteFrames[slot][site]);
+		fprintf(file, ", \"allocations\": %llu, \"bytes\": %llu, \"frames\": [",
+			(unsigned long long)callSiteAllocations[slot].load(), (unsigned long long)callSiteBytes[slot].load());
+		for (int i = 0; i < frameCount; i++) {
+			fprintf(file, "%s", i ? ", " : "");
+			WriteFrame(file, callSiteFrames[slot][i]);
+		}
+		fprintf(file, "]}");
+		first = false;
+	}
+#endif
+
+	fprintf(file, "\n  ]\n}\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Optional global operator new/delete hooks. Configure with
+// -DROBOT_TRACK_ALLOCATIONS=ON to count allocations, bytes and peak usage per
+// frame and per subsystem; without it every call here is a cheap no-op.
+// Debug builds also attribute allocations to their call site.
+
+enum AllocationTag
+{
+	AllocUntagged,
+	AllocInput,
+	AllocScene,
+	AllocRender,
+	AllocAnimation,
+	AllocPose,
+	AllocJoints,
+	AllocShader,
+	AllocTagCount
+};
+
+struct AllocationCounts
+{
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	uint64_t bytes = 0;
+};
+
+struct FrameAllocations
+{
+	AllocationCounts total;
+	AllocationCounts byTag[AllocTagCount];
+	// highest live heap size reached during the frame
+	uint64_t peakBytes = 0;
+};
+
+class AllocationTracker
+{
+public:
+	// true when the hooks were compiled in
+	static bool enabled();
+
+	static const char *tagName(AllocationTag tag);
+
+	// Bracket one frame of the main loop.
+	static void beginFrame();
+	static void endFrame();
+
+	static const FrameAllocations &lastFrame();
+	static uint64_t framesMeasured();
+	static uint64_t framesWithAllocations();
+
+	// Human readable summary for the frame stats.
+	static void printStats();
+
+	// JSON dump of per-frame totals, per-tag totals and (debug builds) call sites.
+	static bool writeDump(const char *fileName);
+};
+
+// Attribute allocations on this thread to a subsystem until the scope ends.
+class AllocationScope
+{
+public:
+	explicit AllocationScope(AllocationTag tag);
+	~AllocationScope();
+
+private:
+	AllocationTag previous;
+};
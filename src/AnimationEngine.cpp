@@ -0,0 +1,342 @@
+#include "AnimationEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANIMATION_SSE 1
+#include <emmintrin.h>
+#endif
+
+AnimationEngine::AnimationEngine()
+{
+#ifdef ANIMATION_SSE
+	simd = true;
+#endif
+}
+
+AnimationEngine::~AnimationEngine()
+{
+}
+
+void AnimationEngine::setChannelCount(int channels)
+{
+	channelCount = channels;
+	poseStride = (channels + 3) & ~3;
+
+	clips.clear();
+	instances.clear();
+	poses.clear();
+	restPose.assign(poseStride, 0.0f);
+
+	// mask 0 weighs every channel fully
+	masks.assign(poseStride, 0.0f);
+	std::fill(masks.begin(), masks.begin() + channels, 1.0f);
+}
+
+void AnimationEngine::setThreadCount(int threads)
+{
+	if (threads == 1) {
+		pool.reset();
+	} else {
+		pool.reset(new ThreadPool(threads));
+	}
+}
+
+void AnimationEngine::setSimd(bool enabled)
+{
+#ifdef ANIMATION_SSE
+	simd = enabled;
+#else
+	simd = false;
+#endif
+}
+
+void AnimationEngine::setRestPose(const float *values)
+{
+	std::copy(values, values + channelCount, restPose.begin());
+}
+
+int AnimationEngine::addClip(const float *values, int frames, float sampleRate, bool additive)
+{
+	Clip clip;
+	clip.frameCount = frames;
+	clip.sampleRate = sampleRate;
+	clip.duration = frames / sampleRate;
+	clip.additive = additive;
+	clip.offset.assign(poseStride, 0.0f);
+	clip.step.assign(poseStride, 0.0f);
+
+	// additive clips keep what they add to their first frame
+	std::vector<float> source(values, values + (size_t)frames * channelCount);
+	if (additive) {
+		for (int f = frames - 1; f >= 0; f--) {
+			for (int c = 0; c < channelCount; c++) {
+				source[(size_t)f * channelCount + c] -= source[c];
+			}
+		}
+	}
+
+	// spread each channel's range over the 16 bit keys, key 0 is the middle of the range
+	for (int c = 0; c < channelCount; c++) {
+		float low = source[c], high = source[c];
+		for (int f = 1; f < frames; f++) {
+			low = std::min(low, source[(size_t)f * channelCount + c]);
+			high = std::max(high, source[(size_t)f * channelCount + c]);
+		}
+		clip.step[c] = (high - low) / 65535.0f;
+		clip.offset[c] = low + 32768.0f * clip.step[c];
+	}
+
+	// one extra row repeats the first frame so a looping clip can always interpolate to the next
+	clip.keys.assign((size_t)(frames + 1) * poseStride, 0);
+	for (int f = 0; f <= frames; f++) {
+		const float *row = &source[(size_t)(f % frames) * channelCount];
+		for (int c = 0; c < channelCount; c++) {
+			if (clip.step[c] > 0.0f) {
+				float key = std::floor((row[c] - clip.offset[c]) / clip.step[c] + 0.5f);
+				clip.keys[(size_t)f * poseStride + c] = (int16_t)std::min(std::max(key, -32768.0f), 32767.0f);
+			}
+		}
+	}
+
+	clips.push_back(clip);
+	return (int)clips.size() - 1;
+}
+
+int AnimationEngine::addMask(const float *weights)
+{
+	size_t first = masks.size();
+	masks.resize(first + poseStride, 0.0f);
+	std::copy(weights, weights + channelCount, masks.begin() + first);
+	return (int)(first / poseStride);
+}
+
+float AnimationEngine::clipDuration(int clip) const
+{
+	return clips[clip].duration;
+}
+
+int AnimationEngine::addInstance()
+{
+	instances.push_back(Instance());
+	poses.insert(poses.end(), restPose.begin(), restPose.end());
+	return (int)instances.size() - 1;
+}
+
+void AnimationEngine::setLayer(int instance, int index, const AnimationLayer &settings)
+{
+	Instance &target = instances[instance];
+	target.layers[index] = settings;
+	target.layerCount = std::max(target.layerCount, index + 1);
+}
+
+// out = offset + step * (a + fraction * (b - a)) for two rows of keys
+void AnimationEngine::sample(const Clip &clip, float time, float *out) const
+{
+	float position = time * clip.sampleRate;
+	int frame = std::min(std::max((int)position, 0), clip.frameCount - 1);
+	float fraction = std::min(std::max(position - frame, 0.0f), 1.0f);
+	const int16_t *a = &clip.keys[(size_t)frame * poseStride];
+	const int16_t *b = a + poseStride;
+	const float *offset = &clip.offset[0];
+	const float *step = &clip.step[0];
+
+#ifdef ANIMATION_SSE
+	if (simd) {
+		__m128 t = _mm_set1_ps(fraction);
+		for (int c = 0; c < poseStride; c += 4) {
+			// sign extend four shorts by unpacking them into the high halves and shifting down
+			__m128i ka = _mm_loadl_epi64((const __m128i *)(a + c));
+			__m128i kb = _mm_loadl_epi64((const __m128i *)(b + c));
+			__m128 fa = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(ka, ka), 16));
+			__m128 fb = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(kb, kb), 16));
+			__m128 key = _mm_add_ps(fa, _mm_mul_ps(t, _mm_sub_ps(fb, fa)));
+			_mm_storeu_ps(out + c, _mm_add_ps(_mm_loadu_ps(offset + c), _mm_mul_ps(_mm_loadu_ps(step + c), key)));
+		}
+		return;
+	}
+#endif
+
+	for (int c = 0; c < poseStride; c++) {
+		float key = a[c] + fraction * (float)(b[c] - a[c]);
+		out[c] = offset[c] + step[c] * key;
+	}
+}
+
+// pose += (sample - pose) * mask * weight
+static void BlendOverride(float *pose, const float *sample, const float *mask, float weight, int stride, bool simd)
+{
+#ifdef ANIMATION_SSE
+	if (simd) {
+		__m128 w = _mm_set1_ps(weight);
+		for (int c = 0; c < stride; c += 4) {
+			__m128 p = _mm_loadu_ps(pose + c);
+			__m128 amount = _mm_mul_ps(_mm_loadu_ps(mask + c), w);
+			_mm_storeu_ps(pose + c, _mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(sample + c), p), amount)));
+		}
+		return;
+	}
+#endif
+
+	for (int c = 0; c < stride; c++) {
+		pose[c] += (sample[c] - pose[c]) * mask[c] * weight;
+	}
+}
+
+// pose += sample * mask * weight
+static void BlendAdditive(float *pose, const float *sample, const float *mask, float weight, int stride, bool simd)
+{
+#ifdef ANIMATION_SSE
+	if (simd) {
+		__m128 w = _mm_set1_ps(weight);
+		for (int c = 0; c < stride; c += 4) {
+			__m128 amount = _mm_mul_ps(_mm_loadu_ps(mask + c), w);
+			_mm_storeu_ps(pose + c, _mm_add_ps(_mm_loadu_ps(pose + c), _mm_mul_ps(_mm_loadu_ps(sample + c), amount)));
+		}
+		return;
+	}
+#endif
+
+	for (int c = 0; c < stride; c++) {
+		pose[c] += sample[c] * mask[c] * weight;
+	}
+}
+
+void AnimationEngine::evaluateBatch(int batch, float seconds, float *row)
+{
+	int begin = batch * instancesPerBatch;
+	int end = std::min(begin + instancesPerBatch, (int)instances.size());
+
+	for (int i = begin; i < end; i++) {
+		Instance &instance = instances[i];
+		float *pose = &poses[(size_t)i * poseStride];
+		std::copy(restPose.begin(), restPose.end(), pose);
+
+		for (int l = 0; l < instance.layerCount; l++) {
+			AnimationLayer &layer = instance.layers[l];
+			if (layer.clip < 0) {
+				continue;
+			}
+			const Clip &clip = clips[layer.clip];
+
+			layer.time = std::fmod(layer.time + seconds * layer.speed, clip.duration);
+			if (layer.time < 0.0f) {
+				layer.time += clip.duration;
+			}
+			if (layer.weight <= 0.0f) {
+				continue;
+			}
+
+			sample(clip, layer.time, row);
+			const float *mask = &masks[(size_t)layer.mask * poseStride];
+			if (clip.additive) {
+				BlendAdditive(pose, row, mask, layer.weight, poseStride, simd);
+			} else {
+				BlendOverride(pose, row, mask, layer.weight, poseStride, simd);
+			}
+		}
+	}
+}
+
+void AnimationEngine::evaluate(float seconds)
+{
+	int batches = ((int)instances.size() + instancesPerBatch - 1) / instancesPerBatch;
+	scratch.resize((size_t)getThreadCount() * poseStride);
+
+	if (!pool) {
+		for (int b = 0; b < batches; b++) {
+			evaluateBatch(b, seconds, &scratch[0]);
+		}
+		return;
+	}
+
+	auto task = [&](int batch, int worker) { evaluateBatch(batch, seconds, &scratch[(size_t)worker * poseStride]); };
+	pool->parallelFor(batches, task);
+}
+
+void BenchmarkAnimationEngine()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int channels = 30;
+	const int frames = 30;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// three looping clips of smooth random curves, like walk, wave and idle
+	std::vector<float> curves[3];
+	for (int c = 0; c < 3; c++) {
+		curves[c].resize(frames * channels);
+		for (int ch = 0; ch < channels; ch++) {
+			float amplitude = unit(rng), phase = 6.28318531f * unit(rng);
+			for (int f = 0; f < frames; f++) {
+				curves[c][f * channels + ch] = amplitude * std::sin(phase + 6.28318531f * f / frames);
+			}
+		}
+	}
+	// the wave only moves the first half of the channels
+	std::vector<float> upperBody(channels, 0.0f);
+	std::fill(upperBody.begin(), upperBody.begin() + channels / 2, 1.0f);
+
+	std::cout << "instances\tthreads\tsimd\tms\tposes/s\tmax difference" << std::endl;
+	int hardwareThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	for (int n = 1000; n <= 100000; n *= 10) {
+		std::vector<float> reference;
+		for (int threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+			for (int simd = 1; simd >= 0; simd--) {
+				AnimationEngine engine;
+				engine.setChannelCount(channels);
+				engine.setThreadCount(threads);
+				engine.setSimd(simd != 0);
+				int walk = engine.addClip(&curves[0][0], frames, 30.0f);
+				int wave = engine.addClip(&curves[1][0], frames, 30.0f);
+				int idle = engine.addClip(&curves[2][0], frames, 30.0f, true);
+				int mask = engine.addMask(&upperBody[0]);
+
+				for (int i = 0; i < n; i++) {
+					engine.addInstance();
+					AnimationLayer layer;
+					layer.clip = walk;
+					layer.time = (i % 97) / 97.0f;
+					engine.setLayer(i, 0, layer);
+					layer.clip = wave;
+					layer.mask = mask;
+					layer.weight = 0.7f;
+					engine.setLayer(i, 1, layer);
+					layer.clip = idle;
+					layer.mask = 0;
+					layer.weight = 0.5f;
+					engine.setLayer(i, 2, layer);
+				}
+
+				// evaluate for about a tenth of a second
+				int iterations = std::max(100000 / n, 1) * 10;
+				engine.evaluate(0.0f);
+				Clock::time_point start = Clock::now();
+				for (int it = 0; it < iterations; it++) {
+					engine.evaluate(1.0f / 60.0f);
+				}
+				double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+
+				// every configuration has advanced the same clips by the same time, so the poses should agree
+				float maxDifference = 0.0f;
+				if (reference.empty()) {
+					reference.assign(engine.pose(0), engine.pose(0) + (size_t)n * engine.getPoseStride());
+				} else {
+					for (size_t v = 0; v < reference.size(); v++) {
+						maxDifference = std::max(maxDifference, std::fabs(reference[v] - engine.pose(0)[v]));
+					}
+				}
+
+				std::cout << n << "\t" << threads << "\t" << (engine.isSimd() ? "on" : "off") << "\t" << ms << "\t"
+					<< n / ms * 1000.0 << "\t" << maxDifference << std::endl;
+			}
+			if (threads == hardwareThreads) {
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ThreadPool.h"
+
+// One layer of an instance's animation: a clip played at its own speed and
+// blended over the layers below it.
+struct AnimationLayer
+{
+	int clip = -1;
+	// channel weights registered with addMask, 0 is every channel at full weight
+	int mask = 0;
+	float weight = 1.0f;
+	float speed = 1.0f;
+	// seconds into the clip, wraps around its duration
+	float time = 0.0f;
+};
+
+// Samples keyframe clips for many instances and blends them into flat poses.
+//
+// A pose is one float per channel (three joint angles per robot part, as in
+// pose tracks), padded to a multiple of four so the kernels run four channels
+// at a time. Clips keep their keyframes quantized to 16 bits per channel with
+// a per-channel offset and step, frame by frame, so sampling reads two short
+// rows. Every instance starts from the rest pose and applies its layers in
+// order: override layers blend towards the clip by weight times the mask,
+// additive clips store their difference from their first frame and add it.
+//
+// Instances are evaluated in batches of instancesPerBatch on a ThreadPool. The
+// poses of a batch are contiguous and each worker blends into them through its
+// own scratch row, so evaluation does not allocate.
+class AnimationEngine
+{
+public:
+	AnimationEngine();
+	~AnimationEngine();
+
+	// Channels every clip, mask and pose has. Clears all clips, masks and instances.
+	void setChannelCount(int channels);
+	int getChannelCount() const { return channelCount; }
+	int getPoseStride() const { return poseStride; }
+
+	// 0 uses every hardware thread, 1 evaluates on the calling thread
+	void setThreadCount(int threads);
+	int getThreadCount() const { return pool ? pool->size() : 1; }
+
+	// use the SSE kernels where they were compiled in
+	void setSimd(bool enabled);
+	bool isSimd() const { return simd; }
+
+	void setRestPose(const float *values);
+
+	// frames * channels values, frame after frame. Returns the clip's id.
+	int addClip(const float *values, int frames, float sampleRate, bool additive = false);
+	// a weight per channel, returns the mask's id
+	int addMask(const float *weights);
+	float clipDuration(int clip) const;
+
+	int addInstance();
+	int instanceCount() const { return (int)instances.size(); }
+	void setLayer(int instance, int layer, const AnimationLayer &settings);
+	AnimationLayer &layer(int instance, int layer) { return instances[instance].layers[layer]; }
+
+	// Advance every layer by seconds times its speed and blend all poses.
+	void evaluate(float seconds);
+
+	const float *pose(int instance) const { return &poses[(size_t)instance * poseStride]; }
+
+	static const int maxLayers = 4;
+	static const int instancesPerBatch = 64;
+
+private:
+	AnimationEngine(const AnimationEngine &);
+	AnimationEngine &operator=(const AnimationEngine &);
+
+	struct Clip
+	{
+		int frameCount = 0;
+		float sampleRate = 0.0f;
+		float duration = 0.0f;
+		bool additive = false;
+		std::vector<int16_t> keys;
+		// value = offset + step * key
+		std::vector<float> offset;
+		std::vector<float> step;
+	};
+
+	struct Instance
+	{
+		AnimationLayer layers[maxLayers];
+		int layerCount = 0;
+	};
+
+	void evaluateBatch(int batch, float seconds, float *scratch);
+	void sample(const Clip &clip, float time, float *out) const;
+
+	int channelCount = 0;
+	int poseStride = 0;
+	bool simd = false;
+
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<Clip> clips;
+	// maskCount * poseStride weights
+	std::vector<float> masks;
+	std::vector<float> restPose;
+	std::vector<Instance> instances;
+	std::vector<float> poses;
+	// poseStride floats per worker
+	std::vector<float> scratch;
+};
+
+// Poses per second for crowds of 1k to 100k instances of three layers, on 1 to
+// all threads, with the SSE kernels and without.
+void BenchmarkAnimationEngine();
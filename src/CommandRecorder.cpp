@@ -0,0 +1,314 @@
+#include "CommandRecorder.h"
+#include "CubeMesh.h"
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+CommandRecorder::CommandRecorder()
+{
+}
+
+CommandRecorder::~CommandRecorder()
+{
+}
+
+void CommandRecorder::setThreadCount(int threads)
+{
+	if (threads == 1) {
+		pool.reset();
+	} else {
+		pool.reset(new ThreadPool(threads));
+	}
+}
+
+void CommandRecorder::prepare(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 *vps, int views)
+{
+	viewCount = std::min(views, (int)maxViews);
+	for (int v = 0; v < viewCount; v++) {
+		viewProjections[v] = vps[v];
+		frusta[v] = Frustum::FromViewProjection(vps[v]);
+	}
+	if (occlusion && viewCount == 1) {
+		occlusion->prepare(scene, roots, viewProjections[0], frusta[0], boundingRadius, eye);
+	}
+
+	int robots = (int)roots.size();
+	robotCount = robots;
+	activeChunks = (robots + robotsPerChunk - 1) / robotsPerChunk;
+	if ((int)chunks.size() < activeChunks) {
+		chunks.resize(activeChunks);
+	}
+}
+
+void CommandRecorder::Chunk::clear()
+{
+	commands.clear();
+	mergedVertices.clear();
+	impostors.clear();
+	visible = 0;
+	occluded = 0;
+	for (int level = 0; level < LodCount; level++) {
+		lodCounts[level] = 0;
+	}
+}
+
+// Forward kinematics of a part and its children, once per robot: T(parentTranslation) R about
+// the joint, then T(jointTranslation) S for the cube, in traversal order
+static void SolvePart(const SceneGraph &scene, SceneHandle handle, const glm::mat4 &parentJoint,
+	std::vector<SceneHandle> &parts, std::vector<glm::mat4> &worlds)
+{
+	glm::mat4 joint = scene.jointTransform(handle, parentJoint);
+	parts.push_back(handle);
+	worlds.push_back(scene.partTransform(handle, joint));
+
+	for (SceneHandle child : scene.children(handle)) {
+		SolvePart(scene, child, joint, parts, worlds);
+	}
+}
+
+// World space box around the solved parts, as SceneGraph::computeBounds gives it
+static void SolvedBounds(const std::vector<glm::mat4> &worlds, glm::vec3 &boundsMin, glm::vec3 &boundsMax)
+{
+	for (size_t i = 0; i < worlds.size(); i++) {
+		const glm::mat4 &part = worlds[i];
+		// the unit cube's corners land within the sum of the absolute axis columns of its center
+		glm::vec3 center(part[3]);
+		glm::vec3 extent = glm::abs(glm::vec3(part[0])) + glm::abs(glm::vec3(part[1])) + glm::abs(glm::vec3(part[2]));
+		boundsMin = glm::min(boundsMin, center - extent);
+		boundsMax = glm::max(boundsMax, center + extent);
+	}
+}
+
+// One draw per solved part
+static void RecordParts(const SceneGraph &scene, const std::vector<SceneHandle> &parts, const std::vector<glm::mat4> &worlds,
+	const glm::mat4 &viewProjection, std::vector<RenderCommand> &commands)
+{
+	for (size_t i = 0; i < parts.size(); i++) {
+		const SceneNode &part = scene.node(parts[i]);
+		const glm::mat4 &model = worlds[i];
+
+		// clip space w of the part's origin is its distance in front of the camera
+		const glm::mat4 &m = viewProjection;
+		float depth = m[0][3] * model[3][0] + m[1][3] * model[3][1] + m[2][3] * model[3][2] + m[3][3];
+		RenderCommand command = {MakeDrawKey(0, part.mesh, part.material, depth), model};
+		commands.push_back(command);
+	}
+}
+
+// Append the cubes of the solved parts in world space, leaving out the small ones
+static void MergeParts(const SceneGraph &scene, const std::vector<SceneHandle> &parts, const std::vector<glm::mat4> &worlds,
+	float minimumVolume, std::vector<float> &vertices)
+{
+	for (size_t i = 0; i < parts.size(); i++) {
+		const SceneNode &part = scene.node(parts[i]);
+		if (8.0f * part.scale.x * part.scale.y * part.scale.z < minimumVolume) {
+			continue;
+		}
+
+		const glm::mat4 &world = worlds[i];
+		for (int v = 0; v < cubeVertexCount; v++) {
+			const float *vertex = &cubeVertices[6 * v];
+			glm::vec4 position = world * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+			vertices.push_back(position.x);
+			vertices.push_back(position.y);
+			vertices.push_back(position.z);
+			vertices.push_back(vertex[3]);
+			vertices.push_back(vertex[4]);
+			vertices.push_back(vertex[5]);
+		}
+	}
+}
+
+// FNV-1a over every part's angles and scale, quantized so small changes keep the same impostor
+static void HashPose(const SceneGraph &scene, SceneHandle handle, uint64_t &hash)
+{
+	const SceneNode &part = scene.node(handle);
+	const float angleStep = glm::radians(10.0f);
+	const float scaleStep = 0.05f;
+	int values[6] = {
+		(int)std::floor(part.rotation.x / angleStep + 0.5f),
+		(int)std::floor(part.rotation.y / angleStep + 0.5f),
+		(int)std::floor(part.rotation.z / angleStep + 0.5f),
+		(int)std::floor(part.scale.x / scaleStep + 0.5f),
+		(int)std::floor(part.scale.y / scaleStep + 0.5f),
+		(int)std::floor(part.scale.z / scaleStep + 0.5f)
+	};
+	for (int i = 0; i < 6; i++) {
+		hash = (hash ^ (uint32_t)values[i]) * 1099511628211ull;
+	}
+
+	for (SceneHandle child : scene.children(handle)) {
+		HashPose(scene, child, hash);
+	}
+}
+
+int CommandRecorder::ImpostorDirection(const glm::vec3 &eye, const glm::vec3 &position, int directions)
+{
+	const float twoPi = 6.28318531f;
+	float azimuth = std::atan2(eye.x - position.x, eye.z - position.z);
+	int direction = (int)std::floor(azimuth / twoPi * directions + 0.5f);
+	return ((direction % directions) + directions) % directions;
+}
+
+void CommandRecorder::recordRobot(const SceneGraph &scene, SceneHandle root, uint32_t robot, Chunk &chunk) const
+{
+	glm::vec3 position = scene.getParentTranslation(root);
+	bool inView = false;
+	for (int v = 0; v < viewCount && !inView; v++) {
+		inView = frusta[v].intersectsSphere(position, boundingRadius);
+	}
+	if (!inView) {
+		return;
+	}
+
+	// the occlusion bounds, the draws and the merged mesh all come from one pass of forward kinematics
+	bool solved = false;
+	if (occlusion && viewCount == 1) {
+		chunk.parts.clear();
+		chunk.partWorlds.clear();
+		SolvePart(scene, root, glm::mat4(1.0f), chunk.parts, chunk.partWorlds);
+		solved = true;
+
+		glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		SolvedBounds(chunk.partWorlds, boundsMin, boundsMax);
+		if (occlusion->isOccluded(boundsMin, boundsMax)) {
+			chunk.occluded++;
+			return;
+		}
+	}
+	chunk.visible++;
+
+	RobotLod level = LodFull;
+	if (lod.enabled) {
+		// clip space w of the root is its distance in front of the camera, use the nearest view
+		float depth = FLT_MAX;
+		for (int v = 0; v < viewCount; v++) {
+			const glm::mat4 &m = viewProjections[v];
+			float w = m[0][3] * position.x + m[1][3] * position.y + m[2][3] * position.z + m[3][3];
+			if (w > 1e-3f) {
+				depth = std::min(depth, w);
+			}
+		}
+		float pixels = depth < FLT_MAX ? boundingRadius * lod.projectionScale / depth : lod.fullPixels;
+		if (pixels < lod.impostorPixels && viewCount == 1) {
+			level = LodImpostor;
+		} else if (pixels < lod.fullPixels) {
+			level = LodMerged;
+		}
+	}
+	chunk.lodCounts[level]++;
+
+	if (level != LodImpostor && !solved) {
+		chunk.parts.clear();
+		chunk.partWorlds.clear();
+		SolvePart(scene, root, glm::mat4(1.0f), chunk.parts, chunk.partWorlds);
+	}
+
+	if (level == LodFull) {
+		RecordParts(scene, chunk.parts, chunk.partWorlds, viewProjections[0], chunk.commands);
+	} else if (level == LodMerged) {
+		MergeParts(scene, chunk.parts, chunk.partWorlds, lod.mergedMinimumVolume, chunk.mergedVertices);
+	} else {
+		// HashPose leaves out translations, so robots in the same pose share a picture
+		uint64_t hash = 14695981039346656037ull;
+		HashPose(scene, root, hash);
+
+		ImpostorRequest request;
+		request.key = (hash << 8) | (uint64_t)ImpostorDirection(eye, position, lod.impostorDirections);
+		request.robot = robot;
+		request.position = position;
+		chunk.impostors.push_back(request);
+	}
+}
+
+void CommandRecorder::recordChunk(const SceneGraph &scene, const std::vector<SceneHandle> &roots, int chunkIndex)
+{
+	Chunk &chunk = chunks[chunkIndex];
+	chunk.clear();
+
+	int begin = chunkIndex * robotsPerChunk;
+	int end = std::min(begin + robotsPerChunk, (int)roots.size());
+	for (int i = begin; i < end; i++) {
+		recordRobot(scene, roots[i], (uint32_t)i, chunk);
+	}
+}
+
+void CommandRecorder::record(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 &vp)
+{
+	record(scene, roots, &vp, 1);
+}
+
+void CommandRecorder::record(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 *vps, int views)
+{
+	prepare(scene, roots, vps, views);
+
+	if (!pool) {
+		for (int i = 0; i < activeChunks; i++) {
+			recordChunk(scene, roots, i);
+		}
+		return;
+	}
+
+	auto task = [&](int chunkIndex, int worker) { recordChunk(scene, roots, chunkIndex); };
+	pool->parallelFor(activeChunks, task);
+}
+
+void CommandRecorder::recordSerial(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 &vp)
+{
+	prepare(scene, roots, &vp, 1);
+
+	// everything goes in the first list, in root order
+	for (int i = 0; i < activeChunks; i++) {
+		chunks[i].clear();
+	}
+	for (size_t i = 0; i < roots.size(); i++) {
+		recordRobot(scene, roots[i], (uint32_t)i, chunks[0]);
+	}
+}
+
+int CommandRecorder::commandCount() const
+{
+	int count = 0;
+	for (int i = 0; i < activeChunks; i++) {
+		count += (int)chunks[i].commands.size();
+	}
+	return count;
+}
+
+int CommandRecorder::mergedVertexCount() const
+{
+	size_t floats = 0;
+	for (int i = 0; i < activeChunks; i++) {
+		floats += chunks[i].mergedVertices.size();
+	}
+	return (int)(floats / 6);
+}
+
+int CommandRecorder::robotsAtLod(RobotLod level) const
+{
+	int count = 0;
+	for (int i = 0; i < activeChunks; i++) {
+		count += chunks[i].lodCounts[level];
+	}
+	return count;
+}
+
+int CommandRecorder::occludedRobots() const
+{
+	int count = 0;
+	for (int i = 0; i < activeChunks; i++) {
+		count += chunks[i].occluded;
+	}
+	return count;
+}
+
+int CommandRecorder::visibleRobots() const
+{
+	int count = 0;
+	for (int i = 0; i < activeChunks; i++) {
+		count += chunks[i].visible;
+	}
+	return count;
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+#include "OcclusionCuller.h"
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+
+// One draw of a part's mesh, sorted by its draw key (see RenderQueue.h).
+// The model matrix is in world space, so the same command serves every view.
+struct RenderCommand
+{
+	uint64_t key;
+	glm::mat4 model;
+};
+
+// How much of a robot is drawn, picked from its size on screen.
+enum RobotLod
+{
+	LodFull,      // every part is its own draw
+	LodMerged,    // the larger parts pre-transformed into one shared vertex stream
+	LodImpostor,  // a billboard showing a cached rendering of the robot
+	LodCount
+};
+
+// A robot far enough away to be drawn as a billboard.
+struct ImpostorRequest
+{
+	// identifies the picture: quantized pose and the side it is seen from
+	uint64_t key;
+	uint32_t robot;
+	glm::vec3 position;
+};
+
+// Screen size thresholds, as the projected radius in pixels of a robot's bounding sphere.
+struct LodSettings
+{
+	bool enabled = true;
+	float fullPixels = 60.0f;
+	float impostorPixels = 12.0f;
+	// pixels covered by one unit at a distance of one unit, viewport height / (2 tan(fovy / 2))
+	float projectionScale = 693.0f;
+	// the merged mesh leaves out parts smaller than this, in cube-local volume
+	float mergedMinimumVolume = 0.5f;
+	// billboards are drawn from this many directions around the robot
+	int impostorDirections = 8;
+};
+
+// Culls robots and records their draws off the GL thread.
+//
+// The robots are cut into fixed size chunks and a ThreadPool runs forward
+// kinematics, frustum culling and command generation for each chunk into that
+// chunk's own command list. The chunking does not depend on the thread count,
+// so walking the lists in chunk order always gives the serial draw order. The
+// GL thread only walks them and issues the draws.
+//
+// Each visible robot is also given a level of detail from its projected size:
+// near robots record one command per part, mid-distance robots append their
+// larger parts, already transformed to world space, to the chunk's merged
+// vertex stream, and far robots only record an impostor request.
+//
+// Several views can be recorded at once. Forward kinematics then still runs
+// once per robot: a robot is kept if any view sees it and gets the level of
+// detail of the view it is largest in. Impostors face a single camera and the
+// occluders are drawn from one, so with more than one view neither is used.
+class CommandRecorder
+{
+public:
+	CommandRecorder();
+	~CommandRecorder();
+
+	// 0 uses every hardware thread, 1 records on the calling thread
+	void setThreadCount(int threads);
+	int getThreadCount() const { return pool ? pool->size() : 1; }
+
+	// bounding sphere radius around each robot root used for culling
+	void setBoundingRadius(float radius) { boundingRadius = radius; }
+	float getBoundingRadius() const { return boundingRadius; }
+
+	void setLodSettings(const LodSettings &settings) { lod = settings; }
+	const LodSettings &getLodSettings() const { return lod; }
+	// the camera position picks which side of a far robot its impostor shows
+	void setEye(const glm::vec3 &position) { eye = position; }
+
+	// Robots hidden behind the torsos of nearer ones are skipped. The culler is
+	// prepared on the calling thread before the chunks are recorded.
+	void setOcclusionCuller(OcclusionCuller *culler) { occlusion = culler; }
+
+	// Record the visible robots among roots. Lists are reused between frames,
+	// so once the robot count is stable recording does not allocate.
+	void record(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 &viewProjection);
+
+	// Record the robots seen by any of up to maxViews views. Draw keys sort by
+	// the depth in the first view.
+	void record(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 *viewProjections, int viewCount);
+
+	// The same output as record, built in one pass on the calling thread.
+	void recordSerial(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 &viewProjection);
+
+	int chunkCount() const { return activeChunks; }
+	const std::vector<RenderCommand> &chunk(int i) const { return chunks[i].commands; }
+	// x, y, z, r, g, b per vertex in world space
+	const std::vector<float> &mergedVertices(int i) const { return chunks[i].mergedVertices; }
+	const std::vector<ImpostorRequest> &impostors(int i) const { return chunks[i].impostors; }
+	int commandCount() const;
+	int mergedVertexCount() const;
+
+	int visibleRobots() const;
+	int culledRobots() const { return robotCount - visibleRobots(); }
+	// robots in the frustum that the occlusion culler hid
+	int occludedRobots() const;
+	int robotsAtLod(RobotLod level) const;
+
+	// Which side of a robot at position the camera sees, in [0, impostorDirections).
+	static int ImpostorDirection(const glm::vec3 &eye, const glm::vec3 &position, int directions);
+
+	static const int robotsPerChunk = 256;
+	static const int maxViews = 4;
+
+private:
+	struct Chunk
+	{
+		std::vector<RenderCommand> commands;
+		std::vector<float> mergedVertices;
+		std::vector<ImpostorRequest> impostors;
+		// the robot being recorded: its parts in traversal order and their world transforms
+		std::vector<SceneHandle> parts;
+		std::vector<glm::mat4> partWorlds;
+		int visible = 0;
+		int occluded = 0;
+		int lodCounts[LodCount];
+
+		void clear();
+	};
+
+	void prepare(const SceneGraph &scene, const std::vector<SceneHandle> &roots, const glm::mat4 *viewProjections, int viewCount);
+	void recordChunk(const SceneGraph &scene, const std::vector<SceneHandle> &roots, int chunkIndex);
+	void recordRobot(const SceneGraph &scene, SceneHandle root, uint32_t robot, Chunk &chunk) const;
+
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<Chunk> chunks;
+	int activeChunks = 0;
+	int robotCount = 0;
+	float boundingRadius = 6.0f;
+	LodSettings lod;
+	glm::vec3 eye{0.0f, 0.0f, 0.0f};
+	OcclusionCuller *occlusion = 0;
+
+	// shared by every chunk for the duration of one record call
+	glm::mat4 viewProjections[maxViews];
+	Frustum frusta[maxViews];
+	int viewCount = 0;
+};
@@ -0,0 +1,47 @@
+#include "CubeMesh.h"
+
+// x, y, z, r, g, b, ...
+const float cubeVertices[cubeVertexCount * 6] = {
+	// Face x-
+	-1.0f,	+1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
+	-1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
+	-1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
+	-1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
+	-1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
+	-1.0f,	-1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
+	// Face x+
+	+1.0f,	+1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
+	+1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
+	+1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
+	+1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
+	+1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
+	+1.0f,	-1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
+	// Face y-
+	+1.0f,	-1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
+	-1.0f,	-1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
+	+1.0f,	-1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
+	+1.0f,	-1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
+	-1.0f,	-1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
+	-1.0f,	-1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
+	// Face y+
+	+1.0f,	+1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
+	+1.0f,	+1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
+	-1.0f,	+1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
+	-1.0f,	+1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
+	+1.0f,	+1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
+	-1.0f,	+1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
+	// Face z-
+	+1.0f,	+1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
+	+1.0f,	-1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
+	-1.0f,	+1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
+	-1.0f,	+1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
+	+1.0f,	-1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
+	-1.0f,	-1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
+	// Face z+
+	+1.0f,	+1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
+	-1.0f,	+1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
+	+1.0f,	-1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
+	+1.0f,	-1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
+	-1.0f,	+1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
+	-1.0f,	-1.0f,	+1.0f,	0.2f,	0.2f,	0.8f
+};
@@ -0,0 +1,6 @@
+#pragma once
+
+// The unit cube every robot part is drawn with, interleaved x, y, z, r, g, b
+// per vertex, faces coloured red for x, green for y and blue for z.
+static const int cubeVertexCount = 36;
+extern const float cubeVertices[cubeVertexCount * 6];
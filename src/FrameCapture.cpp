@@ -0,0 +1,109 @@
+#include "FrameCapture.h"
+#include "FrameWriter.h"
+
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture()
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	// the GL objects go with the context
+}
+
+bool FrameCapture::init(FrameWriter *writer, int ringSize)
+{
+	if (!GLEW_ARB_pixel_buffer_object || !GLEW_ARB_sync) {
+		std::cerr << "Frame capture needs pixel buffer objects and sync objects" << std::endl;
+		return false;
+	}
+
+	ring.assign(ringSize, Slot());
+	for (size_t i = 0; i < ring.size(); i++) {
+		glGenBuffers(1, &ring[i].buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, ring[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, writer->frameBytes(), 0, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	frameWriter = writer;
+	nextSlot = 0;
+	return true;
+}
+
+void FrameCapture::capture(int frame, int width, int height)
+{
+	if (!frameWriter) {
+		return;
+	}
+
+	if (width != frameWriter->getWidth() || height != frameWriter->getHeight()) {
+		sizeMismatches++;
+		return;
+	}
+
+	// pick up anything that finished since the last frame, oldest first
+	for (size_t i = 1; i < ring.size(); i++) {
+		Slot &slot = ring[(nextSlot + i) % ring.size()];
+		if (slot.fence) {
+			collect(slot, false);
+		}
+	}
+
+	// the ring is full, this is the only place capture waits, and only on the GPU
+	Slot &slot = ring[nextSlot];
+	if (slot.fence && !collect(slot, false)) {
+		gpuWaits++;
+		collect(slot, true);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, frameWriter->getWidth(), frameWriter->getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frame;
+	readbacks++;
+
+	nextSlot = (nextSlot + 1) % ring.size();
+}
+
+void FrameCapture::finish()
+{
+	for (size_t i = 0; i < ring.size(); i++) {
+		Slot &slot = ring[(nextSlot + i) % ring.size()];
+		if (slot.fence) {
+			collect(slot, true);
+		}
+	}
+}
+
+bool FrameCapture::collect(Slot &slot, bool wait)
+{
+	GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+	if (status == GL_TIMEOUT_EXPIRED && !wait) {
+		return false;
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameWriter->frameBytes(), GL_MAP_READ_BIT);
+	if (mapped) {
+		// every writer buffer is still queued for the disk, drop the frame rather than wait
+		unsigned char *pixels = frameWriter->acquire();
+		if (pixels) {
+			memcpy(pixels, mapped, frameWriter->frameBytes());
+			frameWriter->submit(pixels, slot.frame);
+		} else {
+			frameWriter->drop();
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		frameWriter->drop();
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FrameWriter;
+
+// Reads finished frames back through a ring of pixel buffer objects.
+//
+// capture() only queues glReadPixels into the next buffer of the ring and
+// fences it; the copy out of a buffer happens frames later once its fence has
+// signalled, so the readback overlaps rendering instead of stalling it. The
+// pixels are then handed to a FrameWriter, which encodes and writes them on
+// its own threads.
+class FrameCapture
+{
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	// Needs pixel buffer objects and sync objects; returns false without them.
+	bool init(FrameWriter *writer, int ringSize = 3);
+	bool isReady() const { return frameWriter != 0; }
+
+	// Queue a readback of the current read framebuffer, call after drawing and before swapping.
+	void capture(int frame, int width, int height);
+
+	// Hand every queued readback to the writer, waiting for the GPU if needed.
+	void finish();
+
+	uint64_t getReadbacks() const { return readbacks; }
+	// times the ring was full and a readback had not finished yet
+	uint64_t getGpuWaits() const { return gpuWaits; }
+	// frames skipped because the framebuffer no longer matched the capture size
+	uint64_t getSizeMismatches() const { return sizeMismatches; }
+
+private:
+	struct Slot
+	{
+		GLuint buffer = 0;
+		GLsync fence = 0;
+		int frame = 0;
+	};
+
+	// copy a finished readback to the writer; without wait only if it is already done
+	bool collect(Slot &slot, bool wait);
+
+	FrameWriter *frameWriter = 0;
+	std::vector<Slot> ring;
+	size_t nextSlot = 0;
+
+	uint64_t readbacks = 0;
+	uint64_t gpuWaits = 0;
+	uint64_t sizeMismatches = 0;
+};
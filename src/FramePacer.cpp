@@ -0,0 +1,163 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+// keep std::min and std::max usable
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// how long before a deadline to stop sleeping and start spinning
+static const std::chrono::microseconds spinThreshold(1500);
+
+// CPU seconds used by the calling thread; std::clock counts the worker threads too
+static double ThreadCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	// FILETIME counts 100 ns ticks
+	return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+	timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+FramePacer::FramePacer()
+{
+	startTime = Clock::now();
+	startCpu = std::clock();
+	startThreadCpu = ThreadCpuSeconds();
+	nextFrame = startTime;
+	frameInterval = Clock::duration::zero();
+	frameTimes.assign(maxSamples, 0.0);
+	frameIntervals.assign(maxSamples, 0.0);
+}
+
+FramePacer::~FramePacer()
+{
+}
+
+void FramePacer::setFrameRateCap(double fps)
+{
+	frameRateCap = fps;
+	if (fps > 0.0) {
+		frameInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+	} else {
+		frameInterval = Clock::duration::zero();
+	}
+	nextFrame = Clock::now();
+}
+
+double FramePacer::timeUntilNextFrame() const
+{
+	if (frameRateCap <= 0.0) {
+		return 0.0;
+	}
+	double remaining = std::chrono::duration<double>(nextFrame - Clock::now()).count();
+	return std::max(remaining, 0.0);
+}
+
+void FramePacer::waitForNextFrame()
+{
+	if (frameRateCap <= 0.0) {
+		return;
+	}
+
+	Clock::time_point now = Clock::now();
+	if (nextFrame - now > spinThreshold) {
+		std::this_thread::sleep_for(nextFrame - now - spinThreshold);
+	}
+	while (Clock::now() < nextFrame) {
+		std::this_thread::yield();
+	}
+}
+
+void FramePacer::beginFrame()
+{
+	frameStart = Clock::now();
+	frameStartThreadCpu = ThreadCpuSeconds();
+
+	if (hasLastFrame) {
+		frameIntervals[intervalCount++ % maxSamples] = std::chrono::duration<double>(frameStart - lastFrameStart).count();
+	}
+	lastFrameStart = frameStart;
+	hasLastFrame = true;
+
+	if (frameRateCap > 0.0) {
+		// schedule from the deadline rather than from now so the rate does not drift,
+		// but do not try to catch up after a long idle period
+		nextFrame += frameInterval;
+		if (nextFrame < frameStart) {
+			nextFrame = frameStart + frameInterval;
+		}
+	}
+}
+
+void FramePacer::endFrame()
+{
+	double seconds = std::chrono::duration<double>(Clock::now() - frameStart).count();
+	frameTimes[frameCount++ % maxSamples] = seconds;
+	totalFrameSeconds += seconds;
+	busyThreadCpuSeconds += ThreadCpuSeconds() - frameStartThreadCpu;
+}
+
+static void PrintSeries(const char *name, const std::vector<double> &samples, long long count)
+{
+	std::vector<double> values(samples.begin(), samples.begin() + std::min<long long>(count, samples.size()));
+	if (values.empty()) {
+		std::cout << name << ": no samples" << std::endl;
+		return;
+	}
+
+	double mean = 0.0;
+	for (size_t i = 0; i < values.size(); i++) {
+		mean += values[i];
+	}
+	mean /= values.size();
+
+	double variance = 0.0;
+	for (size_t i = 0; i < values.size(); i++) {
+		variance += (values[i] - mean) * (values[i] - mean);
+	}
+	variance /= values.size();
+
+	std::sort(values.begin(), values.end());
+	double p99 = values[std::min(values.size() - 1, (size_t)(0.99 * values.size()))];
+
+	std::cout << name << ": mean " << mean * 1000.0 << " ms, stddev (jitter) " << std::sqrt(variance) * 1000.0
+		<< " ms, p99 " << p99 * 1000.0 << " ms, max " << values.back() * 1000.0 << " ms" << std::endl;
+}
+
+void FramePacer::printStats() const
+{
+	double wallSeconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+	double cpuSeconds = double(std::clock() - startCpu) / CLOCKS_PER_SEC;
+	double threadCpuSeconds = ThreadCpuSeconds() - startThreadCpu;
+
+	// the render thread's CPU outside of frames is what the viewer costs while nothing changes
+	double idleWallSeconds = wallSeconds - totalFrameSeconds;
+	double idleCpuSeconds = std::max(threadCpuSeconds - busyThreadCpuSeconds, 0.0);
+
+	std::cout << "Frames rendered: " << frameCount << " in " << wallSeconds << " s" << std::endl;
+	if (frameRateCap > 0.0) {
+		std::cout << "Frame rate cap: " << frameRateCap << " fps" << std::endl;
+	}
+	PrintSeries("Frame time", frameTimes, frameCount);
+	PrintSeries("Frame interval", frameIntervals, intervalCount);
+	std::cout << "CPU usage: " << 100.0 * cpuSeconds / std::max(wallSeconds, 1e-9) << "% overall (all threads), "
+		<< 100.0 * idleCpuSeconds / std::max(idleWallSeconds, 1e-9) << "% of the render thread while idle" << std::endl;
+}
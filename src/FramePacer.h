@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <ctime>
+#include <vector>
+
+// Caps the frame rate and keeps statistics about how evenly frames are delivered
+// and how much CPU the viewer burns while it has nothing to draw.
+class FramePacer
+{
+public:
+	FramePacer();
+	~FramePacer();
+
+	// Limit rendering to fps frames per second, 0 disables the cap.
+	void setFrameRateCap(double fps);
+	double getFrameRateCap() const { return frameRateCap; }
+
+	// Seconds until the capped frame may start, 0 when it may start now.
+	double timeUntilNextFrame() const;
+
+	// Block until the next frame slot. Sleeps for the bulk of the wait and spins
+	// the last stretch so the frame starts close to its deadline.
+	void waitForNextFrame();
+
+	// Mark the start and end of a rendered frame.
+	void beginFrame();
+	void endFrame();
+
+	// Prints frame time, jitter and CPU usage since the pacer was created. The
+	// overall figure counts every thread of the process, the idle one only the
+	// thread that renders frames, which must be the one that created the pacer.
+	void printStats() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	double frameRateCap = 0.0;
+	Clock::duration frameInterval;
+	Clock::time_point nextFrame;
+
+	Clock::time_point startTime;
+	std::clock_t startCpu;
+	double startThreadCpu;
+
+	Clock::time_point frameStart;
+	Clock::time_point lastFrameStart;
+	bool hasLastFrame = false;
+
+	// seconds spent inside frames, and the gaps between frame starts, for the
+	// most recent maxSamples frames; preallocated so recording never allocates
+	static const int maxSamples = 1 << 16;
+	std::vector<double> frameTimes;
+	std::vector<double> frameIntervals;
+	long long frameCount = 0;
+	long long intervalCount = 0;
+	double totalFrameSeconds = 0.0;
+	double busyThreadCpuSeconds = 0.0;
+	double frameStartThreadCpu = 0.0;
+};
@@ -0,0 +1,306 @@
+#include "FrameWriter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameWriter::FrameWriter()
+{
+}
+
+FrameWriter::~FrameWriter()
+{
+	finish();
+}
+
+bool FrameWriter::start(const char *filePrefix, CaptureFormat captureFormat, int w, int h, int threadCount, int buffers)
+{
+	finish();
+
+	prefix = filePrefix;
+	format = captureFormat;
+	width = w;
+	height = h;
+
+	storage.assign(buffers, std::vector<unsigned char>(frameBytes()));
+	freeBuffers.clear();
+	for (int i = 0; i < buffers; i++) {
+		freeBuffers.push_back(&storage[i][0]);
+	}
+	jobs.assign(buffers, Job());
+	jobHead = 0;
+	jobCount = 0;
+	stopping = false;
+	written = dropped = errors = 0;
+	writeSeconds = 0.0;
+
+	if (threadCount <= 0) {
+		threadCount = std::max((int)std::thread::hardware_concurrency(), 2);
+	}
+	for (int i = 0; i < threadCount; i++) {
+		threads.push_back(std::thread(&FrameWriter::writerLoop, this));
+	}
+	return true;
+}
+
+unsigned char *FrameWriter::acquire()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (freeBuffers.empty()) {
+		return 0;
+	}
+	unsigned char *pixels = freeBuffers.back();
+	freeBuffers.pop_back();
+	return pixels;
+}
+
+void FrameWriter::submit(unsigned char *pixels, int frame)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		Job job = {pixels, frame};
+		jobs[(jobHead + jobCount) % jobs.size()] = job;
+		jobCount++;
+	}
+	jobReady.notify_one();
+}
+
+void FrameWriter::finish()
+{
+	if (threads.empty()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	threads.clear();
+}
+
+void FrameWriter::writerLoop()
+{
+	std::vector<unsigned char> scratch;
+
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			jobReady.wait(guard, [this]() { return stopping || jobCount > 0; });
+			// queued frames are still written when stopping
+			if (jobCount == 0) {
+				return;
+			}
+			job = jobs[jobHead];
+			jobHead = (jobHead + 1) % jobs.size();
+			jobCount--;
+		}
+
+		Clock::time_point start = Clock::now();
+		bool ok = writeFrame(job.pixels, job.frame, scratch);
+		Clock::time_point end = Clock::now();
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (written == 0 && errors == 0) {
+			firstWriteStart = start;
+		}
+		firstWriteStart = std::min(firstWriteStart, start);
+		lastWriteEnd = std::max(lastWriteEnd, end);
+		writeSeconds += std::chrono::duration<double>(end - start).count();
+		if (ok) {
+			written++;
+		} else {
+			errors++;
+		}
+		freeBuffers.push_back(job.pixels);
+	}
+}
+
+bool FrameWriter::writeFrame(const unsigned char *pixels, int frame, std::vector<unsigned char> &scratch)
+{
+	char fileName[1024];
+	snprintf(fileName, sizeof(fileName), "%s%06d.%s", prefix.c_str(), frame, format == CapturePng ? "png" : "rgba");
+
+	if (format == CapturePng) {
+		return WritePng(fileName, pixels, width, height, true, scratch);
+	}
+
+	FILE *file = fopen(fileName, "wb");
+	if (!file) {
+		return false;
+	}
+	bool ok = fwrite(pixels, 1, frameBytes(), file) == frameBytes();
+	return fclose(file) == 0 && ok;
+}
+
+double FrameWriter::sustainedFramesPerSecond() const
+{
+	if (written < 2) {
+		return 0.0;
+	}
+	return written / std::chrono::duration<double>(lastWriteEnd - firstWriteStart).count();
+}
+
+void FrameWriter::printStats() const
+{
+	std::cout << "Captured " << written << " frames of " << width << "x" << height << " at "
+		<< sustainedFramesPerSecond() << " fps sustained, " << averageWriteMilliseconds() << " ms per write, "
+		<< dropped << " dropped waiting for the disk";
+	if (errors) {
+		std::cout << ", " << errors << " failed to write";
+	}
+	std::cout << std::endl;
+}
+
+// PNG chunks are checksummed with CRC-32, the zlib stream with Adler-32
+struct CrcTable
+{
+	uint32_t entries[256];
+
+	CrcTable()
+	{
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) {
+				c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			entries[n] = c;
+		}
+	}
+};
+
+static uint32_t Crc32(uint32_t crc, const unsigned char *data, size_t length)
+{
+	// function statics are initialised once even with several writer threads
+	static const CrcTable crcTable;
+	const uint32_t *table = crcTable.entries;
+
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void PutBigEndian(std::vector<unsigned char> &out, uint32_t value)
+{
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+static bool WriteChunk(FILE *file, const char *type, const unsigned char *data, size_t length)
+{
+	unsigned char header[8] = {
+		(unsigned char)(length >> 24), (unsigned char)(length >> 16), (unsigned char)(length >> 8), (unsigned char)length,
+		(unsigned char)type[0], (unsigned char)type[1], (unsigned char)type[2], (unsigned char)type[3]
+	};
+	uint32_t crc = Crc32(0, header + 4, 4);
+	crc = Crc32(crc, data, length);
+	unsigned char footer[4] = {(unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc};
+
+	return fwrite(header, 1, 8, file) == 8 &&
+		(length == 0 || fwrite(data, 1, length, file) == length) &&
+		fwrite(footer, 1, 4, file) == 4;
+}
+
+bool WritePng(const char *fileName, const unsigned char *rgba, int width, int height, bool bottomUp, std::vector<unsigned char> &scratch)
+{
+	size_t rowBytes = (size_t)width * 4;
+	size_t rawBytes = (rowBytes + 1) * height;
+	const size_t maxBlock = 65535;
+
+	// zlib header, stored deflate blocks of each filter byte and row, Adler-32
+	scratch.clear();
+	scratch.reserve(2 + rawBytes + 5 * (rawBytes / maxBlock + 1) + 4);
+	scratch.push_back(0x78);
+	scratch.push_back(0x01);
+
+	uint32_t adlerA = 1, adlerB = 0;
+	size_t blockLeft = 0;
+	size_t rawLeft = rawBytes;
+	for (int y = 0; y < height; y++) {
+		const unsigned char *row = rgba + (bottomUp ? (size_t)(height - 1 - y) : (size_t)y) * rowBytes;
+		for (size_t i = 0; i <= rowBytes; i++) {
+			if (blockLeft == 0) {
+				blockLeft = std::min(rawLeft, maxBlock);
+				scratch.push_back(rawLeft <= maxBlock ? 1 : 0);
+				scratch.push_back((unsigned char)blockLeft);
+				scratch.push_back((unsigned char)(blockLeft >> 8));
+				scratch.push_back((unsigned char)~blockLeft);
+				scratch.push_back((unsigned char)(~blockLeft >> 8));
+			}
+
+			// filter type 0 in front of every row
+			unsigned char byte = i == 0 ? 0 : row[i - 1];
+			scratch.push_back(byte);
+			adlerA = (adlerA + byte) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+			blockLeft--;
+			rawLeft--;
+		}
+	}
+	PutBigEndian(scratch, (adlerB << 16) | adlerA);
+
+	FILE *file = fopen(fileName, "wb");
+	if (!file) {
+		return false;
+	}
+
+	static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	unsigned char header[13] = {
+		(unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+		(unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+		8, 6, 0, 0, 0  // 8 bits per channel, RGBA, deflate, no filter choice, no interlace
+	};
+	bool ok = fwrite(signature, 1, 8, file) == 8 &&
+		WriteChunk(file, "IHDR", header, sizeof(header)) &&
+		WriteChunk(file, "IDAT", &scratch[0], scratch.size()) &&
+		WriteChunk(file, "IEND", 0, 0);
+	return fclose(file) == 0 && ok;
+}
+
+void BenchmarkFrameWriter()
+{
+	typedef std::chrono::steady_clock Clock;
+	const int frames = 30;
+	const int sizes[3][2] = {{800, 800}, {1920, 1080}, {3840, 2160}};
+
+	std::cout << "size\tformat\tfps\tMB/s\tms per write" << std::endl;
+	for (int s = 0; s < 3; s++) {
+		for (int f = 0; f < 2; f++) {
+			CaptureFormat format = f == 0 ? CapturePng : CaptureRaw;
+			FrameWriter writer;
+			writer.start("capture_bench_", format, sizes[s][0], sizes[s][1]);
+
+			// submit as fast as buffers come back, which is the most the disk sustains
+			Clock::time_point start = Clock::now();
+			for (int frame = 0; frame < frames; frame++) {
+				unsigned char *pixels;
+				while ((pixels = writer.acquire()) == 0) {
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+				}
+				memset(pixels, frame * 8, writer.frameBytes());
+				writer.submit(pixels, frame);
+			}
+			writer.finish();
+			double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			std::cout << sizes[s][0] << "x" << sizes[s][1] << "\t" << (format == CapturePng ? "png" : "raw") << "\t"
+				<< frames / seconds << "\t" << frames * writer.frameBytes() / seconds / 1e6 << "\t"
+				<< writer.averageWriteMilliseconds() << std::endl;
+
+			for (int frame = 0; frame < frames; frame++) {
+				char fileName[64];
+				snprintf(fileName, sizeof(fileName), "capture_bench_%06d.%s", frame, format == CapturePng ? "png" : "rgba");
+				remove(fileName);
+			}
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat
+{
+	CapturePng,  // one PNG per frame
+	CaptureRaw   // one file of bottom-up RGBA bytes per frame
+};
+
+// Encodes and writes captured frames on a pool of threads.
+//
+// Frames are RGBA, bottom row first as glReadPixels returns them. A fixed set
+// of frame buffers is allocated up front; the renderer fills a free one and
+// submits it, and a writer thread returns it once the frame is on disk. When
+// every buffer is still waiting for the disk acquire returns null and the
+// frame should be dropped, so rendering never waits on the disk.
+class FrameWriter
+{
+public:
+	FrameWriter();
+	~FrameWriter();
+
+	// Files are named prefix000042.png (or .rgba). threads 0 picks one per hardware thread.
+	bool start(const char *prefix, CaptureFormat format, int width, int height, int threads = 0, int buffers = 8);
+	bool isRunning() const { return !threads.empty(); }
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	size_t frameBytes() const { return (size_t)width * height * 4; }
+
+	// a free frame buffer of frameBytes(), or null if all of them are queued
+	unsigned char *acquire();
+	void submit(unsigned char *pixels, int frame);
+	void drop() { dropped++; }
+
+	// write everything still queued and stop the threads
+	void finish();
+
+	uint64_t getFramesWritten() const { return written; }
+	uint64_t getFramesDropped() const { return dropped; }
+	uint64_t getWriteErrors() const { return errors; }
+	// frames per second from the first write starting to the last one finishing
+	double sustainedFramesPerSecond() const;
+	double averageWriteMilliseconds() const { return written ? writeSeconds * 1000.0 / written : 0.0; }
+
+	void printStats() const;
+
+private:
+	FrameWriter(const FrameWriter &);
+	FrameWriter &operator=(const FrameWriter &);
+
+	struct Job
+	{
+		unsigned char *pixels;
+		int frame;
+	};
+
+	void writerLoop();
+	bool writeFrame(const unsigned char *pixels, int frame, std::vector<unsigned char> &scratch);
+
+	std::string prefix;
+	CaptureFormat format = CapturePng;
+	int width = 0;
+	int height = 0;
+
+	std::vector<std::vector<unsigned char> > storage;
+	std::vector<unsigned char *> freeBuffers;
+	// queued jobs in a ring as large as the buffer count, so queueing never allocates
+	std::vector<Job> jobs;
+	size_t jobHead = 0;
+	size_t jobCount = 0;
+
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable jobReady;
+	bool stopping = false;
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point firstWriteStart;
+	Clock::time_point lastWriteEnd;
+	double writeSeconds = 0.0;
+	uint64_t written = 0;
+	uint64_t dropped = 0;
+	uint64_t errors = 0;
+};
+
+// Write an RGBA image as a PNG with stored (uncompressed) deflate blocks, flipping
+// it if rows are bottom-up. scratch is reused between calls.
+bool WritePng(const char *fileName, const unsigned char *rgba, int width, int height, bool bottomUp, std::vector<unsigned char> &scratch);
+
+// Sustained write rate of the writer pool for PNG and raw frames at several sizes.
+void BenchmarkFrameWriter();
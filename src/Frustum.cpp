@@ -0,0 +1,33 @@
+#include "Frustum.h"
+
+Frustum Frustum::FromViewProjection(const glm::mat4 &m)
+{
+	// Gribb and Hartmann, rows of the column-major matrix
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	frustum.planes[4] = row3 + row2;
+	frustum.planes[5] = row3 - row2;
+	for (int i = 0; i < 6; i++) {
+		glm::vec3 normal(frustum.planes[i]);
+		frustum.planes[i] = frustum.planes[i] * (1.0f / glm::length(normal));
+	}
+	return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const
+{
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
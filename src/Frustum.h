@@ -0,0 +1,11 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// View frustum as six inward facing planes, (normal, distance).
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	static Frustum FromViewProjection(const glm::mat4 &viewProjection);
+	bool intersectsSphere(const glm::vec3 &center, float radius) const;
+};
@@ -0,0 +1,184 @@
+#include "ImpostorAtlas.h"
+
+#include <iostream>
+
+ImpostorAtlas::ImpostorAtlas()
+{
+}
+
+ImpostorAtlas::~ImpostorAtlas()
+{
+	// the GL objects go with the context
+}
+
+bool ImpostorAtlas::init(int size, int cell)
+{
+	atlasSize = size;
+	cellSize = cell;
+	cellsPerRow = size / cell;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Impostor atlas framebuffer is incomplete, far robots will not be drawn" << std::endl;
+		glDeleteFramebuffers(1, &framebuffer);
+		framebuffer = 0;
+		return false;
+	}
+
+	cells.assign(cellsPerRow * cellsPerRow, Cell());
+	size_t slots = 1;
+	while (slots < 2 * cells.size()) {
+		slots <<= 1;
+	}
+	KeySlot empty = {0, -1};
+	keySlots.assign(slots, empty);
+	slotMask = slots - 1;
+	unusedCells = (int)cells.size();
+	return true;
+}
+
+size_t ImpostorAtlas::slotOf(uint64_t key) const
+{
+	// pose keys differ in their low bits, mix them over the whole word first
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return (size_t)key & slotMask;
+}
+
+int ImpostorAtlas::lookup(uint64_t key) const
+{
+	for (size_t slot = slotOf(key); keySlots[slot].cell >= 0; slot = (slot + 1) & slotMask) {
+		if (keySlots[slot].key == key) {
+			return keySlots[slot].cell;
+		}
+	}
+	return -1;
+}
+
+void ImpostorAtlas::insert(uint64_t key, int cell)
+{
+	size_t slot = slotOf(key);
+	while (keySlots[slot].cell >= 0 && keySlots[slot].key != key) {
+		slot = (slot + 1) & slotMask;
+	}
+	keySlots[slot].key = key;
+	keySlots[slot].cell = cell;
+}
+
+void ImpostorAtlas::erase(uint64_t key)
+{
+	size_t slot = slotOf(key);
+	while (keySlots[slot].cell >= 0 && keySlots[slot].key != key) {
+		slot = (slot + 1) & slotMask;
+	}
+	if (keySlots[slot].cell < 0) {
+		return;
+	}
+
+	// shift later entries of the probe run back so lookups never stop early at the hole
+	size_t hole = slot;
+	for (size_t next = (hole + 1) & slotMask; keySlots[next].cell >= 0; next = (next + 1) & slotMask) {
+		size_t home = slotOf(keySlots[next].key);
+		// next can fill the hole unless its home lies cyclically in (hole, next]
+		if (((next - home) & slotMask) >= ((next - hole) & slotMask)) {
+			keySlots[hole] = keySlots[next];
+			hole = next;
+		}
+	}
+	keySlots[hole].cell = -1;
+}
+
+int ImpostorAtlas::find(uint64_t key, uint64_t frame)
+{
+	if (keySlots.empty()) {
+		return -1;
+	}
+	int cell = lookup(key);
+	if (cell < 0) {
+		return -1;
+	}
+	cells[cell].lastUsed = frame;
+	hits++;
+	return cell;
+}
+
+int ImpostorAtlas::allocate(uint64_t key, uint64_t frame)
+{
+	int cell = -1;
+	if (unusedCells > 0) {
+		cell = (int)cells.size() - unusedCells;
+		unusedCells--;
+	} else {
+		// least recently used, but never one already shown this frame
+		uint64_t oldest = frame;
+		for (size_t i = 0; i < cells.size(); i++) {
+			if (cells[i].lastUsed < oldest) {
+				oldest = cells[i].lastUsed;
+				cell = (int)i;
+			}
+		}
+		if (cell < 0) {
+			return -1;
+		}
+		erase(cells[cell].key);
+		evictions++;
+	}
+
+	cells[cell].key = key;
+	cells[cell].lastUsed = frame;
+	insert(key, cell);
+	draws++;
+	return cell;
+}
+
+glm::vec4 ImpostorAtlas::cellTexCoords(int cell) const
+{
+	float step = (float)cellSize / atlasSize;
+	float u = (cell % cellsPerRow) * step;
+	float v = (cell / cellsPerRow) * step;
+	return glm::vec4(u, v, u + step, v + step);
+}
+
+void ImpostorAtlas::beginDrawing(int cell)
+{
+	int x = (cell % cellsPerRow) * cellSize;
+	int y = (cell / cellsPerRow) * cellSize;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(x, y, cellSize, cellSize);
+
+	// only clear this cell, the others hold live pictures
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(x, y, cellSize, cellSize);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+}
+
+void ImpostorAtlas::endDrawing(int windowWidth, int windowHeight)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+}
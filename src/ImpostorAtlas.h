@@ -0,0 +1,81 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Cached pictures of far robots packed into the cells of one texture.
+//
+// A cell is keyed by the robot's quantized pose and the side it is seen from
+// (see ImpostorRequest), so every robot in the same pose shares a picture and
+// a picture is only redrawn once the pose has changed enough to change its
+// key. When the atlas is full the least recently used cell is reused. Keys are
+// looked up in an open addressing table sized for every cell at init, so
+// finding and allocating cells never allocates.
+class ImpostorAtlas
+{
+public:
+	ImpostorAtlas();
+	~ImpostorAtlas();
+
+	// Create the texture and framebuffer, atlasSize / cellSize cells on a side.
+	bool init(int atlasSize = 2048, int cellSize = 128);
+	bool isReady() const { return framebuffer != 0; }
+
+	// The cell holding key, or -1. Marks the cell as used this frame.
+	int find(uint64_t key, uint64_t frame);
+
+	// Give key a cell that the caller must then draw. Returns -1 when every
+	// cell is already in use this frame.
+	int allocate(uint64_t key, uint64_t frame);
+
+	// u0, v0, u1, v1 of a cell
+	glm::vec4 cellTexCoords(int cell) const;
+
+	// Draw into a cell: binds the atlas framebuffer, limits the viewport to the
+	// cell and clears it to transparent. endDrawing restores the window.
+	void beginDrawing(int cell);
+	void endDrawing(int windowWidth, int windowHeight);
+
+	GLuint getTexture() const { return texture; }
+	int cellCount() const { return (int)cells.size(); }
+
+	uint64_t getHits() const { return hits; }
+	uint64_t getDraws() const { return draws; }
+	uint64_t getEvictions() const { return evictions; }
+
+private:
+	struct Cell
+	{
+		uint64_t key = 0;
+		uint64_t lastUsed = 0;
+	};
+
+	// linear probing over keySlots, at most half full; a slot is empty when its cell is -1
+	struct KeySlot
+	{
+		uint64_t key;
+		int cell;
+	};
+	size_t slotOf(uint64_t key) const;
+	int lookup(uint64_t key) const;
+	void insert(uint64_t key, int cell);
+	void erase(uint64_t key);
+
+	int atlasSize = 0;
+	int cellSize = 0;
+	int cellsPerRow = 0;
+
+	GLuint texture = 0;
+	GLuint depthBuffer = 0;
+	GLuint framebuffer = 0;
+
+	std::vector<Cell> cells;
+	std::vector<KeySlot> keySlots;
+	size_t slotMask = 0;
+	int unusedCells = 0;
+
+	uint64_t hits = 0;
+	uint64_t draws = 0;
+	uint64_t evictions = 0;
+};
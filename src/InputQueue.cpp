@@ -0,0 +1,135 @@
+#include "InputQueue.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+InputQueue::InputQueue()
+{
+}
+
+InputQueue::~InputQueue()
+{
+}
+
+void InputQueue::push(const InputEvent &event)
+{
+	// moving the cursor without a button held only matters for the next drag's
+	// starting point, so consecutive hover moves keep just the latest position
+	bool hover = event.type == InputEvent::CursorMove && event.buttons == 0;
+	if (hover && !events.empty() && events.back().type == InputEvent::CursorMove && events.back().buttons == 0) {
+		events.back() = event;
+		return;
+	}
+	events.push_back(event);
+}
+
+void InputQueue::coalesce(FrameInput &input)
+{
+	input.zoomInSteps = 0;
+	input.zoomOutSteps = 0;
+	input.orbitDelta = {0.0f, 0.0f};
+	input.panDelta = {0.0f, 0.0f};
+	input.characters.clear();
+	input.oldestEventTime = -1.0;
+
+	for (size_t i = 0; i < events.size(); i++) {
+		const InputEvent &event = events[i];
+
+		// hover moves change nothing on screen and do not count towards latency
+		bool hover = event.type == InputEvent::CursorMove && event.buttons == 0;
+		if (!hover && input.oldestEventTime < 0.0) {
+			input.oldestEventTime = event.time;
+		}
+
+		switch (event.type) {
+			case InputEvent::Scroll:
+				if (event.y < 0) {
+					input.zoomOutSteps++;
+				} else {
+					input.zoomInSteps++;
+				}
+				break;
+
+			case InputEvent::CursorMove: {
+				glm::vec2 currentCursorPosition = {(float) event.x, (float) event.y};
+				glm::vec2 cursorPositionDelta = prevCursorPosition - currentCursorPosition;
+				if (event.buttons & 1) {
+					input.orbitDelta += cursorPositionDelta;
+				}
+				if (event.buttons & 2) {
+					input.panDelta += cursorPositionDelta;
+				}
+				prevCursorPosition = currentCursorPosition;
+				break;
+			}
+
+			case InputEvent::Character:
+				input.characters.push_back(event.key);
+				break;
+		}
+	}
+
+	// keeps its capacity, so steady-state frames do not allocate
+	events.clear();
+}
+
+LatencyHistogram::LatencyHistogram(double bucketWidthMs, int bucketCount)
+{
+	bucketWidth = bucketWidthMs;
+	// last bucket collects everything past the range
+	buckets.assign(bucketCount + 1, 0);
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+}
+
+void LatencyHistogram::record(double seconds)
+{
+	double ms = seconds * 1000.0;
+	int bucket = std::min((int)(ms / bucketWidth), (int)buckets.size() - 1);
+	buckets[std::max(bucket, 0)]++;
+	samples++;
+	totalMs += ms;
+	maxMs = std::max(maxMs, ms);
+}
+
+double LatencyHistogram::percentile(double fraction) const
+{
+	int target = (int)(fraction * samples);
+	int seen = 0;
+	for (size_t i = 0; i < buckets.size(); i++) {
+		seen += buckets[i];
+		if (seen > target) {
+			// the overflow bucket has no upper edge, the slowest sample bounds it
+			return i + 1 < buckets.size() ? (i + 1) * bucketWidth : maxMs;
+		}
+	}
+	return maxMs;
+}
+
+void LatencyHistogram::print(const char *name) const
+{
+	std::cout << name << ": " << samples << " samples";
+	if (samples == 0) {
+		std::cout << std::endl;
+		return;
+	}
+	// a percentile in the overflow bucket is the maximum itself
+	std::cout << ", mean " << totalMs / samples << " ms, p50 <= " << percentile(0.5)
+		<< " ms, p99 <= " << percentile(0.99) << " ms, max " << maxMs << " ms" << std::endl;
+
+	int largest = *std::max_element(buckets.begin(), buckets.end());
+	for (size_t i = 0; i < buckets.size(); i++) {
+		if (buckets[i] == 0) {
+			continue;
+		}
+		if (i + 1 == buckets.size()) {
+			std::cout << "  >= " << i * bucketWidth << " ms\t";
+		} else {
+			std::cout << "  " << i * bucketWidth << "-" << (i + 1) * bucketWidth << " ms\t";
+		}
+		std::cout << buckets[i] << "\t" << std::string(1 + 40 * buckets[i] / largest, '#') << std::endl;
+	}
+}
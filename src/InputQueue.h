@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+// One raw input callback, stamped with glfwGetTime() when it arrived.
+struct InputEvent
+{
+	enum Type { Scroll, CursorMove, Character };
+
+	Type type;
+	double time;
+	double x, y;
+	unsigned int key;
+	// mouse buttons held when the event arrived, bit 0 left, bit 1 right
+	int buttons;
+};
+
+// Everything that happened since the last frame, collapsed into one update.
+struct FrameInput
+{
+	// number of scroll ticks in each direction
+	int zoomInSteps = 0;
+	int zoomOutSteps = 0;
+
+	// cursor movement (previous - current, as the camera code expects),
+	// accumulated separately for each held button
+	glm::vec2 orbitDelta{0.0f, 0.0f};
+	glm::vec2 panDelta{0.0f, 0.0f};
+
+	// typed characters in arrival order
+	std::vector<unsigned int> characters;
+
+	// arrival time of the oldest event in this frame, negative when there was none
+	double oldestEventTime = -1.0;
+
+	bool empty() const { return oldestEventTime < 0.0; }
+};
+
+// Collects input between frames so the camera and pose are updated once per
+// frame instead of once per raw event.
+class InputQueue
+{
+public:
+	InputQueue();
+	~InputQueue();
+
+	void push(const InputEvent &event);
+
+	// Fold all queued events into input and clear the queue.
+	void coalesce(FrameInput &input);
+
+	int pendingCount() const { return (int)events.size(); }
+
+private:
+	std::vector<InputEvent> events;
+
+	// cursor position of the last move event, carried across frames
+	glm::vec2 prevCursorPosition{0.0f, 0.0f};
+};
+
+// Fixed-width latency histogram in milliseconds with an overflow bucket.
+class LatencyHistogram
+{
+public:
+	LatencyHistogram(double bucketWidthMs = 1.0, int bucketCount = 50);
+	~LatencyHistogram();
+
+	void record(double seconds);
+
+	// latency in milliseconds at or below which the given fraction of samples
+	// fall, the maximum when that is in the overflow bucket
+	double percentile(double fraction) const;
+	int sampleCount() const { return samples; }
+
+	void print(const char *name) const;
+
+private:
+	double bucketWidth;
+	std::vector<int> buckets;
+	int samples = 0;
+	double totalMs = 0.0;
+	double maxMs = 0.0;
+};
@@ -0,0 +1,164 @@
+#include "InputTrace.h"
+
+#include <cstring>
+#include <iostream>
+
+static const char traceMagic[4] = {'R', 'B', 'I', 'T'};
+static const unsigned char traceVersion = 1;
+
+InputRecorder::InputRecorder()
+{
+}
+
+InputRecorder::~InputRecorder()
+{
+	close();
+}
+
+bool InputRecorder::open(const char *fileName)
+{
+	file.open(fileName, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::cerr << "Failed to open the input trace for writing:" << fileName << std::endl;
+		return false;
+	}
+	file.write(traceMagic, sizeof(traceMagic));
+	file.put((char)traceVersion);
+	lastFrame = 0;
+	events = 0;
+	return true;
+}
+
+void InputRecorder::close()
+{
+	if (file.is_open()) {
+		file.close();
+	}
+}
+
+void InputRecorder::writeVarint(unsigned int value)
+{
+	while (value >= 0x80) {
+		file.put((char)((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	file.put((char)value);
+}
+
+void InputRecorder::record(int frame, const InputEvent &event)
+{
+	if (!file.is_open()) {
+		return;
+	}
+
+	writeVarint((unsigned int)(frame - lastFrame));
+	lastFrame = frame;
+	file.put((char)(event.type | (event.buttons << 2)));
+
+	float values[2] = {(float)event.x, (float)event.y};
+	switch (event.type) {
+		case InputEvent::Scroll:
+			file.write((const char *)&values[1], sizeof(float));
+			break;
+		case InputEvent::CursorMove:
+			file.write((const char *)values, sizeof(values));
+			break;
+		case InputEvent::Character:
+			writeVarint(event.key);
+			break;
+	}
+	events++;
+}
+
+InputPlayer::InputPlayer()
+{
+}
+
+InputPlayer::~InputPlayer()
+{
+}
+
+static bool ReadVarint(std::ifstream &file, unsigned int &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		int c = file.get();
+		if (c == EOF) {
+			return false;
+		}
+		value |= (unsigned int)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool InputPlayer::open(const char *fileName)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file) {
+		std::cerr << "Failed to open the input trace:" << fileName << std::endl;
+		return false;
+	}
+
+	char magic[4];
+	file.read(magic, sizeof(magic));
+	if (!file || memcmp(magic, traceMagic, sizeof(magic)) != 0 || file.get() != traceVersion) {
+		std::cerr << "Not an input trace:" << fileName << std::endl;
+		return false;
+	}
+
+	frames.clear();
+	events.clear();
+	next = 0;
+
+	int frame = 0;
+	unsigned int frameDelta;
+	while (ReadVarint(file, frameDelta)) {
+		int header = file.get();
+		if (header == EOF) {
+			break;
+		}
+
+		InputEvent event = {(InputEvent::Type)(header & 3), 0.0, 0.0, 0.0, 0, header >> 2};
+		float values[2] = {0.0f, 0.0f};
+		switch (event.type) {
+			case InputEvent::Scroll:
+				file.read((char *)&values[1], sizeof(float));
+				break;
+			case InputEvent::CursorMove:
+				file.read((char *)values, sizeof(values));
+				break;
+			case InputEvent::Character:
+				if (!ReadVarint(file, event.key)) {
+					file.setstate(std::ios::failbit);
+				}
+				break;
+			default:
+				file.setstate(std::ios::failbit);
+				break;
+		}
+		if (!file) {
+			std::cerr << "Truncated input trace:" << fileName << std::endl;
+			return false;
+		}
+
+		event.x = values[0];
+		event.y = values[1];
+		frame += frameDelta;
+		frames.push_back(frame);
+		events.push_back(event);
+	}
+
+	return true;
+}
+
+void InputPlayer::feedFrame(int frame, double time, InputQueue &queue)
+{
+	while (next < events.size() && frames[next] <= frame) {
+		InputEvent event = events[next++];
+		event.time = time;
+		queue.push(event);
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <vector>
+#include "InputQueue.h"
+
+// Binary input trace: a small header followed by one record per event.
+// Each record is the frame delta since the previous record as a varint, one
+// byte holding the event type and mouse buttons, and a type specific payload
+// (scroll: float y, cursor: float x and y, character: varint key).
+class InputRecorder
+{
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	bool open(const char *fileName);
+	void close();
+	bool isOpen() const { return file.is_open(); }
+
+	// Append an event that will be applied in the given frame.
+	void record(int frame, const InputEvent &event);
+
+	int eventCount() const { return events; }
+
+private:
+	void writeVarint(unsigned int value);
+
+	std::ofstream file;
+	int lastFrame = 0;
+	int events = 0;
+};
+
+class InputPlayer
+{
+public:
+	InputPlayer();
+	~InputPlayer();
+
+	// Reads the whole trace, returns false if it is missing or malformed.
+	bool open(const char *fileName);
+
+	// Push every event recorded for this frame, stamped with the given time.
+	void feedFrame(int frame, double time, InputQueue &queue);
+
+	// Frame of the last recorded event.
+	int lastFrame() const { return frames.empty() ? -1 : frames.back(); }
+	bool finished() const { return next >= events.size(); }
+
+private:
+	std::vector<int> frames;
+	std::vector<InputEvent> events;
+	size_t next = 0;
+};
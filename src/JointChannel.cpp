@@ -0,0 +1,313 @@
+#include "JointChannel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static const char jointChannelMagic[4] = {'R', 'B', 'J', 'C'};
+static const uint32_t jointChannelVersion = 1;
+
+uint64_t JointChannelNow()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+JointChannel::JointChannel()
+{
+}
+
+JointChannel::~JointChannel()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool JointChannel::create(const char *name)
+{
+	std::cerr << "The joint command channel needs POSIX shared memory" << std::endl;
+	return false;
+}
+
+bool JointChannel::open(const char *name)
+{
+	return create(name);
+}
+
+void JointChannel::close()
+{
+}
+
+#else
+
+static JointChannelLayout *MapSegment(int fd)
+{
+	void *mapping = mmap(0, sizeof(JointChannelLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	return mapping == MAP_FAILED ? 0 : (JointChannelLayout *)mapping;
+}
+
+bool JointChannel::create(const char *name)
+{
+	close();
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+	if (fd < 0 || ftruncate(fd, sizeof(JointChannelLayout)) != 0) {
+		std::cerr << "Failed to create the shared memory segment:" << name << std::endl;
+		if (fd >= 0) {
+			::close(fd);
+		}
+		return false;
+	}
+
+	layout = MapSegment(fd);
+	if (!layout) {
+		std::cerr << "Failed to map the shared memory segment:" << name << std::endl;
+		return false;
+	}
+
+	// construct the atomics in place, then stamp the header last so a client
+	// attaching early never sees a half initialised segment as valid
+	memset((void *)layout, 0, sizeof(JointChannelLayout));
+	new (&layout->head) std::atomic<uint64_t>(0);
+	new (&layout->tail) std::atomic<uint64_t>(0);
+	new (&layout->sequence) std::atomic<uint32_t>(0);
+	layout->version = jointChannelVersion;
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(layout->magic, jointChannelMagic, sizeof(layout->magic));
+
+	segmentName = name;
+	owner = true;
+	return true;
+}
+
+bool JointChannel::open(const char *name)
+{
+	close();
+	int fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0) {
+		std::cerr << "No joint command channel named " << name << ", is the viewer running with --joint-server?" << std::endl;
+		return false;
+	}
+
+	layout = MapSegment(fd);
+	if (!layout || memcmp(layout->magic, jointChannelMagic, sizeof(layout->magic)) != 0 ||
+		layout->version != jointChannelVersion) {
+		std::cerr << "Not a joint command channel:" << name << std::endl;
+		close();
+		return false;
+	}
+
+	segmentName = name;
+	owner = false;
+	return true;
+}
+
+void JointChannel::close()
+{
+	if (layout) {
+		munmap((void *)layout, sizeof(JointChannelLayout));
+	}
+	if (owner) {
+		shm_unlink(segmentName.c_str());
+	}
+	layout = 0;
+	owner = false;
+}
+
+#endif
+
+bool JointChannel::push(const JointCommand &command)
+{
+	uint64_t head = layout->head.load(std::memory_order_relaxed);
+	uint64_t tail = layout->tail.load(std::memory_order_acquire);
+	if (head - tail >= (uint64_t)jointRingCapacity) {
+		return false;
+	}
+
+	layout->ring[head & (jointRingCapacity - 1)] = command;
+	layout->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+int JointChannel::drain(std::vector<JointCommand> &commands)
+{
+	commands.clear();
+	uint64_t tail = layout->tail.load(std::memory_order_relaxed);
+	uint64_t head = layout->head.load(std::memory_order_acquire);
+	for (uint64_t i = tail; i != head; i++) {
+		commands.push_back(layout->ring[i & (jointRingCapacity - 1)]);
+	}
+	layout->tail.store(head, std::memory_order_release);
+	return (int)commands.size();
+}
+
+void JointChannel::publish(const std::vector<glm::mat4> &worldTransforms, const JointFrameInfo &info)
+{
+	uint32_t sequence = layout->sequence.load(std::memory_order_relaxed);
+	layout->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	int count = std::min((int)worldTransforms.size(), jointStateMaxElements);
+	layout->elementCount = count;
+	layout->info = info;
+	for (int i = 0; i < count; i++) {
+		memcpy(layout->worldTransforms[i], &worldTransforms[i][0][0], sizeof(float) * 16);
+	}
+
+	layout->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void JointChannel::read(JointState &state) const
+{
+	for (;;) {
+		uint32_t before = layout->sequence.load(std::memory_order_acquire);
+		if (before & 1) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		int count = std::min((int)layout->elementCount, jointStateMaxElements);
+		state.info = layout->info;
+		state.worldTransforms.resize(count);
+		for (int i = 0; i < count; i++) {
+			memcpy(&state.worldTransforms[i][0][0], layout->worldTransforms[i], sizeof(float) * 16);
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (layout->sequence.load(std::memory_order_relaxed) == before) {
+			return;
+		}
+	}
+}
+
+void RunJointClient(const char *name, double seconds)
+{
+	JointChannel channel;
+	if (!channel.open(name)) {
+		return;
+	}
+
+	JointState state;
+	channel.read(state);
+	if (state.worldTransforms.empty()) {
+		std::cerr << "The viewer has not published a frame yet" << std::endl;
+		return;
+	}
+	int joints = (int)state.worldTransforms.size();
+
+	std::cout << "rate (Hz)\tsent\tdropped\tapplied\tframes\tnewest latency (us)\toldest latency (us)" << std::endl;
+
+	const double rates[] = {1000.0, 10000.0, 100000.0, 0.0};
+	for (int r = 0; r < 4; r++) {
+		// a rate of 0 pushes as fast as the ring accepts commands
+		uint64_t interval = rates[r] > 0.0 ? (uint64_t)(1e9 / rates[r]) : 0;
+		uint64_t start = JointChannelNow();
+		uint64_t end = start + (uint64_t)(seconds * 1e9);
+		uint64_t next = start;
+
+		channel.read(state);
+		uint64_t firstApplied = state.info.commandsApplied;
+		uint64_t lastFrame = state.info.frame;
+		uint64_t sent = 0, dropped = 0, frames = 0;
+		double newestLatency = 0.0, oldestLatency = 0.0;
+
+		for (uint64_t now = start; now < end; now = JointChannelNow()) {
+			if (now >= next) {
+				// sweep every joint through a slow sine so the motion is visible
+				JointCommand command;
+				memset(&command, 0, sizeof(command));
+				command.joint = (uint32_t)(sent % joints);
+				float angle = 0.5f * (float)std::sin((now - start) * 1e-9 * 2.0);
+				command.rotation[2] = angle;
+				command.timestamp = now;
+				if (channel.push(command)) {
+					sent++;
+				} else {
+					dropped++;
+				}
+				next += interval;
+			}
+
+			// sample the published state whenever the viewer finishes a frame
+			if ((sent & 63) == 0) {
+				channel.read(state);
+				if (state.info.frame != lastFrame && state.info.newestCommandTimestamp >= start) {
+					lastFrame = state.info.frame;
+					newestLatency += (state.info.appliedTimestamp - state.info.newestCommandTimestamp) * 1e-3;
+					oldestLatency += (state.info.appliedTimestamp - state.info.oldestCommandTimestamp) * 1e-3;
+					frames++;
+				}
+			}
+		}
+
+		// let the viewer drain what is left before reporting
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		channel.read(state);
+
+		std::cout << (rates[r] > 0.0 ? rates[r] : -1.0) << "\t" << sent << "\t" << dropped << "\t"
+			<< state.info.commandsApplied - firstApplied << "\t" << frames << "\t"
+			<< (frames ? newestLatency / frames : 0.0) << "\t" << (frames ? oldestLatency / frames : 0.0) << std::endl;
+	}
+}
+
+void BenchmarkJointChannel()
+{
+	JointChannel channel;
+	if (!channel.create("/robot_joint_benchmark")) {
+		return;
+	}
+
+	const uint64_t total = 5000000;
+	double latencySum = 0.0;
+	uint64_t latencyMax = 0;
+	uint64_t received = 0;
+
+	// consumer drains continuously, like a viewer with no frame to wait for
+	std::thread consumer([&]() {
+		std::vector<JointCommand> commands;
+		commands.reserve(jointRingCapacity);
+		while (received < total) {
+			channel.drain(commands);
+			uint64_t now = JointChannelNow();
+			for (size_t i = 0; i < commands.size(); i++) {
+				uint64_t latency = now - commands[i].timestamp;
+				latencySum += latency;
+				latencyMax = std::max(latencyMax, latency);
+			}
+			received += commands.size();
+		}
+	});
+
+	uint64_t start = JointChannelNow();
+	uint64_t full = 0;
+	JointCommand command;
+	memset(&command, 0, sizeof(command));
+	for (uint64_t sent = 0; sent < total; ) {
+		command.timestamp = JointChannelNow();
+		command.joint = (uint32_t)(sent % 10);
+		if (channel.push(command)) {
+			sent++;
+		} else {
+			full++;
+		}
+	}
+	consumer.join();
+	double seconds = (JointChannelNow() - start) * 1e-9;
+
+	std::cout << "commands\t" << total << std::endl;
+	std::cout << "sustained rate\t" << total / seconds / 1e6 << " M commands/s" << std::endl;
+	std::cout << "ring full retries\t" << full << std::endl;
+	std::cout << "mean latency\t" << latencySum / total * 1e-3 << " us" << std::endl;
+	std::cout << "max latency\t" << latencyMax * 1e-3 << " us" << std::endl;
+}
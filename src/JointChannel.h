@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Shared memory interface for driving the robot from another process.
+//
+// The controller pushes timestamped joint targets into a single-producer,
+// single-consumer ring and the viewer drains it once per frame. The viewer
+// publishes every element's world transform through a seqlock so readers never
+// block it. Both sides only touch shared memory after setup, no syscalls.
+
+struct JointCommand
+{
+	// steady clock nanoseconds when the command was issued
+	uint64_t timestamp;
+	// index into the viewer's traversal order
+	uint32_t joint;
+	uint32_t padding;
+	// absolute joint angles about X, Y and Z in radians
+	float rotation[3];
+	float reserved;
+};
+
+// What the viewer did with the commands in its most recent frame.
+struct JointFrameInfo
+{
+	uint64_t frame;
+	// when the ring was drained
+	uint64_t appliedTimestamp;
+	// issue times of the oldest and newest command drained that frame, 0 if none
+	uint64_t oldestCommandTimestamp;
+	uint64_t newestCommandTimestamp;
+	// total commands applied since the channel was created
+	uint64_t commandsApplied;
+};
+
+static const int jointRingCapacity = 4096;
+static const int jointStateMaxElements = 64;
+
+struct JointChannelLayout
+{
+	char magic[4];
+	uint32_t version;
+
+	// ring indices grow without wrapping, each on its own cache line
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint64_t> tail;
+	alignas(64) JointCommand ring[jointRingCapacity];
+
+	// seqlock: odd while the viewer is writing the block below
+	alignas(64) std::atomic<uint32_t> sequence;
+	uint32_t elementCount;
+	JointFrameInfo info;
+	float worldTransforms[jointStateMaxElements][16];
+};
+
+// Snapshot of the published state, read by controllers.
+struct JointState
+{
+	JointFrameInfo info;
+	std::vector<glm::mat4> worldTransforms;
+};
+
+// steady clock in nanoseconds, the shared timebase for both processes
+uint64_t JointChannelNow();
+
+class JointChannel
+{
+public:
+	JointChannel();
+	~JointChannel();
+
+	// Viewer side: create (or reset) the named shared memory segment.
+	bool create(const char *name);
+	// Controller side: attach to a segment the viewer created.
+	bool open(const char *name);
+	void close();
+	bool isOpen() const { return layout != 0; }
+
+	// Controller: queue a command, false when the ring is full.
+	bool push(const JointCommand &command);
+
+	// Viewer: move every queued command into commands (cleared first).
+	int drain(std::vector<JointCommand> &commands);
+
+	// Viewer: publish the current world transforms.
+	void publish(const std::vector<glm::mat4> &worldTransforms, const JointFrameInfo &info);
+
+	// Controller: consistent copy of the last published state.
+	void read(JointState &state) const;
+
+private:
+	JointChannel(const JointChannel &);
+	JointChannel &operator=(const JointChannel &);
+
+	JointChannelLayout *layout = 0;
+	std::string segmentName;
+	bool owner = false;
+};
+
+// Run a controller against a viewer started with --joint-server: stream
+// commands at increasing rates and report the command to applied latency.
+void RunJointClient(const char *name, double seconds);
+
+// In-process producer and consumer threads: maximum sustained command rate
+// and ring latency without a viewer in the loop.
+void BenchmarkJointChannel();
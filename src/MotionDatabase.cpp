@@ -0,0 +1,544 @@
+#include "MotionDatabase.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MOTION_SSE 1
+#include <xmmintrin.h>
+#endif
+
+static const char motionDatabaseMagic[4] = {'R', 'B', 'M', 'M'};
+static const uint32_t motionDatabaseVersion = 1;
+
+struct MotionDatabaseHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t frameCount;
+	uint32_t channelCount;
+	uint32_t featureCount;
+	uint32_t dimensions;
+	uint32_t rowCount;
+	uint32_t leafSize;
+	uint32_t depth;
+	float sampleRate;
+};
+
+MotionDatabase::MotionDatabase()
+{
+}
+
+MotionDatabase::~MotionDatabase()
+{
+	close();
+}
+
+void MotionDatabase::begin(int channelCount, int featuresPerFrame, float rate)
+{
+	close();
+	channels = channelCount;
+	dimensions = std::min((featuresPerFrame + 3) & ~3, (int)maxDimensions);
+	featureCount = std::min(featuresPerFrame, dimensions);
+	sampleRate = rate;
+}
+
+void MotionDatabase::addFrame(const float *frameAngles, const float *frameFeatures, bool hasNext)
+{
+	angleStore.insert(angleStore.end(), frameAngles, frameAngles + channels);
+	rawFeatures.insert(rawFeatures.end(), frameFeatures, frameFeatures + featureCount);
+	continues.push_back(hasNext ? 1 : 0);
+	frames++;
+}
+
+void MotionDatabase::build(int leaf)
+{
+	leafSize = std::max(leaf, 1);
+
+	// per dimension mean and deviation over every frame
+	meanData.assign(dimensions, 0.0f);
+	inverseDeviationData.assign(dimensions, 0.0f);
+	for (int d = 0; d < featureCount && d < dimensions; d++) {
+		double sum = 0.0, sumSquares = 0.0;
+		for (int f = 0; f < frames; f++) {
+			double value = rawFeatures[(size_t)f * featureCount + d];
+			sum += value;
+			sumSquares += value * value;
+		}
+		double average = frames ? sum / frames : 0.0;
+		double variance = frames ? sumSquares / frames - average * average : 0.0;
+		meanData[d] = (float)average;
+		inverseDeviationData[d] = variance > 1e-12 ? (float)(1.0 / std::sqrt(variance)) : 0.0f;
+	}
+	mean = &meanData[0];
+	inverseDeviation = &inverseDeviationData[0];
+
+	// normalized rows of the frames that have a continuation, in frame order for now
+	rows = 0;
+	for (int f = 0; f < frames; f++) {
+		rows += continues[f];
+	}
+	featureStore.assign((size_t)rows * dimensions, 0.0f);
+	rowFrameStore.resize(rows);
+	for (int f = 0, row = 0; f < frames; f++) {
+		if (continues[f]) {
+			normalize(&rawFeatures[(size_t)f * featureCount], &featureStore[(size_t)row * dimensions]);
+			rowFrameStore[row++] = f;
+		}
+	}
+	std::vector<float>().swap(rawFeatures);
+
+	// enough levels that every leaf holds at most leafSize rows
+	depth = 0;
+	while (((int64_t)leafSize << depth) < rows) {
+		depth++;
+	}
+	int nodes = (1 << depth) - 1;
+	splitDimensionStore.assign(std::max(nodes, 1), 0);
+	splitValueStore.assign(std::max(nodes, 1), 0.0f);
+
+	std::vector<int> order(rows);
+	for (int r = 0; r < rows; r++) {
+		order[r] = r;
+	}
+	features = featureStore.empty() ? 0 : &featureStore[0];
+	buildNode(0, 0, rows, depth, order);
+
+	// move the rows into leaf order in place, following each cycle of the permutation
+	std::vector<float> held(dimensions);
+	std::vector<char> placed(rows, 0);
+	for (int start = 0; start < rows; start++) {
+		if (placed[start] || order[start] == start) {
+			continue;
+		}
+		float *first = &featureStore[(size_t)start * dimensions];
+		std::copy(first, first + dimensions, held.begin());
+		int32_t heldFrame = rowFrameStore[start];
+
+		int to = start;
+		while (order[to] != start) {
+			int from = order[to];
+			std::copy(&featureStore[(size_t)from * dimensions], &featureStore[(size_t)from * dimensions] + dimensions,
+				&featureStore[(size_t)to * dimensions]);
+			rowFrameStore[to] = rowFrameStore[from];
+			placed[to] = 1;
+			to = from;
+		}
+		std::copy(held.begin(), held.end(), &featureStore[(size_t)to * dimensions]);
+		rowFrameStore[to] = heldFrame;
+		placed[to] = 1;
+	}
+
+	useBuildData();
+}
+
+void MotionDatabase::buildNode(int node, int begin, int end, int levelsLeft, std::vector<int> &order)
+{
+	if (levelsLeft == 0) {
+		return;
+	}
+
+	// widest dimension, estimated from at most about a thousand rows of the range
+	int stride = std::max((end - begin) / 1024, 1);
+	int widest = 0;
+	float widestSpread = -1.0f;
+	for (int d = 0; d < dimensions; d++) {
+		float low = FLT_MAX, high = -FLT_MAX;
+		for (int i = begin; i < end; i += stride) {
+			float value = features[(size_t)order[i] * dimensions + d];
+			low = std::min(low, value);
+			high = std::max(high, value);
+		}
+		if (high - low > widestSpread) {
+			widestSpread = high - low;
+			widest = d;
+		}
+	}
+
+	// the lower half goes left, so rows left of the split are at most its value and rows right at least
+	int mid = begin + (end - begin) / 2;
+	const float *values = features;
+	int dims = dimensions;
+	std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+		[values, dims, widest](int a, int b) { return values[(size_t)a * dims + widest] < values[(size_t)b * dims + widest]; });
+	splitDimensionStore[node] = widest;
+	splitValueStore[node] = mid < end ? features[(size_t)order[mid] * dimensions + widest] : 0.0f;
+
+	buildNode(2 * node + 1, begin, mid, levelsLeft - 1, order);
+	buildNode(2 * node + 2, mid, end, levelsLeft - 1, order);
+}
+
+void MotionDatabase::useBuildData()
+{
+	mean = meanData.empty() ? 0 : &meanData[0];
+	inverseDeviation = inverseDeviationData.empty() ? 0 : &inverseDeviationData[0];
+	angleData = angleStore.empty() ? 0 : &angleStore[0];
+	features = featureStore.empty() ? 0 : &featureStore[0];
+	rowFrames = rowFrameStore.empty() ? 0 : &rowFrameStore[0];
+	splitDimensions = &splitDimensionStore[0];
+	splitValues = &splitValueStore[0];
+}
+
+bool MotionDatabase::write(const char *fileName) const
+{
+	std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Cannot write motion database " << fileName << std::endl;
+		return false;
+	}
+
+	MotionDatabaseHeader header;
+	memcpy(header.magic, motionDatabaseMagic, 4);
+	header.version = motionDatabaseVersion;
+	header.frameCount = frames;
+	header.channelCount = channels;
+	header.featureCount = featureCount;
+	header.dimensions = dimensions;
+	header.rowCount = rows;
+	header.leafSize = leafSize;
+	header.depth = depth;
+	header.sampleRate = sampleRate;
+	int nodes = std::max((1 << depth) - 1, 1);
+
+	out.write((const char *)&header, sizeof(header));
+	out.write((const char *)mean, sizeof(float) * dimensions);
+	out.write((const char *)inverseDeviation, sizeof(float) * dimensions);
+	out.write((const char *)angleData, sizeof(float) * (size_t)frames * channels);
+	out.write((const char *)features, sizeof(float) * (size_t)rows * dimensions);
+	out.write((const char *)rowFrames, sizeof(int32_t) * rows);
+	out.write((const char *)splitDimensions, sizeof(int32_t) * nodes);
+	out.write((const char *)splitValues, sizeof(float) * nodes);
+	return (bool)out;
+}
+
+bool MotionDatabase::open(const char *fileName)
+{
+	close();
+	if (!file.open(fileName)) {
+		return false;
+	}
+
+	// every section is a run of four byte values behind a header of them, and the mapping is page aligned
+	MotionDatabaseHeader header;
+	memset(&header, 0, sizeof(header));
+	if (file.size() >= sizeof(header)) {
+		memcpy(&header, file.data(), sizeof(header));
+	}
+	size_t nodes = header.depth < 31 ? std::max((1u << header.depth) - 1, 1u) : 0;
+	size_t expected = sizeof(header) + sizeof(float) * (2 * (size_t)header.dimensions +
+		(size_t)header.frameCount * header.channelCount + (size_t)header.rowCount * header.dimensions +
+		header.rowCount + 2 * nodes);
+	// the SSE scan reads whole groups of four dimensions, and the tree has exactly the levels build() gives it
+	int64_t leafRows = header.leafSize;
+	uint32_t expectedDepth = 0;
+	while (leafRows > 0 && (leafRows << expectedDepth) < header.rowCount) {
+		expectedDepth++;
+	}
+	bool valid = file.size() >= sizeof(header) && memcmp(header.magic, motionDatabaseMagic, 4) == 0 &&
+		header.version == motionDatabaseVersion && header.dimensions <= maxDimensions && header.dimensions % 4 == 0 &&
+		header.featureCount <= header.dimensions && header.frameCount <= INT_MAX && header.rowCount <= header.frameCount &&
+		header.leafSize > 0 && header.depth < 31 && header.depth == expectedDepth && header.sampleRate > 0.0f &&
+		file.size() == expected;
+
+	// every row has to continue into a stored frame and every split has to name a dimension
+	const int32_t *rowFrameData = valid ? (const int32_t *)(file.data() + expected - sizeof(float) * (header.rowCount + 2 * nodes)) : 0;
+	const int32_t *splitData = valid ? rowFrameData + header.rowCount : 0;
+	for (uint32_t r = 0; valid && r < header.rowCount; r++) {
+		valid = rowFrameData[r] >= 0 && (uint32_t)rowFrameData[r] + 1 < header.frameCount;
+	}
+	for (size_t n = 0; valid && header.depth > 0 && n < nodes; n++) {
+		valid = splitData[n] >= 0 && (uint32_t)splitData[n] < header.dimensions;
+	}
+	if (!valid) {
+		std::cerr << "Not a motion database: " << fileName << std::endl;
+		close();
+		return false;
+	}
+
+	frames = header.frameCount;
+	channels = header.channelCount;
+	dimensions = header.dimensions;
+	featureCount = header.featureCount;
+	rows = header.rowCount;
+	leafSize = header.leafSize;
+	depth = header.depth;
+	sampleRate = header.sampleRate;
+
+	const float *p = (const float *)(file.data() + sizeof(header));
+	mean = p;
+	p += dimensions;
+	inverseDeviation = p;
+	p += dimensions;
+	angleData = p;
+	p += (size_t)frames * channels;
+	features = p;
+	p += (size_t)rows * dimensions;
+	rowFrames = (const int32_t *)p;
+	p += rows;
+	splitDimensions = (const int32_t *)p;
+	p += nodes;
+	splitValues = p;
+	return true;
+}
+
+void MotionDatabase::close()
+{
+	file.close();
+	frames = rows = depth = 0;
+	mean = inverseDeviation = angleData = features = splitValues = 0;
+	rowFrames = splitDimensions = 0;
+	meanData.clear();
+	inverseDeviationData.clear();
+	angleStore.clear();
+	rawFeatures.clear();
+	continues.clear();
+	featureStore.clear();
+	rowFrameStore.clear();
+	splitDimensionStore.clear();
+	splitValueStore.clear();
+}
+
+void MotionDatabase::normalize(const float *raw, float *query) const
+{
+	for (int d = 0; d < dimensions; d++) {
+		query[d] = d < featureCount ? (raw[d] - mean[d]) * inverseDeviation[d] : 0.0f;
+	}
+}
+
+void MotionDatabase::scanRows(int begin, int end, SearchState &state) const
+{
+	const float *query = state.query;
+
+#ifdef MOTION_SSE
+	for (int r = begin; r < end; r++) {
+		const float *row = features + (size_t)r * dimensions;
+		__m128 sum = _mm_setzero_ps();
+		for (int d = 0; d < dimensions; d += 4) {
+			__m128 diff = _mm_sub_ps(_mm_loadu_ps(row + d), _mm_loadu_ps(query + d));
+			sum = _mm_add_ps(sum, _mm_mul_ps(diff, diff));
+		}
+		// horizontal add of the four lanes
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		float distance = _mm_cvtss_f32(sum);
+		if (distance < state.best) {
+			state.best = distance;
+			state.bestRow = r;
+		}
+	}
+#else
+	for (int r = begin; r < end; r++) {
+		const float *row = features + (size_t)r * dimensions;
+		float distance = 0.0f;
+		for (int d = 0; d < dimensions; d++) {
+			float diff = row[d] - query[d];
+			distance += diff * diff;
+		}
+		if (distance < state.best) {
+			state.best = distance;
+			state.bestRow = r;
+		}
+	}
+#endif
+}
+
+void MotionDatabase::searchNode(int node, int begin, int end, int levelsLeft, float cellDistance, SearchState &state) const
+{
+	if (levelsLeft == 0) {
+		scanRows(begin, end, state);
+		state.leavesLeft--;
+		return;
+	}
+
+	int dimension = splitDimensions[node];
+	float diff = state.query[dimension] - splitValues[node];
+	int mid = begin + (end - begin) / 2;
+
+	// nearer side first, then the far side only if its cell can still hold something closer
+	if (diff < 0.0f) {
+		searchNode(2 * node + 1, begin, mid, levelsLeft - 1, cellDistance, state);
+	} else {
+		searchNode(2 * node + 2, mid, end, levelsLeft - 1, cellDistance, state);
+	}
+
+	float old = state.offsets[dimension];
+	float farDistance = cellDistance - old * old + diff * diff;
+	if (farDistance < state.best && state.leavesLeft > 0) {
+		state.offsets[dimension] = diff;
+		if (diff < 0.0f) {
+			searchNode(2 * node + 2, mid, end, levelsLeft - 1, farDistance, state);
+		} else {
+			searchNode(2 * node + 1, begin, mid, levelsLeft - 1, farDistance, state);
+		}
+		state.offsets[dimension] = old;
+	}
+}
+
+int MotionDatabase::search(const float *query, float &distance, int maxLeaves) const
+{
+	SearchState state;
+	state.query = query;
+	state.best = FLT_MAX;
+	state.bestRow = -1;
+	state.leavesLeft = maxLeaves > 0 ? maxLeaves : INT_MAX;
+	std::fill(state.offsets, state.offsets + dimensions, 0.0f);
+
+	if (rows > 0) {
+		searchNode(0, 0, rows, depth, 0.0f, state);
+	}
+	distance = state.best;
+	return state.bestRow;
+}
+
+int MotionDatabase::searchBruteForce(const float *query, float &distance) const
+{
+	SearchState state;
+	state.query = query;
+	state.best = FLT_MAX;
+	state.bestRow = -1;
+	scanRows(0, rows, state);
+	distance = state.best;
+	return state.bestRow;
+}
+
+static double MicrosecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void BenchmarkMotionDatabase(int maxFrames)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int features = 27;
+	const int channels = 30;
+	const int latent = 6;
+	const int queries = 200;
+	const char *fileName = "motion_bench.rbmm";
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::normal_distribution<float> noise(0.0f, 1.0f);
+
+	// motion lives on a few oscillators, every feature and angle mixes them
+	std::vector<float> mixing((features + channels) * latent);
+	for (size_t i = 0; i < mixing.size(); i++) {
+		mixing[i] = 2.0f * unit(rng) - 1.0f;
+	}
+
+	std::cout << "frames\tbuild(ms)\tfile(MB)\topen(ms)\tsearch\tus/query\texact\tdistance ratio" << std::endl;
+	for (int n = 10000; n <= maxFrames; n *= 10) {
+		MotionDatabase database;
+		database.begin(channels, features, 60.0f);
+
+		// clips of 100 to 1000 frames, each with its own speeds and phases
+		std::vector<float> frameFeatures(features), frameAngles(channels), frequency(latent), phase(latent);
+		// raw features of evenly spaced frames, the queries are made from them
+		std::vector<float> sampled;
+		int sampleEvery = std::max(n / queries, 1);
+		int clipLeft = 0;
+		float time = 0.0f;
+		for (int f = 0; f < n; f++) {
+			if (clipLeft == 0) {
+				clipLeft = 100 + (int)(unit(rng) * 900.0f);
+				time = 0.0f;
+				for (int k = 0; k < latent; k++) {
+					frequency[k] = 0.5f + 2.0f * unit(rng);
+					phase[k] = 6.28318531f * unit(rng);
+				}
+			}
+			float state[latent];
+			for (int k = 0; k < latent; k++) {
+				state[k] = std::sin(phase[k] + frequency[k] * time);
+			}
+			for (int d = 0; d < features + channels; d++) {
+				float value = 0.0f;
+				for (int k = 0; k < latent; k++) {
+					value += mixing[d * latent + k] * state[k];
+				}
+				if (d < features) {
+					frameFeatures[d] = value;
+				} else {
+					frameAngles[d - features] = value;
+				}
+			}
+			if (f % sampleEvery == 0 && (int)sampled.size() < queries * features) {
+				sampled.insert(sampled.end(), frameFeatures.begin(), frameFeatures.end());
+			}
+			clipLeft--;
+			time += 1.0f / 60.0f;
+			database.addFrame(&frameAngles[0], &frameFeatures[0], clipLeft > 0 && f + 1 < n);
+		}
+
+		Clock::time_point start = Clock::now();
+		database.build();
+		double buildMs = MicrosecondsSince(start) / 1000.0;
+		if (!database.write(fileName)) {
+			return;
+		}
+
+		MotionDatabase mapped;
+		start = Clock::now();
+		if (!mapped.open(fileName)) {
+			remove(fileName);
+			return;
+		}
+		double openMs = MicrosecondsSince(start) / 1000.0;
+		FILE *file = fopen(fileName, "rb");
+		double megabytes = 0.0;
+		if (file) {
+			fseek(file, 0, SEEK_END);
+			megabytes = ftell(file) / 1e6;
+			fclose(file);
+		}
+
+		// queries are stored frames pushed off the data a little, as a nudged pose would be
+		std::vector<float> query(queries * mapped.getDimensions());
+		for (int q = 0; q < queries; q++) {
+			float *normalized = &query[q * mapped.getDimensions()];
+			database.normalize(&sampled[q * features], normalized);
+			for (int d = 0; d < features; d++) {
+				normalized[d] += 0.2f * noise(rng);
+			}
+		}
+
+		std::vector<float> exactDistance(queries);
+		start = Clock::now();
+		for (int q = 0; q < queries; q++) {
+			mapped.searchBruteForce(&query[q * mapped.getDimensions()], exactDistance[q]);
+		}
+		double bruteUs = MicrosecondsSince(start) / queries;
+		std::cout << n << "\t" << buildMs << "\t" << megabytes << "\t" << openMs << "\tbrute force\t" << bruteUs << "\t1\t1" << std::endl;
+
+		const int budgets[5] = {0, 64, 16, 4, 1};
+		for (int b = 0; b < 5; b++) {
+			int exact = 0;
+			double ratio = 0.0;
+			start = Clock::now();
+			std::vector<float> found(queries);
+			for (int q = 0; q < queries; q++) {
+				mapped.search(&query[q * mapped.getDimensions()], found[q], budgets[b]);
+			}
+			double treeUs = MicrosecondsSince(start) / queries;
+			for (int q = 0; q < queries; q++) {
+				exact += found[q] <= exactDistance[q];
+				ratio += exactDistance[q] > 0.0f ? std::sqrt(found[q] / exactDistance[q]) : 1.0;
+			}
+
+			char label[32];
+			if (budgets[b]) {
+				snprintf(label, sizeof(label), "tree, %d leaves", budgets[b]);
+			} else {
+				snprintf(label, sizeof(label), "tree, exact");
+			}
+			std::cout << n << "\t\t\t\t" << label << "\t" << treeUs << "\t" << (double)exact / queries << "\t" << ratio / queries << std::endl;
+		}
+	}
+	remove(fileName);
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MappedFile.h"
+
+// Library of captured poses searched by feature vector for motion matching.
+//
+// Every frame stores its joint angles and a feature vector describing it, for
+// the robot the positions of a few parts relative to the torso and the
+// velocities of the hands and feet. Features are normalized per dimension to
+// zero mean and unit variance and padded to a multiple of four floats, and only
+// frames that have a following frame in the same clip become search rows, so
+// the best match always has a continuation.
+//
+// The rows are ordered by an implicit KD-tree: median splits on the dimension
+// with the widest spread down to leaves of about leafSize rows, with the split
+// planes stored per node and the leaves contiguous in the row matrix. A search
+// descends to the nearest leaf, scans its rows with SSE and visits further
+// leaves only while the distance to their cell can still beat the best match.
+// A leaf budget turns the search into an approximate one with a bounded cost.
+//
+// File layout, every field four bytes:
+//   header    magic "RBMM", version, frame count, channel count, feature count, dimensions,
+//             row count, leaf size, tree depth, sample rate
+//   mean, inverse deviation   one per dimension
+//   angles    channel count per frame, in frame order
+//   features  dimensions per row, in leaf order
+//   row frame the frame of every row
+//   tree      split dimension and split value of every node
+// The database is built offline and opened by mapping the file, so a million
+// frames load without reading them; only the row frames and the split
+// dimensions are checked when it is opened.
+class MotionDatabase
+{
+public:
+	MotionDatabase();
+	~MotionDatabase();
+
+	// Start an empty database of featuresPerFrame unpadded features per frame.
+	void begin(int channelCount, int featuresPerFrame, float sampleRate);
+	// hasNext is false for the last frame of a clip
+	void addFrame(const float *angles, const float *features, bool hasNext);
+	// Normalize the features and build the tree over the frames with a continuation.
+	void build(int leafSize = 16);
+
+	bool write(const char *fileName) const;
+	bool open(const char *fileName);
+	void close();
+
+	int frameCount() const { return frames; }
+	int rowCount() const { return rows; }
+	int getChannelCount() const { return channels; }
+	int getFeatureCount() const { return featureCount; }
+	int getDimensions() const { return dimensions; }
+	float getSampleRate() const { return sampleRate; }
+	int getTreeDepth() const { return depth; }
+
+	const float *angles(int frame) const { return angleData + (size_t)frame * channels; }
+	// frame of the best matching row, its continuation is frame + 1
+	int rowFrame(int row) const { return rowFrames[row]; }
+
+	// Normalize raw features into query, which needs getDimensions() floats.
+	void normalize(const float *features, float *query) const;
+
+	// The row nearest to a normalized query and its squared distance. maxLeaves
+	// of 0 searches exactly, otherwise at most that many leaves are scanned.
+	int search(const float *query, float &distance, int maxLeaves = 0) const;
+	// Every row scanned in order, for checking the tree.
+	int searchBruteForce(const float *query, float &distance) const;
+
+	static const int maxDimensions = 64;
+
+private:
+	MotionDatabase(const MotionDatabase &);
+	MotionDatabase &operator=(const MotionDatabase &);
+
+	struct SearchState
+	{
+		const float *query;
+		float best;
+		int bestRow;
+		int leavesLeft;
+		float offsets[maxDimensions];
+	};
+
+	void buildNode(int node, int begin, int end, int levelsLeft, std::vector<int> &order);
+	void searchNode(int node, int begin, int end, int levelsLeft, float cellDistance, SearchState &state) const;
+	void scanRows(int begin, int end, SearchState &state) const;
+	// point the accessors at the build vectors
+	void useBuildData();
+
+	int frames = 0;
+	int rows = 0;
+	int channels = 0;
+	int featureCount = 0;
+	int dimensions = 0;
+	int leafSize = 0;
+	int depth = 0;
+	float sampleRate = 0.0f;
+
+	// either the build vectors below or the mapped file
+	const float *mean = 0;
+	const float *inverseDeviation = 0;
+	const float *angleData = 0;
+	const float *features = 0;
+	const int32_t *rowFrames = 0;
+	const int32_t *splitDimensions = 0;
+	const float *splitValues = 0;
+
+	std::vector<float> meanData;
+	std::vector<float> inverseDeviationData;
+	std::vector<float> angleStore;
+	std::vector<float> rawFeatures;
+	std::vector<char> continues;
+	std::vector<float> featureStore;
+	std::vector<int32_t> rowFrameStore;
+	std::vector<int32_t> splitDimensionStore;
+	std::vector<float> splitValueStore;
+
+	MappedFile file;
+};
+
+// Build, save, load and search synthetic databases of up to a million frames,
+// comparing the tree with the brute force scan.
+void BenchmarkMotionDatabase(int frames);
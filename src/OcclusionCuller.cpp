@@ -0,0 +1,347 @@
+#include "OcclusionCuller.h"
+#include "CubeMesh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_SSE 1
+#include <xmmintrin.h>
+#endif
+
+// nearer than this a vertex counts as behind the camera
+static const float nearDepth = 1e-3f;
+
+// robots asked of the neighbour grid per occluder; most of those around the eye are outside the frustum
+static const int nearestPerOccluder = 8;
+
+OcclusionCuller::OcclusionCuller()
+{
+	setResolution(256, 256);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void OcclusionCuller::setResolution(int w, int h)
+{
+	width = (std::max(w, 1) + tileSize - 1) / tileSize * tileSize;
+	height = (std::max(h, 1) + tileSize - 1) / tileSize * tileSize;
+	tilesX = width / tileSize;
+	tilesY = height / tileSize;
+	depth.assign(width * height, FLT_MAX);
+	tileMaxDepth.assign(tilesX * tilesY, FLT_MAX);
+}
+
+void OcclusionCuller::clear()
+{
+	std::fill(depth.begin(), depth.end(), FLT_MAX);
+	occluders = 0;
+	triangles = 0;
+}
+
+void OcclusionCuller::prepare(const SceneGraph &scene, const std::vector<SceneHandle> &roots,
+	const glm::mat4 &vp, const Frustum &frustum, float boundingRadius, const glm::vec3 &eye)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	viewProjection = vp;
+	clear();
+
+	// the robots nearest the eye hold the nearest ones in view, unless the eye looks away from them
+	candidates.clear();
+	bool ranked = false;
+	if (grid && grid->size() == (int)roots.size()) {
+		int asked = occluderCount * nearestPerOccluder;
+		grid->queryKNearest(eye, asked, nearest);
+		for (size_t i = 0; i < nearest.size(); i++) {
+			addCandidate(scene, roots, nearest[i].second, frustum, boundingRadius);
+		}
+		ranked = (int)candidates.size() >= occluderCount || (int)nearest.size() < asked;
+	}
+	if (!ranked) {
+		candidates.clear();
+		for (size_t i = 0; i < roots.size(); i++) {
+			addCandidate(scene, roots, (int)i, frustum, boundingRadius);
+		}
+	}
+
+	int count = std::min(occluderCount, (int)candidates.size());
+	std::nth_element(candidates.begin(), candidates.begin() + count, candidates.end());
+	for (int i = 0; i < count; i++) {
+		SceneHandle root = roots[candidates[i].second];
+		const SceneNode &torso = scene.node(root);
+
+		// the unselected size, a selected torso is drawn larger so this stays conservative
+		glm::mat4 joint = scene.jointTransform(root, glm::mat4(1.0f));
+		glm::mat4 box = glm::scale(glm::translate(joint, torso.jointTranslation), torso.originalScale);
+		drawBox(vp * box);
+		occluders++;
+	}
+
+	buildTiles();
+	prepareMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// A robot in the frustum and in front of the camera can occlude
+void OcclusionCuller::addCandidate(const SceneGraph &scene, const std::vector<SceneHandle> &roots, int robot,
+	const Frustum &frustum, float boundingRadius)
+{
+	glm::vec3 p = scene.getParentTranslation(roots[robot]);
+	if (!frustum.intersectsSphere(p, boundingRadius)) {
+		return;
+	}
+	const glm::mat4 &vp = viewProjection;
+	float w = vp[0][3] * p.x + vp[1][3] * p.y + vp[2][3] * p.z + vp[3][3];
+	if (w > nearDepth) {
+		candidates.push_back(std::make_pair(w, (uint32_t)robot));
+	}
+}
+
+void OcclusionCuller::drawBox(const glm::mat4 &boxToClip)
+{
+	for (int v = 0; v < cubeVertexCount; v += 3) {
+		const float *a = &cubeVertices[6 * v];
+		const float *b = &cubeVertices[6 * (v + 1)];
+		const float *c = &cubeVertices[6 * (v + 2)];
+		drawTriangle(boxToClip * glm::vec4(a[0], a[1], a[2], 1.0f),
+			boxToClip * glm::vec4(b[0], b[1], b[2], 1.0f),
+			boxToClip * glm::vec4(c[0], c[1], c[2], 1.0f));
+	}
+}
+
+void OcclusionCuller::drawTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+{
+	// clipping would need new vertices; leaving the triangle out only loses occlusion
+	if (a.w <= nearDepth || b.w <= nearDepth || c.w <= nearDepth) {
+		return;
+	}
+
+	float x0 = (a.x / a.w * 0.5f + 0.5f) * width, y0 = (a.y / a.w * 0.5f + 0.5f) * height;
+	float x1 = (b.x / b.w * 0.5f + 0.5f) * width, y1 = (b.y / b.w * 0.5f + 0.5f) * height;
+	float x2 = (c.x / c.w * 0.5f + 0.5f) * width, y2 = (c.y / c.w * 0.5f + 0.5f) * height;
+
+	// counter-clockwise on screen, whichever way the cube's faces wind
+	float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+	if (area == 0.0f) {
+		return;
+	}
+	if (area < 0.0f) {
+		std::swap(x1, x2);
+		std::swap(y1, y2);
+	}
+
+	int minX = std::max((int)std::floor(std::min(x0, std::min(x1, x2))), 0);
+	int maxX = std::min((int)std::ceil(std::max(x0, std::max(x1, x2))), width - 1);
+	int minY = std::max((int)std::floor(std::min(y0, std::min(y1, y2))), 0);
+	int maxY = std::min((int)std::ceil(std::max(y0, std::max(y1, y2))), height - 1);
+	if (minX > maxX || minY > maxY) {
+		return;
+	}
+	triangles++;
+
+	// the farthest vertex, so the triangle is never nearer in the buffer than on screen
+	float z = std::max(a.w, std::max(b.w, c.w));
+
+	// E(x, y) = A x + B y + C is positive inside each edge
+	float edgeA[3] = {y0 - y1, y1 - y2, y2 - y0};
+	float edgeB[3] = {x1 - x0, x2 - x1, x0 - x2};
+	float edgeC[3] = {
+		-(edgeA[0] * x0 + edgeB[0] * y0),
+		-(edgeA[1] * x1 + edgeB[1] * y1),
+		-(edgeA[2] * x2 + edgeB[2] * y2)
+	};
+
+	// rows are walked four pixels at a time from a four aligned start
+	minX &= ~3;
+
+#ifdef OCCLUSION_SSE
+	__m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	__m128 zValue = _mm_set1_ps(z);
+	__m128 zero = _mm_setzero_ps();
+	__m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]);
+	__m128 step0 = _mm_set1_ps(4.0f * edgeA[0]), step1 = _mm_set1_ps(4.0f * edgeA[1]), step2 = _mm_set1_ps(4.0f * edgeA[2]);
+	__m128 px = _mm_add_ps(_mm_set1_ps((float)minX), offsets);
+
+	for (int y = minY; y <= maxY; y++) {
+		float py = y + 0.5f;
+		__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), _mm_set1_ps(edgeB[0] * py + edgeC[0]));
+		__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), _mm_set1_ps(edgeB[1] * py + edgeC[1]));
+		__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), _mm_set1_ps(edgeB[2] * py + edgeC[2]));
+
+		float *row = &depth[y * width];
+		for (int x = minX; x <= maxX; x += 4) {
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			__m128 current = _mm_loadu_ps(row + x);
+			__m128 nearer = _mm_min_ps(current, zValue);
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+
+			e0 = _mm_add_ps(e0, step0);
+			e1 = _mm_add_ps(e1, step1);
+			e2 = _mm_add_ps(e2, step2);
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++) {
+		float py = y + 0.5f;
+		float *row = &depth[y * width];
+		for (int x = minX; x <= maxX; x++) {
+			float pxf = x + 0.5f;
+			if (edgeA[0] * pxf + edgeB[0] * py + edgeC[0] >= 0.0f &&
+				edgeA[1] * pxf + edgeB[1] * py + edgeC[1] >= 0.0f &&
+				edgeA[2] * pxf + edgeB[2] * py + edgeC[2] >= 0.0f) {
+				row[x] = std::min(row[x], z);
+			}
+		}
+	}
+#endif
+}
+
+void OcclusionCuller::buildTiles()
+{
+	for (int ty = 0; ty < tilesY; ty++) {
+		for (int tx = 0; tx < tilesX; tx++) {
+			const float *tile = &depth[ty * tileSize * width + tx * tileSize];
+#ifdef OCCLUSION_SSE
+			__m128 farthest = _mm_loadu_ps(tile);
+			for (int y = 0; y < tileSize; y++) {
+				farthest = _mm_max_ps(farthest, _mm_loadu_ps(tile + y * width));
+				farthest = _mm_max_ps(farthest, _mm_loadu_ps(tile + y * width + 4));
+			}
+			float lanes[4];
+			_mm_storeu_ps(lanes, farthest);
+			tileMaxDepth[ty * tilesX + tx] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#else
+			float farthest = tile[0];
+			for (int y = 0; y < tileSize; y++) {
+				for (int x = 0; x < tileSize; x++) {
+					farthest = std::max(farthest, tile[y * width + x]);
+				}
+			}
+			tileMaxDepth[ty * tilesX + tx] = farthest;
+#endif
+		}
+	}
+}
+
+bool OcclusionCuller::isOccluded(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) const
+{
+	if (occluders == 0) {
+		return false;
+	}
+
+	// screen rectangle and nearest depth of the box
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minW = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 p((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+		if (clip.w <= nearDepth) {
+			return false;
+		}
+		float sx = (clip.x / clip.w * 0.5f + 0.5f) * width;
+		float sy = (clip.y / clip.w * 0.5f + 0.5f) * height;
+		minX = std::min(minX, sx);
+		maxX = std::max(maxX, sx);
+		minY = std::min(minY, sy);
+		maxY = std::max(maxY, sy);
+		minW = std::min(minW, clip.w);
+	}
+
+	int x0 = std::max((int)std::floor(minX), 0);
+	int x1 = std::min((int)std::floor(maxX), width - 1);
+	int y0 = std::max((int)std::floor(minY), 0);
+	int y1 = std::min((int)std::floor(maxY), height - 1);
+	if (x0 > x1 || y0 > y1) {
+		return false;
+	}
+
+	for (int ty = y0 / tileSize; ty <= y1 / tileSize; ty++) {
+		for (int tx = x0 / tileSize; tx <= x1 / tileSize; tx++) {
+			// everything in the tile is nearer than the robot
+			if (tileMaxDepth[ty * tilesX + tx] < minW) {
+				continue;
+			}
+
+			int px0 = std::max(x0, tx * tileSize), px1 = std::min(x1, tx * tileSize + tileSize - 1);
+			int py0 = std::max(y0, ty * tileSize), py1 = std::min(y1, ty * tileSize + tileSize - 1);
+			for (int y = py0; y <= py1; y++) {
+				const float *row = &depth[y * width];
+				for (int x = px0; x <= px1; x++) {
+					if (row[x] >= minW) {
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void BenchmarkOcclusionCuller(const SceneGraph &scene, const std::vector<SceneHandle> &roots, float crowdDepth)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int iterations = 20;
+	const float boundingRadius = 6.0f;
+	const int occluderCounts[4] = {16, 64, 256, 1024};
+
+	// standing in front of the crowd at chest height, looking down the rows at a slant
+	glm::vec3 eye(3.0f, 1.0f, 10.0f);
+	glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 2.0f * crowdDepth) *
+		glm::lookAt(eye, glm::vec3(-0.25f * crowdDepth, 1.0f, -crowdDepth), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = Frustum::FromViewProjection(viewProjection);
+
+	int inFrustum = 0;
+	for (size_t i = 0; i < roots.size(); i++) {
+		if (frustum.intersectsSphere(scene.getParentTranslation(roots[i]), boundingRadius)) {
+			inFrustum++;
+		}
+	}
+
+	std::cout << roots.size() << " robots, " << inFrustum << " in the frustum" << std::endl;
+	std::cout << "occluders\ttriangles\toccluded\tfraction\trasterize(ms)\ttest(ms)" << std::endl;
+
+	// occluders are picked through a neighbour grid, as the viewer does
+	std::vector<glm::vec3> positions(roots.size());
+	for (size_t i = 0; i < roots.size(); i++) {
+		positions[i] = scene.getParentTranslation(roots[i]);
+	}
+	SpatialGrid grid;
+	grid.build(positions);
+
+	OcclusionCuller culler;
+	culler.setNeighbourGrid(&grid);
+	for (int c = 0; c < 4; c++) {
+		culler.setOccluderCount(occluderCounts[c]);
+
+		double prepareMs = 0.0;
+		for (int n = 0; n < iterations; n++) {
+			culler.prepare(scene, roots, viewProjection, frustum, boundingRadius, eye);
+			prepareMs += culler.prepareMilliseconds();
+		}
+		prepareMs /= iterations;
+
+		// the bounds cost forward kinematics, which the recorder only pays for robots in the frustum
+		int occluded = 0;
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < roots.size(); i++) {
+			if (!frustum.intersectsSphere(scene.getParentTranslation(roots[i]), boundingRadius)) {
+				continue;
+			}
+			glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+			scene.computeBounds(roots[i], glm::mat4(1.0f), boundsMin, boundsMax);
+			if (culler.isOccluded(boundsMin, boundsMax)) {
+				occluded++;
+			}
+		}
+		double testMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		std::cout << culler.occludersDrawn() << "\t" << culler.trianglesDrawn() << "\t" << occluded << "\t"
+			<< (inFrustum ? (double)occluded / inFrustum : 0.0) << "\t" << prepareMs << "\t" << testMs << std::endl;
+	}
+}
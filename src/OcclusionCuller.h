@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+#include "SceneGraph.h"
+#include "SpatialGrid.h"
+
+// Software occlusion culling against the torsos of the nearest robots.
+//
+// Each frame the torso boxes of the closest robots are rasterized on the CPU
+// into a small depth buffer holding view depth, four pixels at a time with
+// SSE2 where available. Each triangle is written at the depth of its farthest
+// vertex, so the buffer never claims an occluder is nearer than it is. An
+// 8x8 tile level keeps the farthest depth of every tile, so most queries
+// are answered without touching pixels.
+//
+// A robot is occluded when every pixel under the screen rectangle of its
+// bounding box holds something nearer than the box's nearest point.
+// isOccluded only reads the buffers and is safe to call from several threads.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+	~OcclusionCuller();
+
+	// width is rounded up to a multiple of the tile size
+	void setResolution(int width, int height);
+	void setOccluderCount(int count) { occluderCount = count; }
+
+	// A grid over the roots' positions, in the order prepare gets the roots.
+	// Occluders are then picked among the robots nearest the eye instead of
+	// ranking every robot in the frustum.
+	void setNeighbourGrid(const SpatialGrid *positions) { grid = positions; }
+
+	// Pick the nearest robots in the frustum and rasterize their torsos.
+	void prepare(const SceneGraph &scene, const std::vector<SceneHandle> &roots,
+		const glm::mat4 &viewProjection, const Frustum &frustum, float boundingRadius, const glm::vec3 &eye);
+
+	bool isOccluded(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	const float *depthBuffer() const { return &depth[0]; }
+
+	// from the last prepare
+	int occludersDrawn() const { return occluders; }
+	int trianglesDrawn() const { return triangles; }
+	double prepareMilliseconds() const { return prepareMs; }
+
+	static const int tileSize = 8;
+
+private:
+	void clear();
+	void addCandidate(const SceneGraph &scene, const std::vector<SceneHandle> &roots, int robot,
+		const Frustum &frustum, float boundingRadius);
+	void drawBox(const glm::mat4 &boxToClip);
+	void drawTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+	void buildTiles();
+
+	int width = 0;
+	int height = 0;
+	int tilesX = 0;
+	int tilesY = 0;
+	int occluderCount = 64;
+
+	// view depth per pixel, and the farthest depth in every tile
+	std::vector<float> depth;
+	std::vector<float> tileMaxDepth;
+
+	// (view depth, robot) of every robot in the frustum
+	std::vector<std::pair<float, uint32_t> > candidates;
+
+	const SpatialGrid *grid = 0;
+	std::vector<SpatialGrid::Neighbour> nearest;
+
+	glm::mat4 viewProjection;
+	int occluders = 0;
+	int triangles = 0;
+	double prepareMs = 0.0;
+};
+
+// Occluded fraction and culler cost for a crowd seen from street level.
+void BenchmarkOcclusionCuller(const SceneGraph &scene, const std::vector<SceneHandle> &roots, float crowdDepth);
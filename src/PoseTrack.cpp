@@ -0,0 +1,440 @@
+#include "PoseTrack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+static const char poseTrackMagic[4] = {'R', 'B', 'P', 'T'};
+static const uint32_t poseTrackVersion = 1;
+// limits a reader accepts, well past anything recorded, so a damaged header cannot size the decode buffer
+static const uint32_t poseTrackMaxChannels = 1 << 16;
+static const uint32_t poseTrackMaxChunkSamples = 1 << 16;
+
+struct PoseTrackHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t channelCount;
+	uint32_t samplesPerChunk;
+	float sampleRate;
+	float quantizationStep;
+};
+
+struct PoseTrackFooter
+{
+	uint64_t indexOffset;
+	uint64_t sampleCount;
+	uint32_t chunkCount;
+	char magic[4];
+};
+
+static void PutVarint(std::vector<unsigned char> &out, uint32_t value)
+{
+	while (value >= 0x80) {
+		out.push_back((unsigned char)((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+// false if the varint runs past end or is longer than five bytes
+static bool GetVarint(const unsigned char *&p, const unsigned char *end, uint32_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35 && p < end; shift += 7) {
+		unsigned char c = *p++;
+		value |= (uint32_t)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint32_t ZigZag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t UnZigZag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+static uint32_t FloatBits(float f) { uint32_t u; memcpy(&u, &f, sizeof(u)); return u; }
+static float BitsFloat(uint32_t u) { float f; memcpy(&f, &u, sizeof(f)); return f; }
+
+template <class T>
+static T ReadAt(const unsigned char *p)
+{
+	// the mapping is not necessarily aligned for T
+	T value;
+	memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+PoseTrackWriter::PoseTrackWriter()
+{
+}
+
+PoseTrackWriter::~PoseTrackWriter()
+{
+	close();
+}
+
+bool PoseTrackWriter::open(const char *fileName, int channels, float rate, float step, int chunkSamples)
+{
+	file.open(fileName, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::cerr << "Failed to open the pose track for writing:" << fileName << std::endl;
+		return false;
+	}
+
+	channelCount = channels;
+	sampleRate = rate;
+	quantizationStep = step;
+	samplesPerChunk = chunkSamples;
+	pending.assign((size_t)channelCount * samplesPerChunk, 0.0f);
+	pendingCount = 0;
+	columnOffsets.resize(channelCount);
+	chunkOffsets.clear();
+	sampleCount = 0;
+	failed = false;
+
+	PoseTrackHeader header;
+	memcpy(header.magic, poseTrackMagic, sizeof(header.magic));
+	header.version = poseTrackVersion;
+	header.channelCount = channelCount;
+	header.samplesPerChunk = samplesPerChunk;
+	header.sampleRate = sampleRate;
+	header.quantizationStep = quantizationStep;
+	file.write((const char *)&header, sizeof(header));
+	bytesWritten = sizeof(header);
+	if (!file) {
+		std::cerr << "Failed to write the pose track:" << fileName << std::endl;
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+void PoseTrackWriter::append(const float *values)
+{
+	for (int c = 0; c < channelCount; c++) {
+		pending[(size_t)c * samplesPerChunk + pendingCount] = values[c];
+	}
+	pendingCount++;
+	sampleCount++;
+
+	if (pendingCount == samplesPerChunk) {
+		flushChunk();
+	}
+}
+
+void PoseTrackWriter::flushChunk()
+{
+	if (pendingCount == 0) {
+		return;
+	}
+
+	// sample count and column offsets are filled in once the columns are encoded
+	size_t headerSize = sizeof(uint32_t) * (1 + channelCount);
+	encoded.assign(headerSize, 0);
+
+	for (int c = 0; c < channelCount; c++) {
+		columnOffsets[c] = (uint32_t)encoded.size();
+		const float *column = &pending[(size_t)c * samplesPerChunk];
+
+		if (quantizationStep > 0.0f) {
+			int32_t previous = 0;
+			for (int i = 0; i < pendingCount; i++) {
+				int32_t q = (int32_t)std::lround(column[i] / quantizationStep);
+				PutVarint(encoded, ZigZag(q - previous));
+				previous = q;
+			}
+		} else {
+			uint32_t previous = 0;
+			for (int i = 0; i < pendingCount; i++) {
+				uint32_t bits = FloatBits(column[i]);
+				PutVarint(encoded, bits ^ previous);
+				previous = bits;
+			}
+		}
+	}
+
+	uint32_t count = (uint32_t)pendingCount;
+	memcpy(&encoded[0], &count, sizeof(count));
+	memcpy(&encoded[sizeof(uint32_t)], &columnOffsets[0], sizeof(uint32_t) * channelCount);
+
+	chunkOffsets.push_back((uint64_t)bytesWritten);
+	file.write((const char *)&encoded[0], encoded.size());
+	bytesWritten += encoded.size();
+	pendingCount = 0;
+	if (!file && !failed) {
+		std::cerr << "Failed to write a pose track chunk" << std::endl;
+		failed = true;
+	}
+}
+
+bool PoseTrackWriter::close()
+{
+	if (!file.is_open()) {
+		return !failed;
+	}
+
+	flushChunk();
+
+	PoseTrackFooter footer;
+	footer.indexOffset = (uint64_t)bytesWritten;
+	footer.sampleCount = (uint64_t)sampleCount;
+	footer.chunkCount = (uint32_t)chunkOffsets.size();
+	memcpy(footer.magic, poseTrackMagic, sizeof(footer.magic));
+
+	if (!chunkOffsets.empty()) {
+		file.write((const char *)&chunkOffsets[0], sizeof(uint64_t) * chunkOffsets.size());
+	}
+	file.write((const char *)&footer, sizeof(footer));
+	bytesWritten += sizeof(uint64_t) * chunkOffsets.size() + sizeof(footer);
+	file.close();
+	failed = failed || !file;
+	return !failed;
+}
+
+PoseTrackReader::PoseTrackReader()
+{
+}
+
+PoseTrackReader::~PoseTrackReader()
+{
+}
+
+bool PoseTrackReader::open(const char *fileName)
+{
+	close();
+	if (!file.open(fileName)) {
+		return false;
+	}
+
+	if (file.size() < sizeof(PoseTrackHeader) + sizeof(PoseTrackFooter)) {
+		std::cerr << "Not a pose track:" << fileName << std::endl;
+		close();
+		return false;
+	}
+
+	PoseTrackHeader header = ReadAt<PoseTrackHeader>(file.data());
+	PoseTrackFooter footer = ReadAt<PoseTrackFooter>(file.data() + file.size() - sizeof(PoseTrackFooter));
+	uint64_t indexBytes = file.size() - sizeof(PoseTrackHeader) - sizeof(PoseTrackFooter);
+	bool valid = memcmp(header.magic, poseTrackMagic, 4) == 0 && memcmp(footer.magic, poseTrackMagic, 4) == 0 &&
+		header.version == poseTrackVersion &&
+		header.channelCount > 0 && header.channelCount <= poseTrackMaxChannels &&
+		header.samplesPerChunk > 0 && header.samplesPerChunk <= poseTrackMaxChunkSamples &&
+		header.sampleRate > 0.0f && std::isfinite(header.sampleRate) &&
+		header.quantizationStep >= 0.0f && std::isfinite(header.quantizationStep) &&
+		footer.chunkCount <= indexBytes / sizeof(uint64_t) && footer.chunkCount <= INT32_MAX &&
+		footer.indexOffset >= sizeof(PoseTrackHeader) &&
+		footer.indexOffset == file.size() - sizeof(PoseTrackFooter) - sizeof(uint64_t) * footer.chunkCount &&
+		// every chunk but the last is full
+		footer.sampleCount <= (uint64_t)footer.chunkCount * header.samplesPerChunk &&
+		footer.sampleCount + header.samplesPerChunk > (uint64_t)footer.chunkCount * header.samplesPerChunk;
+
+	// chunks lie in order between the header and the index, each with its sample count and column offsets inside it
+	uint64_t chunkHeaderSize = sizeof(uint32_t) * (1 + (uint64_t)header.channelCount);
+	uint64_t previousEnd = sizeof(PoseTrackHeader);
+	for (uint32_t chunk = 0; valid && chunk < footer.chunkCount; chunk++) {
+		uint64_t offset = ReadAt<uint64_t>(file.data() + footer.indexOffset + sizeof(uint64_t) * chunk);
+		uint64_t end = chunk + 1 < footer.chunkCount ?
+			ReadAt<uint64_t>(file.data() + footer.indexOffset + sizeof(uint64_t) * (chunk + 1)) : footer.indexOffset;
+		valid = offset == previousEnd && end <= footer.indexOffset && end >= offset && end - offset >= chunkHeaderSize;
+		if (!valid) {
+			break;
+		}
+		uint64_t expected = chunk + 1 < footer.chunkCount ? header.samplesPerChunk : footer.sampleCount - (uint64_t)chunk * header.samplesPerChunk;
+		valid = ReadAt<uint32_t>(file.data() + offset) == expected;
+		for (uint32_t c = 0; valid && c < header.channelCount; c++) {
+			uint32_t column = ReadAt<uint32_t>(file.data() + offset + sizeof(uint32_t) * (1 + c));
+			valid = column >= chunkHeaderSize && column <= end - offset;
+		}
+		previousEnd = end;
+	}
+	if (!valid || previousEnd != footer.indexOffset) {
+		std::cerr << "Not a pose track:" << fileName << std::endl;
+		close();
+		return false;
+	}
+
+	channelCount = header.channelCount;
+	samplesPerChunk = header.samplesPerChunk;
+	sampleRate = header.sampleRate;
+	quantizationStep = header.quantizationStep;
+	sampleCount = (int64_t)footer.sampleCount;
+	chunkCount = footer.chunkCount;
+	indexOffset = footer.indexOffset;
+
+	decoded.assign((size_t)channelCount * samplesPerChunk, 0.0f);
+	nextValues.resize(channelCount);
+	decodedChunk = -1;
+	return true;
+}
+
+void PoseTrackReader::close()
+{
+	file.close();
+	decodedChunk = -1;
+	sampleCount = 0;
+	chunkCount = 0;
+}
+
+void PoseTrackReader::decodeChunk(int chunk)
+{
+	if (chunk == decodedChunk) {
+		return;
+	}
+
+	// open() checked the offsets and counts; the varints are only bounded by the chunk's end
+	uint64_t offset = ReadAt<uint64_t>(file.data() + indexOffset + sizeof(uint64_t) * chunk);
+	uint64_t endOffset = chunk + 1 < chunkCount ? ReadAt<uint64_t>(file.data() + indexOffset + sizeof(uint64_t) * (chunk + 1)) : indexOffset;
+	const unsigned char *base = file.data() + offset;
+	const unsigned char *end = file.data() + endOffset;
+	decodedCount = (int)ReadAt<uint32_t>(base);
+
+	bool truncated = false;
+	for (int c = 0; c < channelCount; c++) {
+		const unsigned char *p = base + ReadAt<uint32_t>(base + sizeof(uint32_t) * (1 + c));
+		float *column = &decoded[(size_t)c * samplesPerChunk];
+		uint32_t delta;
+
+		int i = 0;
+		if (quantizationStep > 0.0f) {
+			int32_t q = 0;
+			for (; i < decodedCount && GetVarint(p, end, delta); i++) {
+				q += UnZigZag(delta);
+				column[i] = q * quantizationStep;
+			}
+		} else {
+			uint32_t bits = 0;
+			for (; i < decodedCount && GetVarint(p, end, delta); i++) {
+				bits ^= delta;
+				column[i] = BitsFloat(bits);
+			}
+		}
+
+		// a damaged column holds its last good value
+		if (i < decodedCount) {
+			std::fill(column + i, column + decodedCount, i > 0 ? column[i - 1] : 0.0f);
+			truncated = true;
+		}
+	}
+	if (truncated) {
+		std::cerr << "Pose track chunk " << chunk << " is damaged" << std::endl;
+	}
+
+	decodedChunk = chunk;
+}
+
+void PoseTrackReader::readSample(int64_t sample, float *values)
+{
+	// an empty track has no chunks, its footer would be read as one
+	if (sampleCount == 0) {
+		return;
+	}
+
+	sample = std::max<int64_t>(0, std::min(sample, sampleCount - 1));
+	int chunk = (int)(sample / samplesPerChunk);
+	int i = (int)(sample % samplesPerChunk);
+	decodeChunk(chunk);
+	for (int c = 0; c < channelCount; c++) {
+		values[c] = decoded[(size_t)c * samplesPerChunk + i];
+	}
+}
+
+void PoseTrackReader::sampleAt(double time, bool loop, float *values)
+{
+	if (sampleCount == 0) {
+		return;
+	}
+
+	double position = time * sampleRate;
+	if (loop) {
+		position = std::fmod(position, (double)sampleCount);
+		if (position < 0.0) {
+			position += sampleCount;
+		}
+	} else {
+		position = std::max(0.0, std::min(position, (double)(sampleCount - 1)));
+	}
+
+	int64_t first = (int64_t)position;
+	float t = (float)(position - first);
+	int64_t second = first + 1;
+	if (second >= sampleCount) {
+		second = loop ? 0 : sampleCount - 1;
+	}
+
+	readSample(second, &nextValues[0]);
+	readSample(first, values);
+	for (int c = 0; c < channelCount; c++) {
+		values[c] += (nextValues[c] - values[c]) * t;
+	}
+}
+
+void BenchmarkPoseTrack()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// an hour of the ten part robot at 240 Hz
+	const int channels = 30;
+	const float rate = 240.0f;
+	const int64_t samples = (int64_t)(3600 * rate);
+	const char *fileName = "pose_benchmark.rbpt";
+	const float steps[] = {0.0f, 0.001f};
+
+	std::mt19937 rng(42);
+	std::normal_distribution<float> noise(0.0f, 0.0005f);
+	std::vector<float> values(channels);
+
+	std::cout << "quantization\tsamples\traw MB\tfile MB\tratio\twrite MB/s\tseek (us)" << std::endl;
+
+	for (int s = 0; s < 2; s++) {
+		PoseTrackWriter writer;
+		if (!writer.open(fileName, channels, rate, steps[s])) {
+			return;
+		}
+
+		// only the encoder and the file writes are timed, not the synthetic motion
+		Clock::duration writeTime = Clock::duration::zero();
+		for (int64_t i = 0; i < samples; i++) {
+			double t = i / rate;
+			for (int c = 0; c < channels; c++) {
+				// slow periodic joint motion with a little sensor noise
+				values[c] = 0.8f * (float)std::sin(0.5 * t * (1 + c % 5) + c) + noise(rng);
+			}
+			Clock::time_point start = Clock::now();
+			writer.append(&values[0]);
+			writeTime += Clock::now() - start;
+		}
+		Clock::time_point start = Clock::now();
+		bool written = writer.close();
+		writeTime += Clock::now() - start;
+		double writeSeconds = std::chrono::duration<double>(writeTime).count();
+
+		double rawBytes = (double)samples * channels * sizeof(float);
+		double fileBytes = (double)writer.getBytesWritten();
+
+		PoseTrackReader reader;
+		if (!written || !reader.open(fileName)) {
+			remove(fileName);
+			return;
+		}
+		std::uniform_real_distribution<double> anyTime(0.0, reader.getDuration());
+		const int seeks = 10000;
+		start = Clock::now();
+		for (int i = 0; i < seeks; i++) {
+			reader.sampleAt(anyTime(rng), false, &values[0]);
+		}
+		double seekMicroseconds = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / seeks;
+		reader.close();
+
+		std::cout << (steps[s] > 0.0f ? "0.001 rad" : "lossless") << "\t" << samples << "\t"
+			<< rawBytes / 1e6 << "\t" << fileBytes / 1e6 << "\t" << rawBytes / fileBytes << "\t"
+			<< rawBytes / 1e6 / writeSeconds << "\t" << seekMicroseconds << std::endl;
+	}
+
+	remove(fileName);
+}
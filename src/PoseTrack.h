@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <vector>
+#include "MappedFile.h"
+
+// Columnar pose recording at a fixed sample rate.
+//
+// File layout:
+//   header   magic "RBPT", version, channel count, samples per chunk, sample rate, quantization step
+//   chunks   sample count, one byte offset per channel column, then the columns. A column is
+//            its first value followed by one varint delta per remaining sample. Quantized tracks
+//            store zigzag deltas of round(value / step), lossless tracks the xor of successive
+//            float bit patterns.
+//   index    byte offset of every chunk
+//   footer   index offset, sample count, chunk count, magic
+//
+// A channel is one joint angle, so a robot records three channels per element.
+class PoseTrackWriter
+{
+public:
+	PoseTrackWriter();
+	~PoseTrackWriter();
+
+	// quantizationStep of 0 stores the angles losslessly
+	bool open(const char *fileName, int channelCount, float sampleRate,
+		float quantizationStep = 0.0f, int samplesPerChunk = 256);
+	// Flush and write the index. False if any write since open failed.
+	bool close();
+	bool isOpen() const { return file.is_open(); }
+
+	// Append one sample, channelCount values.
+	void append(const float *values);
+
+	int64_t getSampleCount() const { return sampleCount; }
+	int64_t getBytesWritten() const { return bytesWritten; }
+	float getSampleRate() const { return sampleRate; }
+
+private:
+	void flushChunk();
+
+	std::ofstream file;
+	int channelCount = 0;
+	int samplesPerChunk = 0;
+	float sampleRate = 0.0f;
+	float quantizationStep = 0.0f;
+
+	// channel-major values of the chunk being filled
+	std::vector<float> pending;
+	int pendingCount = 0;
+
+	std::vector<unsigned char> encoded;
+	std::vector<uint32_t> columnOffsets;
+	std::vector<uint64_t> chunkOffsets;
+	int64_t sampleCount = 0;
+	int64_t bytesWritten = 0;
+	bool failed = false;
+};
+
+class PoseTrackReader
+{
+public:
+	PoseTrackReader();
+	~PoseTrackReader();
+
+	// Checks the header, the index and every chunk's offsets before accepting the file.
+	bool open(const char *fileName);
+	void close();
+	bool isOpen() const { return file.isOpen(); }
+
+	int getChannelCount() const { return channelCount; }
+	float getSampleRate() const { return sampleRate; }
+	int64_t getSampleCount() const { return sampleCount; }
+	double getDuration() const { return sampleCount / (double)sampleRate; }
+
+	// Values of one recorded sample. Only the chunk holding it is decoded, and the
+	// last decoded chunk is cached, so seeking is constant time. values is left
+	// alone when the track has no samples.
+	void readSample(int64_t sample, float *values);
+
+	// Pose at an arbitrary time, interpolated between neighbouring samples.
+	// With loop set, time wraps around the recording, otherwise it is clamped.
+	void sampleAt(double time, bool loop, float *values);
+
+private:
+	void decodeChunk(int chunk);
+
+	MappedFile file;
+	int channelCount = 0;
+	int samplesPerChunk = 0;
+	float sampleRate = 0.0f;
+	float quantizationStep = 0.0f;
+	int64_t sampleCount = 0;
+	int chunkCount = 0;
+	uint64_t indexOffset = 0;
+
+	int decodedChunk = -1;
+	int decodedCount = 0;
+	std::vector<float> decoded;
+	std::vector<float> nextValues;
+};
+
+// Write an hour of synthetic poses and report throughput, compression ratio and seek cost.
+void BenchmarkPoseTrack();
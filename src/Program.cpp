@@ -1,4 +1,5 @@
 #include "Program.h"
+#include "AllocationTracker.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -12,12 +13,17 @@ Program::~Program()
 {
 }
 
-void Program::SetShadersFileName(char *vFileName, char *sFileName)
+void Program::SetShadersFileName(const char *vFileName, const char *sFileName)
 {
 	vertexShaderFileName = vFileName;
 	fragmentShaderFileName = sFileName;
 }
 
+void Program::SetGeometryShaderFileName(const char *gFileName)
+{
+	geometryShaderFileName = gFileName;
+}
+
 void Program::CheckShaderCompileStatus(GLuint shader)
 {
 	GLint status;
@@ -41,6 +47,8 @@ void Program::CheckShaderCompileStatus(GLuint shader)
 
 void Program::Init()
 {
+	AllocationScope scope(AllocShader);
+
 	GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
 	GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -64,6 +72,17 @@ void Program::Init()
 	glAttachShader(programID, vertShader);
 	glAttachShader(programID, fragShader);
 
+	if (geometryShaderFileName) {
+		GLuint geomShader = glCreateShader(GL_GEOMETRY_SHADER);
+		std::string gstr = ReadShader(geometryShaderFileName);
+		const char* gsText = gstr.c_str();
+		glShaderSource(geomShader, 1, &gsText, 0);
+		glCompileShader(geomShader);
+		std::cout << "Geometry shader compilation ";
+		CheckShaderCompileStatus(geomShader);
+		glAttachShader(programID, geomShader);
+	}
+
 	glLinkProgram(programID);
 	GLint status;
 	glGetProgramiv(programID, GL_LINK_STATUS, &status);
@@ -84,7 +103,7 @@ std::string Program::ReadShader(const char *name)
 	ifs.open(name);
 	if (!ifs) {
 		std::cerr << "Failed to open the shader file:" << name << std::endl;
-		return 0;
+		return std::string();
 	}
 	ss << ifs.rdbuf();
 	ifs.close();
@@ -143,11 +162,16 @@ void Program::SendUniformData(glm::vec3 input, const char* name)
 }
 
 //send a matrix to the shader.
-void Program::SendUniformData(glm::mat4 &input, const char* name)
+void Program::SendUniformData(const glm::mat4 &input, const char* name)
 {
 	glUniformMatrix4fv(glGetUniformLocation(programID, name), 1, GL_FALSE, &input[0][0]);
 }
 
+void Program::SendUniformData(const glm::mat4 *input, int count, const char* name)
+{
+	glUniformMatrix4fv(glGetUniformLocation(programID, name), count, GL_FALSE, &input[0][0][0]);
+}
+
 void Program::Bind()
 {
 	glUseProgram(programID);
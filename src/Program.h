@@ -10,7 +10,8 @@ public:
 	
 	Program();
 	~Program();
-	void SetShadersFileName(char *vFileName, char *sFileName);
+	void SetShadersFileName(const char *vFileName, const char *sFileName);
+	void SetGeometryShaderFileName(const char *gFileName);
 	void CheckShaderCompileStatus(GLuint shader);
 	void Init();
 	std::string ReadShader(const char *name);
@@ -18,7 +19,8 @@ public:
 	void SendUniformData(int a, const char* name);
 	void SendUniformData(float a, const char* name);
 	void SendUniformData(glm::vec3 input, const char* name);
-	void SendUniformData(glm::mat4 &mat, const char* name);
+	void SendUniformData(const glm::mat4 &mat, const char* name);
+	void SendUniformData(const glm::mat4 *mats, int count, const char* name);
 	void Bind();
 	void Unbind();
 	GLint GetPID() { return programID; };
@@ -26,6 +28,7 @@ public:
 
 private:
 	GLint programID;
-	char *vertexShaderFileName, *fragmentShaderFileName;
+	const char *vertexShaderFileName, *fragmentShaderFileName;
+	const char *geometryShaderFileName = 0;
 };
 
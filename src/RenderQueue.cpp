@@ -0,0 +1,147 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+uint64_t MakeDrawKey(unsigned int program, unsigned int mesh, unsigned int material, float depth)
+{
+	// flip the float bits so unsigned order matches numeric order for either sign
+	uint32_t depthBits;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+	depthBits = (depthBits & 0x80000000u) ? ~depthBits : (depthBits | 0x80000000u);
+
+	return ((uint64_t)(program & 0xffu) << 56) |
+		((uint64_t)(mesh & 0xfffu) << 44) |
+		((uint64_t)(material & 0xfffu) << 32) |
+		depthBits;
+}
+
+void RenderStateCounters::add(const RenderStateCounters &other)
+{
+	draws += other.draws;
+	programBinds += other.programBinds;
+	meshBinds += other.meshBinds;
+	materialBinds += other.materialBinds;
+	skippedBinds += other.skippedBinds;
+}
+
+void PrintRenderStateCounters(const RenderStateCounters &total, uint64_t frames)
+{
+	if (frames == 0) {
+		return;
+	}
+
+	std::cout << "Render state changes per frame: " << (double)total.draws / frames << " draws, "
+		<< (double)total.programBinds / frames << " program, "
+		<< (double)total.meshBinds / frames << " mesh, "
+		<< (double)total.materialBinds / frames << " material binds, "
+		<< (double)total.skippedBinds / frames << " redundant binds skipped" << std::endl;
+}
+
+namespace
+{
+	struct BenchmarkDraw
+	{
+		int id;
+	};
+
+	// counts binds without touching GL
+	struct CountingBackend
+	{
+		uint64_t checksum = 0;
+		void bindProgram(unsigned int program) { checksum += program; }
+		void bindMesh(unsigned int mesh) { checksum += mesh; }
+		void bindMaterial(unsigned int material) { checksum += material; }
+		void draw(const BenchmarkDraw &draw) { checksum += draw.id; }
+	};
+
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void BenchmarkRenderQueue()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef RenderQueue<BenchmarkDraw> Queue;
+	const int count = 100000;
+	const int iterations = 50;
+
+	// a scene with a few shaders, a few dozen meshes and a few hundred materials
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> program(0, 3);
+	std::uniform_int_distribution<int> mesh(0, 31);
+	std::uniform_int_distribution<int> material(0, 255);
+	std::uniform_real_distribution<float> depth(0.1f, 1000.0f);
+
+	std::vector<BenchmarkDraw> draws(count);
+	std::vector<uint64_t> keys(count);
+	for (int i = 0; i < count; i++) {
+		draws[i].id = i;
+		keys[i] = MakeDrawKey(program(rng), mesh(rng), material(rng), depth(rng));
+	}
+
+	Queue queue;
+	queue.reserve(count);
+	CountingBackend backend;
+
+	// submission order as recorded
+	for (int i = 0; i < count; i++) {
+		queue.push(keys[i], &draws[i]);
+	}
+	queue.submit(backend);
+	RenderStateCounters unsorted = queue.lastFrame();
+
+	double radixMs = 0.0;
+	for (int n = 0; n < iterations; n++) {
+		queue.clear();
+		for (int i = 0; i < count; i++) {
+			queue.push(keys[i], &draws[i]);
+		}
+		Clock::time_point start = Clock::now();
+		queue.sort();
+		radixMs += MillisecondsSince(start);
+	}
+	radixMs /= iterations;
+
+	Clock::time_point start = Clock::now();
+	queue.submit(backend);
+	double submitMs = MillisecondsSince(start);
+	RenderStateCounters sorted = queue.lastFrame();
+
+	// the same entries through std::stable_sort must come out in the same order
+	std::vector<Queue::Entry> reference(count);
+	double stdMs = 0.0;
+	for (int n = 0; n < iterations; n++) {
+		for (int i = 0; i < count; i++) {
+			reference[i].key = keys[i];
+			reference[i].command = &draws[i];
+		}
+		start = Clock::now();
+		std::stable_sort(reference.begin(), reference.end(),
+			[](const Queue::Entry &a, const Queue::Entry &b) { return a.key < b.key; });
+		stdMs += MillisecondsSince(start);
+	}
+	stdMs /= iterations;
+
+	int mismatches = 0;
+	for (int i = 0; i < count; i++) {
+		if (queue[i].command != reference[i].command) {
+			mismatches++;
+		}
+	}
+
+	std::cout << count << " draws" << std::endl;
+	std::cout << "radix sort\t" << radixMs << " ms" << std::endl;
+	std::cout << "std::stable_sort\t" << stdMs << " ms" << std::endl;
+	std::cout << "sorted submit\t" << submitMs << " ms (checksum " << backend.checksum << ")" << std::endl;
+	std::cout << "binds unsorted\t" << unsorted.programBinds << " program, " << unsorted.meshBinds << " mesh, "
+		<< unsorted.materialBinds << " material" << std::endl;
+	std::cout << "binds sorted\t" << sorted.programBinds << " program, " << sorted.meshBinds << " mesh, "
+		<< sorted.materialBinds << " material, " << sorted.skippedBinds << " skipped" << std::endl;
+	std::cout << "order mismatches against std::stable_sort\t" << mismatches << std::endl;
+}
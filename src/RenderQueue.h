@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A draw key packs everything that decides draw order into 64 bits, most
+// significant first, so sorting the keys as integers groups draws by program,
+// then mesh, then material, and orders each group front to back:
+//
+//   63..56 program   55..44 mesh   43..32 material   31..0 view depth
+static const int drawKeyProgramBits = 8;
+static const int drawKeyMeshBits = 12;
+static const int drawKeyMaterialBits = 12;
+
+// depth is the view space distance in front of the camera; negative depths sort first
+uint64_t MakeDrawKey(unsigned int program, unsigned int mesh, unsigned int material, float depth);
+
+inline unsigned int DrawKeyProgram(uint64_t key) { return (unsigned int)(key >> 56); }
+inline unsigned int DrawKeyMesh(uint64_t key) { return (unsigned int)(key >> 44) & 0xfffu; }
+inline unsigned int DrawKeyMaterial(uint64_t key) { return (unsigned int)(key >> 32) & 0xfffu; }
+
+// GL state changes made while submitting a queue
+struct RenderStateCounters
+{
+	uint64_t draws = 0;
+	uint64_t programBinds = 0;
+	uint64_t meshBinds = 0;
+	uint64_t materialBinds = 0;
+	// binds skipped because the state was already current
+	uint64_t skippedBinds = 0;
+
+	uint64_t binds() const { return programBinds + meshBinds + materialBinds; }
+	void add(const RenderStateCounters &other);
+};
+
+// Per-frame list of draws, sorted by key with an LSD radix sort and submitted
+// through a backend that is only asked to bind state that actually changes.
+//
+// Entries point at the caller's commands, which must outlive the submit. Storage
+// is reused between frames, so once the draw count is stable nothing allocates.
+template <class Command>
+class RenderQueue
+{
+public:
+	struct Entry
+	{
+		uint64_t key;
+		const Command *command;
+	};
+
+	void clear() { entries.clear(); }
+	void push(uint64_t key, const Command *command)
+	{
+		Entry entry = {key, command};
+		entries.push_back(entry);
+	}
+	void reserve(size_t count) { entries.reserve(count); scratch.reserve(count); }
+
+	int size() const { return (int)entries.size(); }
+	const Entry &operator[](int i) const { return entries[i]; }
+
+	// Stable sort by key, eight passes of eight bits. Passes where every key
+	// has the same digit are skipped, which for a handful of programs,
+	// meshes and materials leaves mostly the depth passes.
+	void sort();
+
+	// Backend needs bindProgram(unsigned), bindMesh(unsigned),
+	// bindMaterial(unsigned) and draw(const Command &). A frame drawn in
+	// several passes, such as once per view, submits every pass after the
+	// first with sameFrame set so the counters see one frame.
+	template <class Backend>
+	void submit(Backend &backend, bool sameFrame = false);
+
+	const RenderStateCounters &lastFrame() const { return frameCounters; }
+	const RenderStateCounters &total() const { return totalCounters; }
+	uint64_t framesSubmitted() const { return frames; }
+
+	void printStats() const;
+
+private:
+	std::vector<Entry> entries;
+	std::vector<Entry> scratch;
+
+	RenderStateCounters frameCounters;
+	RenderStateCounters totalCounters;
+	uint64_t frames = 0;
+};
+
+void PrintRenderStateCounters(const RenderStateCounters &total, uint64_t frames);
+
+template <class Command>
+void RenderQueue<Command>::sort()
+{
+	size_t n = entries.size();
+	if (n < 2) {
+		return;
+	}
+	scratch.resize(n);
+
+	// one counting pass builds the histograms for all eight digits
+	uint32_t histogram[8][256] = {};
+	for (size_t i = 0; i < n; i++) {
+		uint64_t key = entries[i].key;
+		for (int digit = 0; digit < 8; digit++) {
+			histogram[digit][(key >> (8 * digit)) & 0xff]++;
+		}
+	}
+
+	Entry *source = &entries[0];
+	Entry *destination = &scratch[0];
+	for (int digit = 0; digit < 8; digit++) {
+		uint32_t *counts = histogram[digit];
+
+		// all keys share this digit, the pass would not move anything
+		if (counts[(source[0].key >> (8 * digit)) & 0xff] == n) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++) {
+			uint32_t count = counts[bucket];
+			counts[bucket] = offset;
+			offset += count;
+		}
+		for (size_t i = 0; i < n; i++) {
+			destination[counts[(source[i].key >> (8 * digit)) & 0xff]++] = source[i];
+		}
+		std::swap(source, destination);
+	}
+
+	// an odd number of passes leaves the result in scratch
+	if (source != &entries[0]) {
+		entries.swap(scratch);
+	}
+}
+
+template <class Command>
+template <class Backend>
+void RenderQueue<Command>::submit(Backend &backend, bool sameFrame)
+{
+	RenderStateCounters passCounters;
+
+	// nothing is known to be bound at the start of a frame
+	unsigned int program = 0xffffffffu, mesh = 0xffffffffu, material = 0xffffffffu;
+	for (size_t i = 0; i < entries.size(); i++) {
+		uint64_t key = entries[i].key;
+
+		if (DrawKeyProgram(key) != program) {
+			program = DrawKeyProgram(key);
+			backend.bindProgram(program);
+			passCounters.programBinds++;
+			// a new program has none of the old uniforms, and its attribute
+			// locations differ, so the mesh's pointers must be set again
+			mesh = 0xffffffffu;
+			material = 0xffffffffu;
+		} else {
+			passCounters.skippedBinds++;
+		}
+		if (DrawKeyMesh(key) != mesh) {
+			mesh = DrawKeyMesh(key);
+			backend.bindMesh(mesh);
+			passCounters.meshBinds++;
+		} else {
+			passCounters.skippedBinds++;
+		}
+		if (DrawKeyMaterial(key) != material) {
+			material = DrawKeyMaterial(key);
+			backend.bindMaterial(material);
+			passCounters.materialBinds++;
+		} else {
+			passCounters.skippedBinds++;
+		}
+
+		backend.draw(*entries[i].command);
+		passCounters.draws++;
+	}
+
+	if (sameFrame && frames > 0) {
+		frameCounters.add(passCounters);
+	} else {
+		frameCounters = passCounters;
+		frames++;
+	}
+	totalCounters.add(passCounters);
+}
+
+template <class Command>
+void RenderQueue<Command>::printStats() const
+{
+	PrintRenderStateCounters(totalCounters, frames);
+}
+
+// Radix sort and std::sort 100k keyed draws, and count the binds each order needs.
+void BenchmarkRenderQueue();
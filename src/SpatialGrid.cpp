@@ -0,0 +1,338 @@
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+SpatialGrid::SpatialGrid(float size)
+{
+	setCellSize(size);
+}
+
+SpatialGrid::~SpatialGrid()
+{
+}
+
+void SpatialGrid::setCellSize(float size)
+{
+	cellSize = size;
+	inverseCellSize = 1.0f / size;
+}
+
+void SpatialGrid::cellOf(const glm::vec3 &p, int &cx, int &cy, int &cz) const
+{
+	cx = (int)std::floor(p.x * inverseCellSize);
+	cy = (int)std::floor(p.y * inverseCellSize);
+	cz = (int)std::floor(p.z * inverseCellSize);
+}
+
+unsigned int SpatialGrid::bucketOf(int cx, int cy, int cz) const
+{
+	// Teschner et al. spatial hash
+	unsigned int h = ((unsigned int)cx * 73856093u) ^ ((unsigned int)cy * 19349663u) ^ ((unsigned int)cz * 83492791u);
+	return h & bucketMask;
+}
+
+void SpatialGrid::build(const std::vector<glm::vec3> &positions)
+{
+	int n = (int)positions.size();
+
+	// twice as many buckets as points, rounded up to a power of two
+	unsigned int bucketCount = 1;
+	while (bucketCount < (unsigned int)(2 * n)) {
+		bucketCount <<= 1;
+	}
+	bucketMask = bucketCount - 1;
+
+	bucketStart.assign(bucketCount + 1, 0);
+	sortedIndices.resize(n);
+	sortedPositions.resize(n);
+	pointBucket.resize(n);
+	pointSlot.resize(n);
+
+	// count
+	for (int i = 0; i < n; i++) {
+		int cx, cy, cz;
+		cellOf(positions[i], cx, cy, cz);
+		if (i == 0) {
+			cellMin = glm::ivec3(cx, cy, cz);
+			cellMax = cellMin;
+		}
+		cellMin = glm::min(cellMin, glm::ivec3(cx, cy, cz));
+		cellMax = glm::max(cellMax, glm::ivec3(cx, cy, cz));
+		unsigned int b = bucketOf(cx, cy, cz);
+		pointBucket[i] = b;
+		bucketStart[b + 1]++;
+	}
+
+	// prefix sum
+	for (unsigned int b = 0; b < bucketCount; b++) {
+		bucketStart[b + 1] += bucketStart[b];
+	}
+
+	// scatter, walking backwards so the sort stays stable
+	for (int i = n - 1; i >= 0; i--) {
+		unsigned int b = pointBucket[i];
+		int slot = --bucketStart[b + 1];
+		sortedIndices[slot] = i;
+		sortedPositions[slot] = positions[i];
+		pointSlot[i] = slot;
+	}
+
+	// each bucketStart[b + 1] now holds the start of bucket b, shift them down one
+	for (unsigned int b = 0; b < bucketCount; b++) {
+		bucketStart[b] = bucketStart[b + 1];
+	}
+	bucketStart[bucketCount] = n;
+}
+
+void SpatialGrid::update(const std::vector<glm::vec3> &positions)
+{
+	int n = (int)positions.size();
+	if (n != (int)pointBucket.size()) {
+		build(positions);
+		return;
+	}
+
+	for (int i = 0; i < n; i++) {
+		int cx, cy, cz;
+		cellOf(positions[i], cx, cy, cz);
+		if (bucketOf(cx, cy, cz) != pointBucket[i]) {
+			build(positions);
+			return;
+		}
+
+		// a cell sharing the bucket can still be new, the k-nearest search has to reach it
+		cellMin = glm::min(cellMin, glm::ivec3(cx, cy, cz));
+		cellMax = glm::max(cellMax, glm::ivec3(cx, cy, cz));
+		sortedPositions[pointSlot[i]] = positions[i];
+	}
+}
+
+void SpatialGrid::queryRadius(const glm::vec3 &p, float radius, std::vector<int> &result) const
+{
+	if (sortedIndices.empty()) {
+		return;
+	}
+
+	float radiusSquared = radius * radius;
+	int minX, minY, minZ, maxX, maxY, maxZ;
+	cellOf(p - glm::vec3(radius), minX, minY, minZ);
+	cellOf(p + glm::vec3(radius), maxX, maxY, maxZ);
+
+	for (int cx = minX; cx <= maxX; cx++) {
+		for (int cy = minY; cy <= maxY; cy++) {
+			for (int cz = minZ; cz <= maxZ; cz++) {
+				unsigned int b = bucketOf(cx, cy, cz);
+				for (int s = bucketStart[b]; s < bucketStart[b + 1]; s++) {
+					const glm::vec3 &q = sortedPositions[s];
+
+					// distinct cells can share a bucket, only report points that live in this cell
+					int qx, qy, qz;
+					cellOf(q, qx, qy, qz);
+					if (qx != cx || qy != cy || qz != cz) {
+						continue;
+					}
+
+					glm::vec3 d = q - p;
+					if (glm::dot(d, d) <= radiusSquared) {
+						result.push_back(sortedIndices[s]);
+					}
+				}
+			}
+		}
+	}
+}
+
+void SpatialGrid::queryRadiusBatch(const std::vector<glm::vec3> &points, float radius,
+	std::vector<int> &offsets, std::vector<int> &indices) const
+{
+	offsets.resize(points.size() + 1);
+	indices.clear();
+	offsets[0] = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		queryRadius(points[i], radius, indices);
+		offsets[i + 1] = (int)indices.size();
+	}
+}
+
+void SpatialGrid::findKNearest(const glm::vec3 &p, int k, int excludeIndex, std::vector<Neighbour> &heap) const
+{
+	// max-heap of the k best (distance squared, index) pairs seen so far
+	heap.clear();
+	if (k <= 0 || sortedIndices.empty()) {
+		return;
+	}
+
+	int centerX, centerY, centerZ;
+	cellOf(p, centerX, centerY, centerZ);
+
+	// grow a shell of cells around p until the k-th best cannot improve
+	for (int ring = 0; ; ring++) {
+		for (int dx = -ring; dx <= ring; dx++) {
+			for (int dy = -ring; dy <= ring; dy++) {
+				for (int dz = -ring; dz <= ring; dz++) {
+					// only the outer shell of this ring is new
+					if (std::abs(dx) != ring && std::abs(dy) != ring && std::abs(dz) != ring) {
+						continue;
+					}
+
+					int cx = centerX + dx, cy = centerY + dy, cz = centerZ + dz;
+					unsigned int b = bucketOf(cx, cy, cz);
+					for (int s = bucketStart[b]; s < bucketStart[b + 1]; s++) {
+						if (sortedIndices[s] == excludeIndex) {
+							continue;
+						}
+
+						const glm::vec3 &q = sortedPositions[s];
+						int qx, qy, qz;
+						cellOf(q, qx, qy, qz);
+						if (qx != cx || qy != cy || qz != cz) {
+							continue;
+						}
+
+						glm::vec3 d = q - p;
+						float distanceSquared = glm::dot(d, d);
+						if ((int)heap.size() < k) {
+							heap.push_back(std::make_pair(distanceSquared, sortedIndices[s]));
+							std::push_heap(heap.begin(), heap.end());
+						} else if (distanceSquared < heap.front().first) {
+							std::pop_heap(heap.begin(), heap.end());
+							heap.back() = std::make_pair(distanceSquared, sortedIndices[s]);
+							std::push_heap(heap.begin(), heap.end());
+						}
+					}
+				}
+			}
+		}
+
+		// anything outside the scanned cube is at least ring * cellSize away
+		float reach = ring * cellSize;
+		if ((int)heap.size() == k && heap.front().first <= reach * reach) {
+			break;
+		}
+
+		// the cube already covers every occupied cell
+		if (centerX - ring <= cellMin.x && centerY - ring <= cellMin.y && centerZ - ring <= cellMin.z &&
+			centerX + ring >= cellMax.x && centerY + ring >= cellMax.y && centerZ + ring >= cellMax.z) {
+			break;
+		}
+	}
+
+	std::sort_heap(heap.begin(), heap.end());
+}
+
+void SpatialGrid::queryKNearest(const glm::vec3 &p, int k, std::vector<Neighbour> &result, int excludeIndex) const
+{
+	findKNearest(p, k, excludeIndex, result);
+}
+
+void SpatialGrid::queryKNearestBatch(const std::vector<glm::vec3> &points, int k, std::vector<int> &result,
+	std::vector<Neighbour> &scratch, const std::vector<int> &excludeIndices) const
+{
+	result.assign(points.size() * k, -1);
+	for (size_t i = 0; i < points.size(); i++) {
+		findKNearest(points[i], k, excludeIndices.empty() ? -1 : excludeIndices[i], scratch);
+		for (size_t j = 0; j < scratch.size(); j++) {
+			result[i * k + j] = scratch[j].second;
+		}
+	}
+}
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void BenchmarkSpatialGrid()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	const float radius = 5.0f;
+	const int k = 8;
+	std::mt19937 rng(1234);
+
+	std::cout << "robots\tbuild(ms)\tupdate(ms)\tradius(ms)\tavg neighbours\tknn(ms)\tbrute force radius(ms)" << std::endl;
+
+	for (int n = 1000; n <= 1000000; n *= 10) {
+		// robots stand on the ground plane about three units apart
+		float side = 3.0f * std::sqrt((float)n);
+		std::uniform_real_distribution<float> coordinate(0.0f, side);
+		std::vector<glm::vec3> positions(n);
+		for (int i = 0; i < n; i++) {
+			positions[i] = glm::vec3(coordinate(rng), 0.0f, coordinate(rng));
+		}
+
+		SpatialGrid grid(radius);
+		Clock::time_point start = Clock::now();
+		grid.build(positions);
+		double buildTime = MillisecondsSince(start);
+
+		// a second build with the same count is the steady-state per-frame cost
+		start = Clock::now();
+		grid.build(positions);
+		buildTime = std::min(buildTime, MillisecondsSince(start));
+
+		// robots stepping toward the middle of their cell stay in their buckets and skip the sort
+		std::vector<glm::vec3> moved(positions);
+		for (int i = 0; i < n; i++) {
+			glm::vec3 center = (glm::floor(positions[i] / radius) + glm::vec3(0.5f)) * radius;
+			moved[i] += 0.1f * (center - positions[i]);
+		}
+		start = Clock::now();
+		grid.update(moved);
+		double updateTime = MillisecondsSince(start);
+		grid.build(positions);
+
+		std::vector<int> offsets, indices;
+		start = Clock::now();
+		grid.queryRadiusBatch(positions, radius, offsets, indices);
+		double radiusTime = MillisecondsSince(start);
+
+		std::vector<int> nearest;
+		std::vector<SpatialGrid::Neighbour> knnScratch;
+		int knnQueries = std::min(n, 10000);
+		std::vector<glm::vec3> knnPoints(positions.begin(), positions.begin() + knnQueries);
+		std::vector<int> knnSelf(knnQueries);
+		for (int i = 0; i < knnQueries; i++) {
+			knnSelf[i] = i;
+		}
+		start = Clock::now();
+		grid.queryKNearestBatch(knnPoints, k, nearest, knnScratch, knnSelf);
+		double knnTime = MillisecondsSince(start) * n / knnQueries;
+
+		// brute force is O(n^2); only run it where it finishes, and check the grid agrees
+		double bruteTime = -1.0;
+		if (n <= 10000) {
+			std::vector<int> bruteCounts(n, 0);
+			start = Clock::now();
+			for (int i = 0; i < n; i++) {
+				for (int j = 0; j < n; j++) {
+					glm::vec3 d = positions[j] - positions[i];
+					if (glm::dot(d, d) <= radius * radius) {
+						bruteCounts[i]++;
+					}
+				}
+			}
+			bruteTime = MillisecondsSince(start);
+
+			for (int i = 0; i < n; i++) {
+				if (bruteCounts[i] != offsets[i + 1] - offsets[i]) {
+					std::cerr << "spatial grid mismatch at robot " << i << std::endl;
+					break;
+				}
+			}
+		}
+
+		std::cout << n << "\t" << buildTime << "\t" << updateTime << "\t" << radiusTime << "\t"
+			<< (double)indices.size() / n << "\t" << knnTime << "\t";
+		if (bruteTime >= 0.0) {
+			std::cout << bruteTime;
+		} else {
+			std::cout << "-";
+		}
+		std::cout << std::endl;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Uniform spatial hash over robot root positions.
+// Positions are bucketed by a hashed 3D cell coordinate and laid out contiguously
+// per bucket with a counting sort, so a radius query only touches the buckets
+// overlapping the query sphere instead of every robot in the scene.
+// Queries only read the grid; k-nearest ones work in storage the caller
+// passes in, so several threads can query at once.
+class SpatialGrid
+{
+public:
+	// (distance squared, index) of a k-nearest result
+	typedef std::pair<float, int> Neighbour;
+
+	SpatialGrid(float cellSize = 5.0f);
+	~SpatialGrid();
+
+	void setCellSize(float size);
+	float getCellSize() const { return cellSize; }
+
+	// Re-bucket all positions. Storage is reused between frames, so once the
+	// robot count is stable a rebuild does not allocate.
+	void build(const std::vector<glm::vec3> &positions);
+
+	// Move the positions given to the last build. Points that stay in their
+	// bucket are written in place; only when one crosses into another bucket, or
+	// the count changes, are the buckets sorted again.
+	void update(const std::vector<glm::vec3> &positions);
+
+	// Append the indices of every position within radius of p to result.
+	void queryRadius(const glm::vec3 &p, float radius, std::vector<int> &result) const;
+
+	// Radius query for many points at once. Results for query i are
+	// indices[offsets[i]] .. indices[offsets[i + 1] - 1].
+	void queryRadiusBatch(const std::vector<glm::vec3> &points, float radius,
+		std::vector<int> &offsets, std::vector<int> &indices) const;
+
+	// Write the k closest positions to p into result, nearest first.
+	// excludeIndex is skipped so a robot can ask for its own neighbours.
+	void queryKNearest(const glm::vec3 &p, int k, std::vector<Neighbour> &result, int excludeIndex = -1) const;
+
+	// k-nearest for many points; result holds k indices per query, padded with -1,
+	// and scratch is the search's working storage. excludeIndices is empty or
+	// holds the index to skip for every point, e.g. 0 .. n-1 when the points are
+	// the grid's own positions.
+	void queryKNearestBatch(const std::vector<glm::vec3> &points, int k, std::vector<int> &result,
+		std::vector<Neighbour> &scratch, const std::vector<int> &excludeIndices = std::vector<int>()) const;
+
+	int size() const { return (int)sortedIndices.size(); }
+
+private:
+	void cellOf(const glm::vec3 &p, int &cx, int &cy, int &cz) const;
+	unsigned int bucketOf(int cx, int cy, int cz) const;
+	// leave the k nearest to p in heap, nearest first
+	void findKNearest(const glm::vec3 &p, int k, int excludeIndex, std::vector<Neighbour> &heap) const;
+
+	float cellSize;
+	float inverseCellSize;
+	unsigned int bucketMask = 0;
+
+	// bucketStart[b] .. bucketStart[b + 1] indexes into sortedIndices/sortedPositions
+	std::vector<int> bucketStart;
+	std::vector<int> sortedIndices;
+	std::vector<glm::vec3> sortedPositions;
+
+	// per-position bucket computed during the counting pass, and its slot in the sorted arrays
+	std::vector<unsigned int> pointBucket;
+	std::vector<int> pointSlot;
+
+	// occupied cell range, bounds the k-nearest search
+	glm::ivec3 cellMin;
+	glm::ivec3 cellMax;
+};
+
+// Compare grid queries against brute force for crowds of 1k to 1M robots.
+void BenchmarkSpatialGrid();
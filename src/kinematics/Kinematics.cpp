@@ -0,0 +1,156 @@
+#include "Kinematics.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <vector>
+#include "StaticSkeleton.h"
+#include "ThreadPool.h"
+
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "transforms are written as packed glm::mat4");
+
+struct KinematicsContext
+{
+	std::vector<StaticPart> parts;
+	// solve with StaticForwardKinematics<TenPartRobot> instead of walking the table
+	bool robot = false;
+	std::unique_ptr<ThreadPool> pool;
+	// partCount joint frames per worker
+	std::vector<StaticJointFrame> scratch;
+};
+
+// the table walked at run time, with the same arithmetic the static skeleton inlines
+static void SolvePose(const StaticPart *parts, int partCount, const float *angles, StaticJointFrame *joints, glm::mat4 *world)
+{
+	static const StaticJointFrame root = {{1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+	for (int i = 0; i < partCount; i++) {
+		const StaticPart &part = parts[i];
+		float local[9];
+		StaticSkeletonDetail::EulerXYZ(angles + 3 * i, local);
+		StaticSkeletonDetail::Compose(part.parent < 0 ? root : joints[part.parent], local,
+			part.parentTranslation[0], part.parentTranslation[1], part.parentTranslation[2], joints[i]);
+		StaticSkeletonDetail::WorldMatrix(joints[i], part.jointTranslation[0], part.jointTranslation[1], part.jointTranslation[2],
+			part.scale[0], part.scale[1], part.scale[2], world[i]);
+	}
+}
+
+static void SolveTask(KinematicsContext *context, int task, int worker, const float *angles, int poseCount, float *transforms)
+{
+	int partCount = (int)context->parts.size();
+	int begin = task * kinematicsPosesPerTask;
+	int end = std::min(begin + kinematicsPosesPerTask, poseCount);
+	StaticJointFrame *joints = &context->scratch[(size_t)worker * partCount];
+
+	for (int pose = begin; pose < end; pose++) {
+		const float *poseAngles = angles + (size_t)pose * 3 * partCount;
+		glm::mat4 *world = (glm::mat4 *)(transforms + (size_t)pose * 16 * partCount);
+		if (context->robot) {
+			StaticForwardKinematics<TenPartRobot>(poseAngles, world);
+		} else {
+			SolvePose(&context->parts[0], partCount, poseAngles, joints, world);
+		}
+	}
+}
+
+// Nothing may unwind into a C caller; every exported function catches here and
+// reports failure through its return value.
+static KinematicsContext *CreateContext(const StaticPart *parts, int partCount, int threadCount)
+{
+	std::unique_ptr<KinematicsContext> context(new KinematicsContext());
+	context->parts.assign(parts, parts + partCount);
+	if (threadCount != 1) {
+		context->pool.reset(new ThreadPool(threadCount));
+	}
+	context->scratch.resize((size_t)KinematicsThreadCount(context.get()) * partCount);
+	return context.release();
+}
+
+KinematicsContext *KinematicsCreate(const KinematicsPart *parts, int partCount, int threadCount)
+{
+	if (!parts || partCount <= 0) {
+		return 0;
+	}
+
+	try {
+		std::vector<StaticPart> table(partCount);
+		for (int i = 0; i < partCount; i++) {
+			if (parts[i].parent >= i || parts[i].parent < -1) {
+				return 0;
+			}
+			table[i].parent = parts[i].parent;
+			std::copy(parts[i].parentTranslation, parts[i].parentTranslation + 3, table[i].parentTranslation);
+			std::copy(parts[i].jointTranslation, parts[i].jointTranslation + 3, table[i].jointTranslation);
+			std::copy(parts[i].scale, parts[i].scale + 3, table[i].scale);
+		}
+		return CreateContext(&table[0], partCount, threadCount);
+	} catch (const std::exception &) {
+		return 0;
+	}
+}
+
+KinematicsContext *KinematicsCreateRobot(int threadCount)
+{
+	try {
+		KinematicsContext *context = CreateContext(TenPartRobot::parts, TenPartRobot::partCount, threadCount);
+		context->robot = true;
+		return context;
+	} catch (const std::exception &) {
+		return 0;
+	}
+}
+
+void KinematicsDestroy(KinematicsContext *context)
+{
+	delete context;
+}
+
+int KinematicsPartCount(const KinematicsContext *context)
+{
+	return context ? (int)context->parts.size() : -1;
+}
+
+int KinematicsThreadCount(const KinematicsContext *context)
+{
+	if (!context) {
+		return -1;
+	}
+	return context->pool ? context->pool->size() : 1;
+}
+
+int KinematicsGetParts(const KinematicsContext *context, KinematicsPart *parts)
+{
+	if (!context || !parts) {
+		return -1;
+	}
+	for (size_t i = 0; i < context->parts.size(); i++) {
+		const StaticPart &part = context->parts[i];
+		parts[i].parent = part.parent;
+		std::copy(part.parentTranslation, part.parentTranslation + 3, parts[i].parentTranslation);
+		std::copy(part.jointTranslation, part.jointTranslation + 3, parts[i].jointTranslation);
+		std::copy(part.scale, part.scale + 3, parts[i].scale);
+	}
+	return 0;
+}
+
+int KinematicsSolve(KinematicsContext *context, const float *angles, int poseCount, float *transforms)
+{
+	if (!context || poseCount < 0 || (poseCount > 0 && (!angles || !transforms))) {
+		return -1;
+	}
+
+	int tasks = (poseCount + kinematicsPosesPerTask - 1) / kinematicsPosesPerTask;
+	if (!context->pool) {
+		for (int task = 0; task < tasks; task++) {
+			SolveTask(context, task, 0, angles, poseCount, transforms);
+		}
+		return 0;
+	}
+
+	try {
+		auto task = [&](int index, int worker) { SolveTask(context, index, worker, angles, poseCount, transforms); };
+		context->pool->parallelFor(tasks, task);
+	} catch (const std::exception &) {
+		return -1;
+	}
+	return 0;
+}
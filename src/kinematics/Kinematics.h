@@ -0,0 +1,62 @@
+#pragma once
+
+// C interface to batched forward kinematics, for sampling poses offline
+// without the viewer, GL or GLFW.
+//
+// A context holds a skeleton and a pool of worker threads. Solving a batch
+// splits it into runs of kinematicsPosesPerTask poses over the pool and writes
+// straight into the caller's buffer; the per-thread scratch is allocated when
+// the context is created, so solving never allocates. A context solves one
+// batch at a time; use one context per calling thread.
+//
+// Poses are laid out as pose track samples: the X, Y and Z joint angle of every
+// part in table order, 3 * partCount floats per pose. The result for every part
+// is its world transform (joint * translate(jointTranslation) * scale, as drawn
+// by the viewer) as 16 floats in column-major order, partCount per pose, with
+// the root joint at the origin.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct KinematicsContext KinematicsContext;
+
+// one part of a skeleton, parts are listed parents first
+typedef struct KinematicsPart
+{
+	// index of the parent part, -1 for the root
+	int parent;
+	// translation of this part's joint with respect to the parent's joint
+	float parentTranslation[3];
+	// translation of the part with respect to its joint
+	float jointTranslation[3];
+	float scale[3];
+} KinematicsPart;
+
+enum
+{
+	kinematicsPosesPerTask = 64
+};
+
+// threadCount of 0 uses every hardware thread, 1 solves on the calling thread.
+// Returns 0 when a part's parent is not listed before it, or when the context
+// or its threads cannot be created.
+KinematicsContext *KinematicsCreate(const KinematicsPart *parts, int partCount, int threadCount);
+// The viewer's ten part robot, solved by the compile-time specialized skeleton.
+KinematicsContext *KinematicsCreateRobot(int threadCount);
+void KinematicsDestroy(KinematicsContext *context);
+
+// -1 without a context
+int KinematicsPartCount(const KinematicsContext *context);
+int KinematicsThreadCount(const KinematicsContext *context);
+// copy of the skeleton table, partCount entries. Returns 0 on success, -1 without a context or parts.
+int KinematicsGetParts(const KinematicsContext *context, KinematicsPart *parts);
+
+// World transforms of poseCount poses: angles holds 3 * partCount floats per pose
+// and transforms receives 16 * partCount floats per pose. Returns 0 on success,
+// -1 on bad arguments or when the work could not be handed to the pool.
+int KinematicsSolve(KinematicsContext *context, const float *angles, int poseCount, float *transforms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,111 @@
+#include "MappedFile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *fileName)
+{
+	close();
+	fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		fileHandle = 0;
+		std::cerr << "Failed to open the file:" << fileName << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(fileHandle, &fileSize);
+	length = (size_t)fileSize.QuadPart;
+	if (length == 0) {
+		close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle) {
+		bytes = (const unsigned char *)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!bytes) {
+		std::cerr << "Failed to map the file:" << fileName << std::endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes) {
+		UnmapViewOfFile(bytes);
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle) {
+		CloseHandle(fileHandle);
+	}
+	bytes = 0;
+	length = 0;
+	mappingHandle = 0;
+	fileHandle = 0;
+}
+
+#else
+
+bool MappedFile::open(const char *fileName)
+{
+	close();
+	int fd = ::open(fileName, O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "Failed to open the file:" << fileName << std::endl;
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(0, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping stays valid after the descriptor is closed
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		std::cerr << "Failed to map the file:" << fileName << std::endl;
+		return false;
+	}
+
+	bytes = (const unsigned char *)mapping;
+	length = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes) {
+		munmap((void *)bytes, length);
+	}
+	bytes = 0;
+	length = 0;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. Pages are only read from disk when
+// they are touched, so large recordings can be opened without loading them.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char *fileName);
+	void close();
+
+	const unsigned char *data() const { return bytes; }
+	size_t size() const { return length; }
+	bool isOpen() const { return bytes != 0; }
+
+private:
+	// not copyable, the mapping has a single owner
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const unsigned char *bytes = 0;
+	size_t length = 0;
+#ifdef _WIN32
+	void *fileHandle = 0;
+	void *mappingHandle = 0;
+#endif
+};
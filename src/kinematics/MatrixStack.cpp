@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <cassert>
 #include <vector>
+#include <utility>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -13,7 +14,10 @@ using namespace std;
 
 MatrixStack::MatrixStack()
 {
-	mstack = make_shared< stack<glm::mat4> >();
+	// reserve the whole depth the asserts allow, so the stack never reallocates
+	vector<glm::mat4> storage;
+	storage.reserve(100);
+	mstack = make_shared< stack<glm::mat4, vector<glm::mat4> > >(std::move(storage));
 	mstack->push(glm::mat4(1.0));
 }
 
@@ -7,6 +7,7 @@
 #define _MatrixStack_H_
 
 #include <stack>
+#include <vector>
 #include <memory>
 #include <glm/fwd.hpp>
 
@@ -54,7 +55,8 @@ public:
 	void print(const char *name = 0) const;
 	
 private:
-	std::shared_ptr< std::stack<glm::mat4> > mstack;
+	// vector backed so pushes reuse one block instead of allocating deque nodes
+	std::shared_ptr< std::stack<glm::mat4, std::vector<glm::mat4> > > mstack;
 	
 };
 
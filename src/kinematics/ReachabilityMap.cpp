@@ -0,0 +1,596 @@
+#include "ReachabilityMap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include "ThreadPool.h"
+
+static const char reachabilityMagic[4] = {'R', 'B', 'R', 'M'};
+static const uint32_t reachabilityVersion = 1;
+static const int reachSamplesPerTask = 4096;
+static const float reachPi = 3.14159265f;
+
+struct ReachabilityHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t chainCount;
+	uint32_t voxelCount;
+};
+
+// splitmix64, so every sample's angles follow from its index alone
+static uint64_t SampleHash(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+static void SampleAngles(int chain, uint64_t sample, int count, float *angles)
+{
+	uint64_t state = SampleHash(((uint64_t)chain << 48) ^ sample);
+	for (int a = 0; a < count; a++) {
+		state = SampleHash(state);
+		angles[a] = (float)((state >> 40) * (1.0 / (1 << 24))) * 2.0f * reachPi - reachPi;
+	}
+}
+
+static glm::vec3 ChainEffector(const ReachabilityChain &chain, const float *angles)
+{
+	static const StaticJointFrame root = {{1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+	StaticJointFrame joints[reachMaxChainParts];
+	for (int i = 0; i < chain.partCount; i++) {
+		const StaticPart &part = chain.parts[i];
+		float local[9];
+		StaticSkeletonDetail::EulerXYZ(angles + 3 * i, local);
+		StaticSkeletonDetail::Compose(i == 0 ? root : joints[i - 1], local,
+			part.parentTranslation[0], part.parentTranslation[1], part.parentTranslation[2], joints[i]);
+	}
+
+	const StaticJointFrame &end = joints[chain.partCount - 1];
+	const float *r = end.r;
+	const float *tip = chain.tip;
+	return glm::vec3(r[0] * tip[0] + r[1] * tip[1] + r[2] * tip[2] + end.t[0],
+		r[3] * tip[0] + r[4] * tip[1] + r[5] * tip[2] + end.t[1],
+		r[6] * tip[0] + r[7] * tip[1] + r[8] * tip[2] + end.t[2]);
+}
+
+// x with m x = b by Cramer's rule, m is symmetric and positive definite here
+static glm::vec3 Solve3x3(const float m[3][3], const glm::vec3 &b)
+{
+	float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	float inverseDeterminant = 1.0f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+	glm::vec3 x;
+	x[0] = (b[0] * c00 + m[0][1] * (b[2] * m[1][2] - b[1] * m[2][2]) + m[0][2] * (b[1] * m[2][1] - b[2] * m[1][1])) * inverseDeterminant;
+	x[1] = (m[0][0] * (b[1] * m[2][2] - b[2] * m[1][2]) + b[0] * c01 + m[0][2] * (b[2] * m[1][0] - b[1] * m[2][0])) * inverseDeterminant;
+	x[2] = (m[0][0] * (b[2] * m[1][1] - b[1] * m[2][1]) + m[0][1] * (b[1] * m[2][0] - b[2] * m[1][0]) + b[0] * c02) * inverseDeterminant;
+	return x;
+}
+
+ReachabilityMap::ReachabilityMap()
+{
+}
+
+ReachabilityMap::~ReachabilityMap()
+{
+	close();
+}
+
+bool ReachabilityMap::build(const StaticPart *parts, int partCount, const int *endParts, const glm::vec3 *tips, int chainCount,
+	int resolution, int64_t samplesPerChain, int threadCount)
+{
+	close();
+
+	// every chain's voxels are addressed with 32-bit offsets, and a voxel's closest sample is kept in 32 bits
+	if (!parts || partCount <= 0 || !endParts || !tips || chainCount <= 0 || resolution <= 0 || resolution > reachMaxResolution ||
+		samplesPerChain <= 0 || samplesPerChain > UINT32_MAX || (uint64_t)chainCount * resolution * resolution * resolution > UINT32_MAX) {
+		std::cerr << "Reachability maps need parts, at least one chain, a resolution of 1 to " << reachMaxResolution <<
+			" and 1 to " << UINT32_MAX << " samples" << std::endl;
+		return false;
+	}
+
+	// walk up from every end part to the root, then describe the chain root first
+	uint32_t voxels = (uint32_t)resolution * resolution * resolution;
+	for (int c = 0; c < chainCount; c++) {
+		ReachabilityChain chain;
+		memset(&chain, 0, sizeof(chain));
+		chain.endPart = endParts[c];
+		if (endParts[c] < 0 || endParts[c] >= partCount) {
+			std::cerr << "Reachability chain " << c << " ends in part " << endParts[c] << " of " << partCount << std::endl;
+			close();
+			return false;
+		}
+
+		int path[reachMaxChainParts];
+		int length = 0;
+		for (int part = endParts[c]; parts[part].parent >= 0; part = parts[part].parent) {
+			if (parts[part].parent >= partCount || length == reachMaxChainParts) {
+				std::cerr << "Reachability chains are at most " << reachMaxChainParts << " parts long" << std::endl;
+				close();
+				return false;
+			}
+			path[length++] = part;
+		}
+		if (length == 0) {
+			std::cerr << "Reachability chain " << c << " ends in the root, it has no joints to move" << std::endl;
+			close();
+			return false;
+		}
+		chain.partCount = length;
+		for (int i = 0; i < length; i++) {
+			chain.partIndices[i] = path[length - 1 - i];
+			chain.parts[i] = parts[chain.partIndices[i]];
+			chain.parts[i].parent = i - 1;
+		}
+		chain.tip[0] = tips[c].x;
+		chain.tip[1] = tips[c].y;
+		chain.tip[2] = tips[c].z;
+
+		// the tip stays within the summed link lengths of the first joint
+		float radius = glm::length(tips[c]);
+		for (int i = 1; i < length; i++) {
+			radius += glm::length(glm::vec3(chain.parts[i].parentTranslation[0], chain.parts[i].parentTranslation[1], chain.parts[i].parentTranslation[2]));
+		}
+		radius *= 1.01f;
+		for (int axis = 0; axis < 3; axis++) {
+			chain.origin[axis] = chain.parts[0].parentTranslation[axis] - radius;
+		}
+		chain.voxelSize = 2.0f * radius / resolution;
+		chain.resolution = resolution;
+		chain.reachOffset = (uint32_t)c * voxels;
+		chain.seedOffset = (uint32_t)seedStore.size();
+
+		seedStore.resize(seedStore.size() + (size_t)voxels * 3 * length, 0);
+		chainStore.push_back(chain);
+	}
+	chains = chainCount;
+	reachStore.assign(((size_t)chainCount * voxels + 3) & ~(size_t)3, 0);
+
+	std::unique_ptr<ThreadPool> pool;
+	if (threadCount != 1) {
+		pool.reset(new ThreadPool(threadCount));
+	}
+
+	// The workers share every voxel's sample count and closest sample. The closest
+	// is kept as the bits of its squared distance from the voxel center above its
+	// index: distances are not negative, so their bits order like the floats and
+	// the smallest key is the closest sample, ties going to the lower index the
+	// way a serial build sees them.
+	const uint64_t noSample = ~(uint64_t)0;
+	std::unique_ptr<std::atomic<uint64_t>[]> best(new std::atomic<uint64_t>[voxels]);
+	std::unique_ptr<std::atomic<uint32_t>[]> counts(new std::atomic<uint32_t>[voxels]);
+
+	for (int c = 0; c < chainCount; c++) {
+		const ReachabilityChain &chain = chainStore[c];
+		auto clearTask = [&](int slab, int) {
+			int slabVoxels = resolution * resolution;
+			for (int v = slab * slabVoxels; v < (slab + 1) * slabVoxels; v++) {
+				best[v].store(noSample, std::memory_order_relaxed);
+				counts[v].store(0, std::memory_order_relaxed);
+			}
+		};
+
+		int tasks = (int)((samplesPerChain + reachSamplesPerTask - 1) / reachSamplesPerTask);
+		auto sampleTask = [&](int task, int) {
+			int64_t end = std::min((int64_t)(task + 1) * reachSamplesPerTask, samplesPerChain);
+			float angles[3 * reachMaxChainParts];
+			for (int64_t sample = (int64_t)task * reachSamplesPerTask; sample < end; sample++) {
+				SampleAngles(c, sample, 3 * chain.partCount, angles);
+				glm::vec3 point = ChainEffector(chain, angles);
+				int voxel = voxelIndex(chain, point);
+				if (voxel < 0) {
+					continue;
+				}
+
+				glm::vec3 cell = (point - glm::vec3(chain.origin[0], chain.origin[1], chain.origin[2])) / chain.voxelSize;
+				glm::vec3 offset = cell - glm::floor(cell) - glm::vec3(0.5f);
+				float squared = glm::dot(offset, offset);
+				uint32_t bits;
+				memcpy(&bits, &squared, sizeof(bits));
+				uint64_t key = (uint64_t)bits << 32 | (uint64_t)sample;
+
+				counts[voxel].fetch_add(1, std::memory_order_relaxed);
+				uint64_t current = best[voxel].load(std::memory_order_relaxed);
+				while (key < current && !best[voxel].compare_exchange_weak(current, key, std::memory_order_relaxed)) {
+				}
+			}
+		};
+
+		// the busiest voxel of every slab of the grid
+		uint32_t maxCount = 0;
+		std::vector<uint32_t> slabMax(resolution, 0);
+		auto countTask = [&](int slab, int) {
+			int slabVoxels = resolution * resolution;
+			for (int v = slab * slabVoxels; v < (slab + 1) * slabVoxels; v++) {
+				slabMax[slab] = std::max(slabMax[slab], counts[v].load(std::memory_order_relaxed));
+			}
+		};
+
+		// log of the sample count, scaled so the busiest voxel gets 255, and the closest sample's angles
+		uint8_t *chainReach = &reachStore[chain.reachOffset];
+		int16_t *chainSeeds = &seedStore[chain.seedOffset];
+		int angleCount = 3 * chain.partCount;
+		auto storeTask = [&](int slab, int) {
+			int slabVoxels = resolution * resolution;
+			float scale = 254.0f / std::log(1.0f + (float)maxCount);
+			float angles[3 * reachMaxChainParts];
+			for (int v = slab * slabVoxels; v < (slab + 1) * slabVoxels; v++) {
+				uint32_t count = counts[v].load(std::memory_order_relaxed);
+				if (count == 0) {
+					continue;
+				}
+				chainReach[v] = (uint8_t)std::min(1.0f + std::floor(std::log(1.0f + (float)count) * scale), 255.0f);
+				SampleAngles(c, best[v].load(std::memory_order_relaxed) & 0xffffffffu, angleCount, angles);
+				for (int a = 0; a < angleCount; a++) {
+					float key = std::floor(angles[a] / reachPi * 32767.0f + 0.5f);
+					chainSeeds[(size_t)v * angleCount + a] = (int16_t)std::min(std::max(key, -32767.0f), 32767.0f);
+				}
+			}
+		};
+
+		if (pool) {
+			pool->parallelFor(resolution, clearTask);
+			pool->parallelFor(tasks, sampleTask);
+			pool->parallelFor(resolution, countTask);
+		} else {
+			for (int slab = 0; slab < resolution; slab++) {
+				clearTask(slab, 0);
+			}
+			for (int task = 0; task < tasks; task++) {
+				sampleTask(task, 0);
+			}
+			for (int slab = 0; slab < resolution; slab++) {
+				countTask(slab, 0);
+			}
+		}
+		maxCount = *std::max_element(slabMax.begin(), slabMax.end());
+		if (maxCount == 0) {
+			continue;
+		}
+		if (pool) {
+			pool->parallelFor(resolution, storeTask);
+		} else {
+			for (int slab = 0; slab < resolution; slab++) {
+				storeTask(slab, 0);
+			}
+		}
+	}
+
+	useBuildData();
+	return true;
+}
+
+void ReachabilityMap::useBuildData()
+{
+	chainData = chainStore.empty() ? 0 : &chainStore[0];
+	reach = reachStore.empty() ? 0 : &reachStore[0];
+	seeds = seedStore.empty() ? 0 : &seedStore[0];
+}
+
+bool ReachabilityMap::write(const char *fileName) const
+{
+	std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Cannot write reachability map " << fileName << std::endl;
+		return false;
+	}
+
+	ReachabilityHeader header;
+	memcpy(header.magic, reachabilityMagic, 4);
+	header.version = reachabilityVersion;
+	header.chainCount = chains;
+	header.voxelCount = 0;
+	size_t seedCount = 0;
+	for (int c = 0; c < chains; c++) {
+		uint32_t voxels = (uint32_t)chainData[c].resolution * chainData[c].resolution * chainData[c].resolution;
+		header.voxelCount += voxels;
+		seedCount += (size_t)voxels * 3 * chainData[c].partCount;
+	}
+
+	out.write((const char *)&header, sizeof(header));
+	out.write((const char *)chainData, sizeof(ReachabilityChain) * chains);
+	out.write((const char *)reach, (header.voxelCount + 3) & ~3u);
+	out.write((const char *)seeds, sizeof(int16_t) * seedCount);
+	return (bool)out;
+}
+
+bool ReachabilityMap::open(const char *fileName)
+{
+	close();
+	if (!file.open(fileName)) {
+		return false;
+	}
+
+	ReachabilityHeader header;
+	memset(&header, 0, sizeof(header));
+	if (file.size() >= sizeof(header)) {
+		memcpy(&header, file.data(), sizeof(header));
+	}
+	bool valid = memcmp(header.magic, reachabilityMagic, 4) == 0 && header.version == reachabilityVersion &&
+		file.size() >= sizeof(header) + sizeof(ReachabilityChain) * (size_t)header.chainCount;
+
+	// the sections have to match what the chains describe
+	size_t voxels = 0, seedCount = 0;
+	const ReachabilityChain *records = (const ReachabilityChain *)(file.data() + sizeof(header));
+	for (uint32_t c = 0; valid && c < header.chainCount; c++) {
+		const ReachabilityChain &chain = records[c];
+		// the same limits build() keeps, and a grid a point can be placed in
+		valid = chain.partCount > 0 && chain.partCount <= reachMaxChainParts &&
+			chain.resolution > 0 && chain.resolution <= reachMaxResolution &&
+			std::isfinite(chain.voxelSize) && chain.voxelSize > 0.0f &&
+			std::isfinite(chain.origin[0]) && std::isfinite(chain.origin[1]) && std::isfinite(chain.origin[2]) &&
+			chain.reachOffset == voxels && chain.seedOffset == seedCount;
+		size_t chainVoxels = (size_t)chain.resolution * chain.resolution * chain.resolution;
+		voxels += chainVoxels;
+		seedCount += chainVoxels * 3 * chain.partCount;
+	}
+	size_t reachBytes = (voxels + 3) & ~(size_t)3;
+	if (!valid || voxels != header.voxelCount ||
+		file.size() != sizeof(header) + sizeof(ReachabilityChain) * header.chainCount + reachBytes + sizeof(int16_t) * seedCount) {
+		std::cerr << "Not a reachability map: " << fileName << std::endl;
+		close();
+		return false;
+	}
+
+	chains = header.chainCount;
+	chainData = records;
+	reach = (const uint8_t *)(records + chains);
+	seeds = (const int16_t *)(reach + reachBytes);
+	return true;
+}
+
+void ReachabilityMap::close()
+{
+	file.close();
+	chains = 0;
+	chainData = 0;
+	reach = 0;
+	seeds = 0;
+	chainStore.clear();
+	reachStore.clear();
+	seedStore.clear();
+}
+
+int ReachabilityMap::findChain(int endPart) const
+{
+	for (int c = 0; c < chains; c++) {
+		if (chainData[c].endPart == endPart) {
+			return c;
+		}
+	}
+	return -1;
+}
+
+int ReachabilityMap::voxelIndex(const ReachabilityChain &chain, const glm::vec3 &point) const
+{
+	float inverse = 1.0f / chain.voxelSize;
+	float x = std::floor((point.x - chain.origin[0]) * inverse);
+	float y = std::floor((point.y - chain.origin[1]) * inverse);
+	float z = std::floor((point.z - chain.origin[2]) * inverse);
+	int resolution = chain.resolution;
+	// range checked before converting, far or NaN points do not fit an int
+	if (!(x >= 0.0f && y >= 0.0f && z >= 0.0f && x < resolution && y < resolution && z < resolution)) {
+		return -1;
+	}
+	return ((int)z * resolution + (int)y) * resolution + (int)x;
+}
+
+int ReachabilityMap::reachability(int chain, const glm::vec3 &point) const
+{
+	int voxel = voxelIndex(chainData[chain], point);
+	return voxel < 0 ? 0 : reach[chainData[chain].reachOffset + voxel];
+}
+
+bool ReachabilityMap::seed(int chain, const glm::vec3 &point, float *angles) const
+{
+	const ReachabilityChain &record = chainData[chain];
+	int voxel = voxelIndex(record, point);
+	if (voxel < 0 || reach[record.reachOffset + voxel] == 0) {
+		return false;
+	}
+
+	int count = 3 * record.partCount;
+	const int16_t *keys = seeds + record.seedOffset + (size_t)voxel * count;
+	for (int a = 0; a < count; a++) {
+		angles[a] = keys[a] * (reachPi / 32767.0f);
+	}
+	return true;
+}
+
+glm::vec3 ReachabilityMap::effector(int chain, const float *angles) const
+{
+	return ChainEffector(chainData[chain], angles);
+}
+
+int ReachabilityMap::solve(int chain, const glm::vec3 &target, float *angles, int maxIterations, float tolerance) const
+{
+	const ReachabilityChain &record = chainData[chain];
+	const int count = 3 * record.partCount;
+	const float step = 1e-3f;
+	const float damping = 0.05f;
+	glm::vec3 columns[3 * reachMaxChainParts];
+
+	for (int iteration = 0; iteration <= maxIterations; iteration++) {
+		glm::vec3 tip = ChainEffector(record, angles);
+		glm::vec3 error = target - tip;
+		if (glm::length(error) <= tolerance) {
+			return iteration;
+		}
+		if (iteration == maxIterations) {
+			break;
+		}
+
+		// Jacobian by forward differences, one column per angle
+		for (int a = 0; a < count; a++) {
+			float saved = angles[a];
+			angles[a] = saved + step;
+			columns[a] = (ChainEffector(record, angles) - tip) / step;
+			angles[a] = saved;
+		}
+
+		// damped least squares: angles += J^T (J J^T + damping^2 I)^-1 error
+		float m[3][3] = {{damping * damping, 0.0f, 0.0f}, {0.0f, damping * damping, 0.0f}, {0.0f, 0.0f, damping * damping}};
+		for (int a = 0; a < count; a++) {
+			for (int row = 0; row < 3; row++) {
+				for (int col = 0; col < 3; col++) {
+					m[row][col] += columns[a][row] * columns[a][col];
+				}
+			}
+		}
+		glm::vec3 solved = Solve3x3(m, error);
+		float largest = 0.0f;
+		float change[3 * reachMaxChainParts];
+		for (int a = 0; a < count; a++) {
+			change[a] = glm::dot(columns[a], solved);
+			largest = std::max(largest, std::fabs(change[a]));
+		}
+
+		// no more than half a radian per joint per iteration
+		float scale = largest > 0.5f ? 0.5f / largest : 1.0f;
+		for (int a = 0; a < count; a++) {
+			angles[a] += change[a] * scale;
+		}
+	}
+	return -1;
+}
+
+bool BuildRobotReachabilityMap(ReachabilityMap &map, int resolution, int64_t samplesPerChain, int threadCount)
+{
+	// lower arms, lower legs and head; the tip is the far end of the part's box from its joint
+	const int endParts[5] = {2, 4, 6, 8, 9};
+	glm::vec3 tips[5];
+	for (int c = 0; c < 5; c++) {
+		const StaticPart &part = TenPartRobot::parts[endParts[c]];
+		float direction = part.jointTranslation[1] < 0.0f ? -1.0f : 1.0f;
+		tips[c] = glm::vec3(part.jointTranslation[0], part.jointTranslation[1] + direction * part.scale[1], part.jointTranslation[2]);
+	}
+	return map.build(TenPartRobot::parts, TenPartRobot::partCount, endParts, tips, 5, resolution, samplesPerChain, threadCount);
+}
+
+void BenchmarkReachabilityMap(int resolution, int64_t samplesPerChain)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const char *fileName = "reach_bench.rbrm";
+	const int lookups = 1000000;
+	const int solves = 1000;
+
+	// build time on 1 to all threads, every build has to match the first
+	std::cout << "resolution " << resolution << ", " << samplesPerChain << " samples per chain" << std::endl;
+	std::cout << "threads\tbuild(ms)\tsamples/s\tmatches 1 thread" << std::endl;
+	int hardwareThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	ReachabilityMap reference;
+	for (int threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+		ReachabilityMap map;
+		Clock::time_point start = Clock::now();
+		if (!BuildRobotReachabilityMap(threads == 1 ? reference : map, resolution, samplesPerChain, threads)) {
+			return;
+		}
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+		bool matches = true;
+		if (threads > 1) {
+			for (int c = 0; c < map.chainCount(); c++) {
+				for (float x = -4.0f; x <= 4.0f; x += 0.25f) {
+					for (float y = -5.0f; y <= 5.0f; y += 0.25f) {
+						glm::vec3 point(x, y, 0.3f);
+						float a[3 * reachMaxChainParts], b[3 * reachMaxChainParts];
+						bool seededA = map.seed(c, point, a), seededB = reference.seed(c, point, b);
+						matches = matches && map.reachability(c, point) == reference.reachability(c, point) && seededA == seededB &&
+							(!seededA || memcmp(a, b, sizeof(float) * map.angleCount(c)) == 0);
+					}
+				}
+			}
+		}
+		std::cout << threads << "\t" << ms << "\t" << 5 * samplesPerChain / ms * 1000.0 << "\t" << (matches ? "yes" : "NO") << std::endl;
+		if (threads == hardwareThreads) {
+			break;
+		}
+	}
+
+	ReachabilityMap map;
+	if (!reference.write(fileName)) {
+		return;
+	}
+	Clock::time_point start = Clock::now();
+	if (!map.open(fileName)) {
+		remove(fileName);
+		return;
+	}
+	double openMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	FILE *file = fopen(fileName, "rb");
+	long bytes = 0;
+	if (file) {
+		fseek(file, 0, SEEK_END);
+		bytes = ftell(file);
+		fclose(file);
+	}
+	std::cout << "file " << bytes / 1e6 << " MB, opened in " << openMs << " ms" << std::endl;
+
+	// lookups at random points of each chain's grid
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<glm::vec3> points(lookups);
+	std::vector<int> pointChains(lookups);
+	for (int i = 0; i < lookups; i++) {
+		int c = i % map.chainCount();
+		const ReachabilityChain &chain = map.chain(c);
+		float extent = chain.voxelSize * chain.resolution;
+		points[i] = glm::vec3(chain.origin[0], chain.origin[1], chain.origin[2]) + extent * glm::vec3(unit(rng), unit(rng), unit(rng));
+		pointChains[i] = c;
+	}
+	int reachable = 0;
+	start = Clock::now();
+	for (int i = 0; i < lookups; i++) {
+		reachable += map.reachability(pointChains[i], points[i]) > 0;
+	}
+	double lookupNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / lookups;
+	float seedAngles[3 * reachMaxChainParts];
+	start = Clock::now();
+	for (int i = 0; i < lookups; i++) {
+		reachable += map.seed(pointChains[i], points[i], seedAngles);
+	}
+	double seedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / lookups;
+	std::cout << "reachability lookup " << lookupNs << " ns, seed lookup " << seedNs << " ns, "
+		<< reachable / (2.0 * lookups) << " of the grid reachable" << std::endl;
+
+	// IK to points the chains can certainly reach, from the cached seed and from the rest pose
+	std::cout << "start\tsolved\titerations\tus/solve" << std::endl;
+	std::vector<glm::vec3> targets(solves);
+	std::vector<float> randomAngles(3 * reachMaxChainParts);
+	for (int i = 0; i < solves; i++) {
+		int c = i % map.chainCount();
+		for (int a = 0; a < map.angleCount(c); a++) {
+			randomAngles[a] = (2.0f * unit(rng) - 1.0f) * reachPi;
+		}
+		targets[i] = map.effector(c, &randomAngles[0]);
+	}
+	for (int seeded = 1; seeded >= 0; seeded--) {
+		int solved = 0;
+		int64_t iterations = 0;
+		start = Clock::now();
+		for (int i = 0; i < solves; i++) {
+			int c = i % map.chainCount();
+			float angles[3 * reachMaxChainParts] = {};
+			if (seeded) {
+				map.seed(c, targets[i], angles);
+			}
+			int taken = map.solve(c, targets[i], angles);
+			solved += taken >= 0;
+			iterations += taken >= 0 ? taken : 50;
+		}
+		double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / solves;
+		std::cout << (seeded ? "seed" : "rest") << "\t" << (double)solved / solves << "\t" << (double)iterations / solves << "\t" << us << std::endl;
+	}
+	remove(fileName);
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "StaticSkeleton.h"
+
+// parts in the longest limb chain a map can hold
+const int reachMaxChainParts = 4;
+// voxels on a side of a chain's grid, so voxel indices fit an int
+const int reachMaxResolution = 1024;
+
+// One limb of a skeleton: the parts from the first joint below the root down to
+// an end part, and the point on the end part that has to reach. Positions are
+// in the root part's joint space, so a map holds for any placement of the root.
+struct ReachabilityChain
+{
+	int32_t endPart;
+	int32_t partCount;
+	// skeleton indices of the chain's parts, the first one hangs off the root
+	int32_t partIndices[reachMaxChainParts];
+	// copies of the parts, each the parent of the next
+	StaticPart parts[reachMaxChainParts];
+	// effector point in the end part's joint space
+	float tip[3];
+
+	// resolution^3 voxels of voxelSize starting at origin, around the first joint
+	float origin[3];
+	float voxelSize;
+	int32_t resolution;
+	// first voxel of the chain in the reach bytes and in the seeds (angleCount per voxel)
+	uint32_t reachOffset;
+	uint32_t seedOffset;
+};
+
+// Precomputed workspace of a skeleton's limbs: which points each limb can reach
+// and the joint angles that reach them best.
+//
+// Building samples every chain's joint space, all three angles of every part in
+// [-pi, pi), on a ThreadPool. Each sample's effector lands in a voxel; a voxel
+// counts its samples and keeps the one that came closest to its center. The
+// workers share one grid of atomic counts and closest samples, 12 bytes a voxel
+// however many there are. Samples are generated from their index, so the map
+// is the same on any thread count.
+// A voxel's reachability byte is 0 when nothing landed in it and otherwise grows
+// from 1 to 255 with the log of its sample count, roughly how many ways there
+// are to reach it. Its seed is the closest sample's angles as 16-bit fractions
+// of pi.
+//
+// Lookups are a voxel index computation and one read. solve() refines a seed
+// into an exact solution by damped least squares.
+//
+// File layout:
+//   header  magic "RBRM", version, chain count, total voxels
+//   chains  ReachabilityChain records
+//   reach   one byte per voxel of every chain, padded to four bytes
+//   seeds   3 * partCount int16 angles per voxel of every chain
+// Maps are opened by mapping the file, so only the voxels looked up are read.
+class ReachabilityMap
+{
+public:
+	ReachabilityMap();
+	~ReachabilityMap();
+
+	// One chain per end part, tips[i] the effector point of endParts[i]. threadCount
+	// of 0 uses every hardware thread. Returns false if an end part is out of
+	// range or the root, a chain is too long, resolution is not 1 to
+	// reachMaxResolution or samples are not 1 to UINT32_MAX.
+	bool build(const StaticPart *parts, int partCount, const int *endParts, const glm::vec3 *tips, int chainCount,
+		int resolution, int64_t samplesPerChain, int threadCount = 0);
+
+	bool write(const char *fileName) const;
+	bool open(const char *fileName);
+	void close();
+
+	int chainCount() const { return chains; }
+	const ReachabilityChain &chain(int index) const { return chainData[index]; }
+	// the chain ending in a skeleton part, -1 if there is none
+	int findChain(int endPart) const;
+	int angleCount(int chain) const { return 3 * chainData[chain].partCount; }
+
+	// 0 when the point is outside the chain's grid or was never reached, up to 255
+	int reachability(int chain, const glm::vec3 &point) const;
+	// Cached angles that reach closest to point's voxel, angleCount floats. False if unreachable.
+	bool seed(int chain, const glm::vec3 &point, float *angles) const;
+
+	// where the chain's tip is for the given angles
+	glm::vec3 effector(int chain, const float *angles) const;
+	// Refine angles until the tip is within tolerance of target. Returns the
+	// iterations taken, or -1 if it did not get there in maxIterations.
+	int solve(int chain, const glm::vec3 &target, float *angles, int maxIterations = 50, float tolerance = 1e-3f) const;
+
+private:
+	ReachabilityMap(const ReachabilityMap &);
+	ReachabilityMap &operator=(const ReachabilityMap &);
+
+	int voxelIndex(const ReachabilityChain &chain, const glm::vec3 &point) const;
+	void useBuildData();
+
+	int chains = 0;
+	// either the build vectors below or the mapped file
+	const ReachabilityChain *chainData = 0;
+	const uint8_t *reach = 0;
+	const int16_t *seeds = 0;
+
+	std::vector<ReachabilityChain> chainStore;
+	std::vector<uint8_t> reachStore;
+	std::vector<int16_t> seedStore;
+
+	MappedFile file;
+};
+
+// Build the ten part robot's map with its arms, legs and head as chains.
+bool BuildRobotReachabilityMap(ReachabilityMap &map, int resolution, int64_t samplesPerChain, int threadCount = 0);
+
+// Build time on 1 to all threads, file size and load time, lookup latency and
+// seeded against unseeded IK for the robot's map.
+void BenchmarkReachabilityMap(int resolution, int64_t samplesPerChain);
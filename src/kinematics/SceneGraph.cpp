@@ -0,0 +1,242 @@
+#include "SceneGraph.h"
+
+#include <cassert>
+#include <glm/gtc/matrix_transform.hpp>
+
+uint32_t NameTable::intern(const char *name)
+{
+	std::unordered_map<std::string, uint32_t>::const_iterator found = ids.find(name);
+	if (found != ids.end()) {
+		return found->second;
+	}
+
+	uint32_t id = (uint32_t)names.size();
+	names.push_back(name);
+	ids[names.back()] = id;
+	return id;
+}
+
+SceneGraph::SceneGraph()
+{
+}
+
+SceneGraph::~SceneGraph()
+{
+}
+
+SceneHandle SceneGraph::create(SceneHandle parent, const char *name)
+{
+	// a stale parent is a bug in the caller, not a request for a root
+	if (parent != sceneNullHandle && !isValid(parent)) {
+		return sceneNullHandle;
+	}
+
+	uint32_t index;
+	if (!freeSlots.empty()) {
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	} else {
+		index = (uint32_t)nodes.size();
+		nodes.push_back(SceneNode());
+	}
+
+	// reset everything except the generation, which was bumped on removal
+	SceneNode &n = nodes[index];
+	uint32_t generation = n.generation;
+	n = SceneNode();
+	n.generation = generation;
+	n.alive = true;
+	n.name = nameTable.intern(name);
+	aliveCount++;
+
+	if (isValid(parent)) {
+		link(index, parent.index);
+	}
+
+	SceneHandle handle = {index, generation};
+	return handle;
+}
+
+void SceneGraph::remove(SceneHandle handle)
+{
+	if (!isValid(handle)) {
+		return;
+	}
+
+	unlink(handle.index);
+
+	// free the subtree without recursion, children first
+	uint32_t index = handle.index;
+	while (index != sceneNoNode) {
+		SceneNode &n = nodes[index];
+		if (n.firstChild != sceneNoNode) {
+			index = n.firstChild;
+			continue;
+		}
+
+		uint32_t parent = n.parent;
+		if (index != handle.index) {
+			unlink(index);
+		}
+		n.alive = false;
+		n.generation++;
+		n.parent = sceneNoNode;
+		freeSlots.push_back(index);
+		aliveCount--;
+
+		index = index == handle.index ? sceneNoNode : parent;
+	}
+}
+
+bool SceneGraph::reparent(SceneHandle handle, SceneHandle newParent)
+{
+	if (!isValid(handle)) {
+		return false;
+	}
+	if (newParent != sceneNullHandle && !isValid(newParent)) {
+		return false;
+	}
+
+	if (isValid(newParent)) {
+		// refuse to move a node under itself or one of its descendants
+		for (uint32_t i = newParent.index; i != sceneNoNode; i = nodes[i].parent) {
+			if (i == handle.index) {
+				return false;
+			}
+		}
+	}
+
+	unlink(handle.index);
+	if (isValid(newParent)) {
+		link(handle.index, newParent.index);
+	}
+	return true;
+}
+
+SceneHandle SceneGraph::handleOf(uint32_t index) const
+{
+	if (index == sceneNoNode) {
+		return sceneNullHandle;
+	}
+	SceneHandle handle = {index, nodes[index].generation};
+	return handle;
+}
+
+void SceneGraph::setScale(SceneHandle handle, glm::vec3 s)
+{
+	SceneNode &n = node(handle);
+	n.scale = s;
+	n.originalScale = s;
+	n.selectedScale = {1.1f*s[0], 1.1f*s[1], 1.1f*s[2]};
+}
+
+void SceneGraph::link(uint32_t index, uint32_t parent)
+{
+	SceneNode &n = nodes[index];
+	SceneNode &p = nodes[parent];
+	n.parent = parent;
+	n.prevSibling = p.lastChild;
+	n.nextSibling = sceneNoNode;
+	if (p.lastChild != sceneNoNode) {
+		nodes[p.lastChild].nextSibling = index;
+	} else {
+		p.firstChild = index;
+	}
+	p.lastChild = index;
+}
+
+void SceneGraph::unlink(uint32_t index)
+{
+	SceneNode &n = nodes[index];
+	if (n.parent == sceneNoNode) {
+		return;
+	}
+
+	SceneNode &p = nodes[n.parent];
+	if (n.prevSibling != sceneNoNode) {
+		nodes[n.prevSibling].nextSibling = n.nextSibling;
+	} else {
+		p.firstChild = n.nextSibling;
+	}
+	if (n.nextSibling != sceneNoNode) {
+		nodes[n.nextSibling].prevSibling = n.prevSibling;
+	} else {
+		p.lastChild = n.prevSibling;
+	}
+	n.parent = sceneNoNode;
+	n.prevSibling = sceneNoNode;
+	n.nextSibling = sceneNoNode;
+}
+
+SceneGraph::ChildRange SceneGraph::children(SceneHandle handle) const
+{
+	ChildRange range = {ChildIterator(this, node(handle).firstChild), ChildIterator(this, sceneNoNode)};
+	return range;
+}
+
+SceneHandle SceneGraph::nextInTraversal(SceneHandle current, SceneHandle root) const
+{
+	assert(isValid(current) && isValid(root));
+	uint32_t index = current.index;
+	if (nodes[index].firstChild != sceneNoNode) {
+		return handleOf(nodes[index].firstChild);
+	}
+
+	// climb until a node with a next sibling, without leaving the subtree of root
+	while (index != root.index) {
+		if (nodes[index].nextSibling != sceneNoNode) {
+			return handleOf(nodes[index].nextSibling);
+		}
+		index = nodes[index].parent;
+	}
+	return sceneNullHandle;
+}
+
+void SceneGraph::traverse(SceneHandle root, std::vector<SceneHandle> &order) const
+{
+	for (SceneHandle h = root; h != sceneNullHandle; h = nextInTraversal(h, root)) {
+		order.push_back(h);
+	}
+}
+
+glm::mat4 SceneGraph::jointTransform(SceneHandle handle, const glm::mat4 &parentJoint) const
+{
+	const SceneNode &n = node(handle);
+	glm::mat4 joint = glm::translate(parentJoint, n.parentTranslation);
+	joint = glm::rotate(joint, n.rotation[0], glm::vec3(1.0f, 0.0f, 0.0f));
+	joint = glm::rotate(joint, n.rotation[1], glm::vec3(0.0f, 1.0f, 0.0f));
+	joint = glm::rotate(joint, n.rotation[2], glm::vec3(0.0f, 0.0f, 1.0f));
+	return joint;
+}
+
+glm::mat4 SceneGraph::partTransform(SceneHandle handle, const glm::mat4 &joint) const
+{
+	const SceneNode &n = node(handle);
+	return glm::scale(glm::translate(joint, n.jointTranslation), n.scale);
+}
+
+void SceneGraph::computeBounds(SceneHandle root, const glm::mat4 &parentJoint, glm::vec3 &boundsMin, glm::vec3 &boundsMax) const
+{
+	glm::mat4 joint = jointTransform(root, parentJoint);
+	glm::mat4 part = partTransform(root, joint);
+
+	// the unit cube's corners land within the sum of the absolute axis columns of its center
+	glm::vec3 center(part[3]);
+	glm::vec3 extent = glm::abs(glm::vec3(part[0])) + glm::abs(glm::vec3(part[1])) + glm::abs(glm::vec3(part[2]));
+	boundsMin = glm::min(boundsMin, center - extent);
+	boundsMax = glm::max(boundsMax, center + extent);
+
+	for (uint32_t child = nodes[root.index].firstChild; child != sceneNoNode; child = nodes[child].nextSibling) {
+		computeBounds(handleOf(child), joint, boundsMin, boundsMax);
+	}
+}
+
+void SceneGraph::computeWorldTransforms(SceneHandle root, const glm::mat4 &parentJoint, std::vector<glm::mat4> &worldTransforms) const
+{
+	glm::mat4 joint = jointTransform(root, parentJoint);
+	worldTransforms.push_back(partTransform(root, joint));
+
+	for (uint32_t child = nodes[root.index].firstChild; child != sceneNoNode; child = nodes[child].nextSibling) {
+		computeWorldTransforms(handleOf(child), joint, worldTransforms);
+	}
+}
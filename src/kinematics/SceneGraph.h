@@ -0,0 +1,167 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Generational handle to a scene node. A handle to a removed node stays
+// invalid even after its slot is reused by a new node.
+struct SceneHandle
+{
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const SceneHandle &other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const SceneHandle &other) const { return !(*this == other); }
+};
+
+static const uint32_t sceneNoNode = 0xffffffffu;
+static const SceneHandle sceneNullHandle = {sceneNoNode, 0};
+
+// Interned strings: every distinct name is stored once and nodes keep a small id.
+// Names never move once interned, so lookup's pointers stay valid.
+class NameTable
+{
+public:
+	uint32_t intern(const char *name);
+	const char *lookup(uint32_t id) const { return names[id].c_str(); }
+
+private:
+	// a deque, not a vector: growing it would move short names held inline
+	std::deque<std::string> names;
+	std::unordered_map<std::string, uint32_t> ids;
+};
+
+// One part of a robot. Children form an intrusive doubly linked sibling list,
+// so linking, unlinking and walking children never allocates.
+struct SceneNode
+{
+	uint32_t generation = 1;
+	bool alive = false;
+
+	uint32_t parent = sceneNoNode;
+	uint32_t firstChild = sceneNoNode;
+	uint32_t lastChild = sceneNoNode;
+	uint32_t prevSibling = sceneNoNode;
+	uint32_t nextSibling = sceneNoNode;
+
+	uint32_t name = 0;
+
+	// what the part is drawn with, indexes into the renderer's mesh and material tables
+	uint16_t mesh = 0;
+	uint16_t material = 0;
+
+	// translation of this component's joint with respect to the parent component's joint
+	glm::vec3 parentTranslation{0.0f, 0.0f, 0.0f};
+	// the current joint angles about the X, Y, and Z axes of the component's joint
+	glm::vec3 rotation{0.0f, 0.0f, 0.0f};
+	// translation of the component with respect to its joint
+	glm::vec3 jointTranslation{0.0f, 0.0f, 0.0f};
+	// the X, Y, and Z scaling factors for the component, enlarged while selected
+	glm::vec3 scale{0.0f, 0.0f, 0.0f};
+	glm::vec3 originalScale{0.0f, 0.0f, 0.0f};
+	glm::vec3 selectedScale{0.0f, 0.0f, 0.0f};
+};
+
+// Pool of scene nodes addressed by handles. Nodes live in one contiguous array
+// and freed slots are recycled, so adding, removing and reparenting parts at
+// runtime is O(1) amortized and never invalidates other handles.
+class SceneGraph
+{
+public:
+	SceneGraph();
+	~SceneGraph();
+
+	// Add a node as the last child of parent (or as a root with sceneNullHandle).
+	// Returns sceneNullHandle if parent is a stale handle.
+	SceneHandle create(SceneHandle parent, const char *name);
+
+	// Remove a node and its whole subtree.
+	void remove(SceneHandle handle);
+
+	// Move a node, with its subtree, under a new parent. Fails if that would
+	// make the node its own ancestor or newParent is a stale handle.
+	bool reparent(SceneHandle handle, SceneHandle newParent);
+
+	bool isValid(SceneHandle handle) const
+	{
+		return handle.index < nodes.size() && nodes[handle.index].alive && nodes[handle.index].generation == handle.generation;
+	}
+	int size() const { return aliveCount; }
+
+	// The accessors below take live handles; debug builds assert it.
+	SceneNode &node(SceneHandle handle) { assert(isValid(handle)); return nodes[handle.index]; }
+	const SceneNode &node(SceneHandle handle) const { assert(isValid(handle)); return nodes[handle.index]; }
+	SceneHandle handleOf(uint32_t index) const;
+
+	SceneHandle getParent(SceneHandle handle) const { return handleOf(node(handle).parent); }
+	const char *getName(SceneHandle handle) const { return nameTable.lookup(node(handle).name); }
+	void setName(SceneHandle handle, const char *name) { node(handle).name = nameTable.intern(name); }
+
+	void setScale(SceneHandle handle, glm::vec3 s);
+	void setParentTranslation(SceneHandle handle, glm::vec3 t) { node(handle).parentTranslation = t; }
+	glm::vec3 getParentTranslation(SceneHandle handle) const { return node(handle).parentTranslation; }
+	void setJointTranslation(SceneHandle handle, glm::vec3 t) { node(handle).jointTranslation = t; }
+	void setMesh(SceneHandle handle, uint16_t mesh) { node(handle).mesh = mesh; }
+	void setMaterial(SceneHandle handle, uint16_t material) { node(handle).material = material; }
+	void setRotation(SceneHandle handle, glm::vec3 r) { node(handle).rotation = r; }
+	glm::vec3 getRotation(SceneHandle handle) const { return node(handle).rotation; }
+	void addRotation(SceneHandle handle, glm::vec3 delta) { node(handle).rotation += delta; }
+
+	// select enlarges a part by 10% so it stands out, deselect restores it
+	void select(SceneHandle handle) { SceneNode &n = node(handle); n.scale = n.selectedScale; }
+	void deselect(SceneHandle handle) { SceneNode &n = node(handle); n.scale = n.originalScale; }
+
+	// Iterates the children of a node by following sibling links.
+	class ChildIterator
+	{
+	public:
+		ChildIterator(const SceneGraph *graph, uint32_t index) : graph(graph), index(index) {}
+		SceneHandle operator*() const { return graph->handleOf(index); }
+		ChildIterator &operator++() { index = graph->nodes[index].nextSibling; return *this; }
+		bool operator!=(const ChildIterator &other) const { return index != other.index; }
+
+	private:
+		const SceneGraph *graph;
+		uint32_t index;
+	};
+
+	struct ChildRange
+	{
+		ChildIterator first;
+		ChildIterator last;
+		ChildIterator begin() const { return first; }
+		ChildIterator end() const { return last; }
+	};
+
+	ChildRange children(SceneHandle handle) const;
+
+	// Depth-first pre-order walk, the order the robot's parts are selected in.
+	// Returns sceneNullHandle after the last node under root.
+	SceneHandle nextInTraversal(SceneHandle current, SceneHandle root) const;
+	void traverse(SceneHandle root, std::vector<SceneHandle> &order) const;
+
+	// World transform of every node under root in traversal order.
+	void computeWorldTransforms(SceneHandle root, const glm::mat4 &parentJoint, std::vector<glm::mat4> &worldTransforms) const;
+
+	// World space box around every part under root, grown to take them in.
+	// Start with boundsMin above boundsMax to get the bounds of the subtree alone.
+	void computeBounds(SceneHandle root, const glm::mat4 &parentJoint, glm::vec3 &boundsMin, glm::vec3 &boundsMax) const;
+
+	// Joint frame of a node, parentJoint * T(parentTranslation) * Rx * Ry * Rz.
+	glm::mat4 jointTransform(SceneHandle handle, const glm::mat4 &parentJoint) const;
+	// Draw transform of a node given its joint frame, joint * T(jointTranslation) * S(scale).
+	glm::mat4 partTransform(SceneHandle handle, const glm::mat4 &joint) const;
+
+private:
+	void link(uint32_t index, uint32_t parent);
+	void unlink(uint32_t index);
+
+	std::vector<SceneNode> nodes;
+	std::vector<uint32_t> freeSlots;
+	int aliveCount = 0;
+	NameTable nameTable;
+};
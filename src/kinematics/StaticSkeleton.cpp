@@ -0,0 +1,4 @@
+#include "StaticSkeleton.h"
+
+// C++11 still wants a definition of the part table; every use of it folds to a constant
+constexpr StaticPart TenPartRobot::parts[TenPartRobot::partCount];
@@ -0,0 +1,154 @@
+#pragma once
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Forward kinematics for skeletons whose topology is known at compile time.
+//
+// A skeleton is a type with a constexpr table of parts in traversal order
+// (parents before children). StaticForwardKinematics<Skeleton> expands into
+// one straight-line block per part: there is no recursion, no virtual call and
+// no child list at run time, and the offsets and scales from the table are
+// folded into the arithmetic as constants. Dynamic robots keep using the
+// SceneGraph.
+
+struct StaticPart
+{
+	// index of the parent part, -1 for the root
+	int parent;
+	// translation of this part's joint with respect to the parent's joint
+	float parentTranslation[3];
+	// translation of the part with respect to its joint
+	float jointTranslation[3];
+	float scale[3];
+};
+
+// The robot built by ConstructRobot(), in SceneGraph traversal order.
+struct TenPartRobot
+{
+	static const int partCount = 10;
+	static constexpr StaticPart parts[partCount] = {
+		// torso
+		{-1, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {1.0f, 2.0f, 1.0f}},
+		// left upper arm, left lower arm
+		{0, {1.0f, 1.0f, 0.0f}, {0.0f, -0.9f, 0.0f}, {0.5f, 1.0f, 0.5f}},
+		{1, {0.0f, -2.0f, 0.0f}, {0.0f, -0.4f, 0.0f}, {0.25f, 0.5f, 0.25f}},
+		// right upper arm, right lower arm
+		{0, {-1.0f, 1.0f, 0.0f}, {0.0f, -0.9f, 0.0f}, {0.5f, 1.0f, 0.5f}},
+		{3, {0.0f, -2.0f, 0.0f}, {0.0f, -0.4f, 0.0f}, {0.25f, 0.5f, 0.25f}},
+		// left upper leg, left lower leg
+		{0, {0.6f, -2.0f, 0.0f}, {0.0f, -0.9f, 0.0f}, {0.5f, 1.0f, 0.5f}},
+		{5, {0.0f, -2.0f, 0.0f}, {0.0f, -0.4f, 0.0f}, {0.25f, 0.5f, 0.25f}},
+		// right upper leg, right lower leg
+		{0, {-0.6f, -2.0f, 0.0f}, {0.0f, -0.9f, 0.0f}, {0.5f, 1.0f, 0.5f}},
+		{7, {0.0f, -2.0f, 0.0f}, {0.0f, -0.4f, 0.0f}, {0.25f, 0.5f, 0.25f}},
+		// head
+		{0, {0.0f, 2.0f, 0.0f}, {0.0f, 0.4f, 0.0f}, {0.5f, 0.5f, 0.5f}},
+	};
+};
+
+// Rotation (row-major 3x3) and translation of a joint frame.
+struct StaticJointFrame
+{
+	float r[9];
+	float t[3];
+};
+
+namespace StaticSkeletonDetail
+{
+	// R = Rx(a) * Ry(b) * Rz(c), the order SceneGraph::jointTransform applies them
+	inline void EulerXYZ(const float *angles, float *r)
+	{
+		float sa = std::sin(angles[0]), ca = std::cos(angles[0]);
+		float sb = std::sin(angles[1]), cb = std::cos(angles[1]);
+		float sc = std::sin(angles[2]), cc = std::cos(angles[2]);
+		r[0] = cb * cc;                   r[1] = -cb * sc;                  r[2] = sb;
+		r[3] = sa * sb * cc + ca * sc;    r[4] = -sa * sb * sc + ca * cc;   r[5] = -sa * cb;
+		r[6] = -ca * sb * cc + sa * sc;   r[7] = ca * sb * sc + sa * cc;    r[8] = ca * cb;
+	}
+
+	// child = parent * [local | offset]
+	inline void Compose(const StaticJointFrame &parent, const float *local, float ox, float oy, float oz, StaticJointFrame &child)
+	{
+		const float *p = parent.r;
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				child.r[row * 3 + col] = p[row * 3] * local[col] + p[row * 3 + 1] * local[3 + col] + p[row * 3 + 2] * local[6 + col];
+			}
+			child.t[row] = p[row * 3] * ox + p[row * 3 + 1] * oy + p[row * 3 + 2] * oz + parent.t[row];
+		}
+	}
+
+	// world = joint * T(jointTranslation) * S(scale), written as a column-major glm::mat4
+	inline void WorldMatrix(const StaticJointFrame &joint, float jx, float jy, float jz, float sx, float sy, float sz, glm::mat4 &world)
+	{
+		const float *r = joint.r;
+		world[0] = glm::vec4(r[0] * sx, r[3] * sx, r[6] * sx, 0.0f);
+		world[1] = glm::vec4(r[1] * sy, r[4] * sy, r[7] * sy, 0.0f);
+		world[2] = glm::vec4(r[2] * sz, r[5] * sz, r[8] * sz, 0.0f);
+		world[3] = glm::vec4(r[0] * jx + r[1] * jy + r[2] * jz + joint.t[0],
+			r[3] * jx + r[4] * jy + r[5] * jz + joint.t[1],
+			r[6] * jx + r[7] * jy + r[8] * jz + joint.t[2], 1.0f);
+	}
+
+	// the root's parent is the frame passed in, everything else a part computed earlier
+	template <int Parent>
+	struct ParentFrame
+	{
+		static inline const StaticJointFrame &get(const StaticJointFrame &, const StaticJointFrame *joints)
+		{
+			return joints[Parent];
+		}
+	};
+
+	template <>
+	struct ParentFrame<-1>
+	{
+		static inline const StaticJointFrame &get(const StaticJointFrame &root, const StaticJointFrame *)
+		{
+			return root;
+		}
+	};
+
+	// One instantiation per part; each run() inlines the next, so the whole
+	// skeleton becomes a single straight-line function.
+	template <class Skeleton, int I, int N = Skeleton::partCount>
+	struct Step
+	{
+		static_assert(Skeleton::parts[I].parent < I, "parts must be listed parents first");
+
+		static inline void run(const StaticJointFrame &root, const float *angles, StaticJointFrame *joints, glm::mat4 *world)
+		{
+			float local[9];
+			EulerXYZ(angles + 3 * I, local);
+
+			Compose(ParentFrame<Skeleton::parts[I].parent>::get(root, joints), local,
+				Skeleton::parts[I].parentTranslation[0], Skeleton::parts[I].parentTranslation[1], Skeleton::parts[I].parentTranslation[2],
+				joints[I]);
+			WorldMatrix(joints[I],
+				Skeleton::parts[I].jointTranslation[0], Skeleton::parts[I].jointTranslation[1], Skeleton::parts[I].jointTranslation[2],
+				Skeleton::parts[I].scale[0], Skeleton::parts[I].scale[1], Skeleton::parts[I].scale[2],
+				world[I]);
+
+			Step<Skeleton, I + 1, N>::run(root, angles, joints, world);
+		}
+	};
+
+	template <class Skeleton, int N>
+	struct Step<Skeleton, N, N>
+	{
+		static inline void run(const StaticJointFrame &, const float *, StaticJointFrame *, glm::mat4 *)
+		{
+		}
+	};
+}
+
+// World transforms of every part. angles holds the X, Y and Z joint angles of
+// each part in table order (the pose track channel layout), rootTranslation
+// places the root joint.
+template <class Skeleton>
+inline void StaticForwardKinematics(const float *angles, glm::mat4 *world, const glm::vec3 &rootTranslation = glm::vec3(0.0f))
+{
+	StaticJointFrame root = {{1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f}, {rootTranslation.x, rootTranslation.y, rootTranslation.z}};
+	StaticJointFrame joints[Skeleton::partCount];
+	StaticSkeletonDetail::Step<Skeleton, 0>::run(root, angles, joints, world);
+}
@@ -0,0 +1,119 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threadCount)
+	: ranges(threadCount > 0 ? threadCount : std::max(1u, std::thread::hardware_concurrency())),
+	  tasksRemaining(0)
+{
+	for (int worker = 1; worker < (int)ranges.size(); worker++) {
+		threads.push_back(std::thread(&ThreadPool::workerLoop, this, worker));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(jobLock);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+void ThreadPool::run(int taskCount, TaskFunction function, void *context)
+{
+	if (taskCount <= 0) {
+		return;
+	}
+
+	int workers = size();
+	if (workers == 1) {
+		for (int task = 0; task < taskCount; task++) {
+			function(context, task, 0);
+		}
+		return;
+	}
+
+	// hand every worker an equal contiguous share
+	for (int worker = 0; worker < workers; worker++) {
+		std::lock_guard<std::mutex> guard(ranges[worker].lock);
+		ranges[worker].begin = (int)((long long)taskCount * worker / workers);
+		ranges[worker].end = (int)((long long)taskCount * (worker + 1) / workers);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(jobLock);
+		jobFunction = function;
+		jobContext = context;
+		tasksRemaining.store(taskCount);
+		workersBusy = workers - 1;
+		jobGeneration++;
+	}
+	jobReady.notify_all();
+
+	work(0);
+
+	// the job's context lives on the caller's stack, so wait until every worker has let go of it
+	std::unique_lock<std::mutex> guard(jobLock);
+	jobDone.wait(guard, [this]() { return workersBusy == 0; });
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+	uint64_t seenGeneration = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(jobLock);
+			jobReady.wait(guard, [&]() { return stopping || jobGeneration != seenGeneration; });
+			if (stopping) {
+				return;
+			}
+			seenGeneration = jobGeneration;
+		}
+
+		work(worker);
+
+		{
+			std::lock_guard<std::mutex> guard(jobLock);
+			workersBusy--;
+		}
+		jobDone.notify_one();
+	}
+}
+
+void ThreadPool::work(int worker)
+{
+	int task;
+	while (tasksRemaining.load(std::memory_order_acquire) > 0 && takeTask(worker, task)) {
+		jobFunction(jobContext, task, worker);
+		tasksRemaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
+
+bool ThreadPool::takeTask(int worker, int &task)
+{
+	// own range first, from the back
+	{
+		TaskRange &own = ranges[worker];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (own.begin < own.end) {
+			task = --own.end;
+			return true;
+		}
+	}
+
+	// then steal from the front of the others
+	int workers = size();
+	for (int offset = 1; offset < workers; offset++) {
+		TaskRange &victim = ranges[(worker + offset) % workers];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (victim.begin < victim.end) {
+			task = victim.begin++;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running parallel loops with work stealing.
+//
+// parallelFor splits [0, taskCount) into one contiguous range per worker.
+// A worker takes tasks from the back of its own range and, once that is
+// empty, steals from the front of the others. The calling thread joins in as
+// worker 0 and the call returns when every task is done. Nothing is allocated
+// per call, so it is safe to use from the frame loop.
+class ThreadPool
+{
+public:
+	// threadCount includes the calling thread; 0 picks one per hardware thread
+	explicit ThreadPool(int threadCount = 0);
+	~ThreadPool();
+
+	int size() const { return (int)ranges.size(); }
+
+	// Call fn(task, worker) once for every task. worker is in [0, size()).
+	template <class F>
+	void parallelFor(int taskCount, F &fn)
+	{
+		run(taskCount, &Invoke<F>, &fn);
+	}
+
+private:
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+
+	typedef void (*TaskFunction)(void *context, int task, int worker);
+
+	template <class F>
+	static void Invoke(void *context, int task, int worker)
+	{
+		(*(F *)context)(task, worker);
+	}
+
+	void run(int taskCount, TaskFunction function, void *context);
+	void workerLoop(int worker);
+	void work(int worker);
+	bool takeTask(int worker, int &task);
+
+	// tasks still owned by a worker, [begin, end)
+	struct alignas(64) TaskRange
+	{
+		std::mutex lock;
+		int begin = 0;
+		int end = 0;
+	};
+
+	std::vector<TaskRange> ranges;
+	std::vector<std::thread> threads;
+
+	std::mutex jobLock;
+	std::condition_variable jobReady;
+	std::condition_variable jobDone;
+	uint64_t jobGeneration = 0;
+	bool stopping = false;
+
+	TaskFunction jobFunction = 0;
+	void *jobContext = 0;
+	std::atomic<int> tasksRemaining;
+	int workersBusy = 0;
+};
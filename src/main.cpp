@@ -9,14 +9,41 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
 #include "MatrixStack.h"
 #include "Program.h"
+#include "SpatialGrid.h"
+#include "FramePacer.h"
+#include "InputQueue.h"
+#include "InputTrace.h"
+#include "PoseTrack.h"
+#include "JointChannel.h"
+#include "StaticSkeleton.h"
+#include "SceneGraph.h"
+#include "AllocationTracker.h"
+#include "CommandRecorder.h"
+#include "RenderQueue.h"
+#include "CubeMesh.h"
+#include "ImpostorAtlas.h"
+#include "FrameWriter.h"
+#include "FrameCapture.h"
+#include "AnimationEngine.h"
+#include "MotionDatabase.h"
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 800
 
 char* vertShaderPath = "../shaders/shader.vert";
 char* fragShaderPath = "../shaders/shader.frag";
+const char *impostorVertShaderPath = "../shaders/impostor.vert";
+const char *impostorFragShaderPath = "../shaders/impostor.frag";
+const char *multiviewVertShaderPath = "../shaders/multiview.vert";
+const char *multiviewGeomShaderPath = "../shaders/multiview.geom";
+const char *multiviewFragShaderPath = "../shaders/multiview.frag";
 
 GLFWwindow *window;
 double currentXpos, currentYpos;
@@ -25,465 +52,1013 @@ glm::vec3 center(0.0f, 0.0f, 0.0f);
 glm::vec3 up(0.0f, 1.0f, 0.0f);
 
 Program program;
+// draws the billboards of far robots from the impostor atlas
+Program impostorProgram;
+// draws parts into every view at once, one instance per view
+Program multiviewProgram;
 MatrixStack modelViewProjectionMatrix;
+SceneGraph scene;
 
 bool animationOn = false;
+int animationStepsLeft = 0;
+double nextAnimationStep = 0.0;
+
+// On-demand rendering: frames are only drawn when something asked for one.
+// Continuous rendering redraws as fast as the frame rate cap allows.
+bool continuousRendering = false;
+bool redrawRequested = true;
+FramePacer framePacer;
+
+// input is queued by the callbacks and applied once per frame
+InputQueue inputQueue;
+FrameInput frameInput;
+LatencyHistogram inputLatency;
+
+// Input traces. While recording or replaying, animation follows the frame's
+// logical time, a fixed step per frame, so anything recorded input starts
+// advances on the same frames in the replay. A replay does not install the
+// window's input callbacks.
+InputRecorder inputRecorder;
+InputPlayer inputPlayer;
+bool replaying = false;
+// a captured pose track steps by its own sample interval instead
+double replayTimestep = 1.0 / 60.0;
+int frameNumber = 0;
+
+double CurrentTime()
+{
+	if (replaying || inputRecorder.isOpen()) {
+		return frameNumber * replayTimestep;
+	}
+	return glfwGetTime();
+}
 
-// Draw cube on screen
-void DrawCube(glm::mat4& modelViewProjectionMatrix)
+// queue an event for the next frame, recording it if a trace is being written
+void QueueInput(const InputEvent &event)
 {
-	program.SendUniformData(modelViewProjectionMatrix, "mvp");
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	inputRecorder.record(frameNumber, event);
+	inputQueue.push(event);
 }
 
-class RobotElement
+void RequestRedraw()
 {
-    public:
-        RobotElement()
-        {
-        }
-        ~RobotElement()
-        {
-        }
+	redrawRequested = true;
+}
 
-		void setScale(glm::vec3 s) {
-			scale = s;
-			originalScale = s;
-			selectedScale = {1.1f*s[0], 1.1f*s[1], 1.1f*s[2]};
-		}
+// Shader programs a draw key can name
+enum ProgramId
+{
+	ProgramParts,
+	ProgramImpostors
+};
+Program *programs[] = {&program, &impostorProgram};
 
-		void setParentTranslation(glm::vec3 t) {
-			moveToParentTranslation = t;
-		}
+// Vertex buffers a draw key can name, indexed by SceneNode::mesh. Plain meshes
+// are x, y, z, r, g, b per vertex, textured ones x, y, z, u, v.
+struct Mesh
+{
+	GLuint buffer;
+	GLsizei vertexCount;
+	bool textured;
+};
+std::vector<Mesh> meshes;
 
-		void setJointTranslation(glm::vec3 t) {
-			moveToJointTranslation = t;
-		}
+// mesh 0 is the cube, the other two are rewritten every frame
+enum MeshId
+{
+	MeshCube,
+	MeshMerged,
+	MeshBillboards
+};
 
-		void setRotation(glm::vec3 r) {
-			rotation = r;
-		}
+// Colour tint or texture of every material, indexed by SceneNode::material
+struct Material
+{
+	glm::vec3 tint;
+	GLuint texture;
+};
+std::vector<Material> materials;
 
-		void addChild(RobotElement* child) {
-			children.push_back(child);
-		}
+enum MaterialId
+{
+	MaterialVertexColor,
+	MaterialImpostorAtlas
+};
 
-		std::vector<RobotElement*> getChildren() {
-			return children;
-		}
+// Point the attributes of shader at an interleaved vertex buffer
+void BindMesh(const Mesh &mesh, Program &shader)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+	if (mesh.textured) {
+		GLint posID = glGetAttribLocation(shader.GetPID(), "position");
+		glEnableVertexAttribArray(posID);
+		glVertexAttribPointer(posID, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), 0);
+		GLint texID = glGetAttribLocation(shader.GetPID(), "texCoord");
+		glEnableVertexAttribArray(texID);
+		glVertexAttribPointer(texID, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+		return;
+	}
+	GLint posID = glGetAttribLocation(shader.GetPID(), "position");
+	glEnableVertexAttribArray(posID);
+	glVertexAttribPointer(posID, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
+	GLint colID = glGetAttribLocation(shader.GetPID(), "color");
+	glEnableVertexAttribArray(colID);
+	glVertexAttribPointer(colID, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
+}
 
-		void setParent(RobotElement* p) {
-			parent = p;
-		}
+// Issues the GL calls for a sorted render queue; the queue only asks for binds that change state
+struct GLSubmitter
+{
+	Program *shader = 0;
+	GLsizei vertexCount = 0;
+	// the views this pass draws into; more than one goes through the multiview program
+	const glm::mat4 *viewProjections = 0;
+	int views = 1;
 
-		RobotElement* getParent() {
-			return parent;
+	void bindProgram(unsigned int id)
+	{
+		shader = views > 1 ? &multiviewProgram : programs[id];
+		shader->Bind();
+		if (views > 1) {
+			shader->SendUniformData(viewProjections, views, "viewProjections");
+		} else {
+			shader->SendUniformData(viewProjections[0], "viewProjection");
+		}
+	}
+	void bindMesh(unsigned int id)
+	{
+		BindMesh(meshes[id], *shader);
+		vertexCount = meshes[id].vertexCount;
+	}
+	void bindMaterial(unsigned int id)
+	{
+		if (materials[id].texture) {
+			glBindTexture(GL_TEXTURE_2D, materials[id].texture);
+			shader->SendUniformData(0, "atlas");
+		} else {
+			shader->SendUniformData(materials[id].tint, "tint");
 		}
+	}
+	void draw(const RenderCommand &command)
+	{
+		shader->SendUniformData(command.model, "model");
+		if (views > 1) {
+			glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, views);
+		} else {
+			glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+		}
+	}
+};
+
+RenderQueue<RenderCommand> renderQueue;
 
-        // A member method for drawing itself and its children.
-        // takes modelViewProjectionMatrix (pass by reference *aka smart pointer*)
-        // update it by the trasnformation of each component
-        void Draw(MatrixStack &stack)
-        {
-			// copy top
-            modelViewProjectionMatrix.pushMatrix();
+// every part lives in the scene store, the robot is the subtree under robotTorso
+SceneHandle robotTorso = sceneNullHandle;
+std::vector<SceneHandle> traversalVector;
+int currentIndex = 0;
 
-			/** multiply top by M2A **/
-			modelViewProjectionMatrix.translate(moveToParentTranslation);
-			/** *** **/
+// With --crowd N the controlled robot is joined by N - 1 copies standing behind it.
+// robotRoots holds every robot's torso, the controlled one first.
+int crowdSize = 1;
+const float crowdSpacing = 6.0f;
+std::vector<SceneHandle> robotRoots;
 
-			/** multiply top by M1A **/
-			modelViewProjectionMatrix.rotateX(rotation[0]);
-            modelViewProjectionMatrix.rotateY(rotation[1]);
-            modelViewProjectionMatrix.rotateZ(rotation[2]);
-			/** *** **/
+// culling and draw recording run on worker threads, the GL thread only submits
+CommandRecorder commandRecorder;
+int renderThreads = 0;
 
-			/** multiply top by M*A **/
-			modelViewProjectionMatrix.pushMatrix();
-			modelViewProjectionMatrix.translate(moveToJointTranslation);
-			modelViewProjectionMatrix.scale(scale);
-			/** *** **/
+// the far plane moves out to take in a large crowd
+float farPlane = 100.0f;
 
-			// draw cube
-            DrawCube(modelViewProjectionMatrix.topMatrix());
+// Views (--views N): the orbit camera, then front, side and top cameras looking
+// at the same point. Every view draws the same recorded commands. With viewport
+// arrays they are drawn in one instanced pass, otherwise the sorted queue is
+// submitted once per view.
+struct View
+{
+	int x, y, width, height;
+};
+int viewCount = 1;
+View views[CommandRecorder::maxViews];
+glm::mat4 viewProjections[CommandRecorder::maxViews];
+bool layeredViews = false;
+
+// GPU time spent drawing the views, read back two frames late so it never stalls
+GLuint viewTimers[2] = {0, 0};
+bool viewTimerIssued[2] = {false, false};
+double viewGpuMilliseconds = 0.0;
+uint64_t viewTimedFrames = 0;
+
+// Split the window between the views and build each view's camera
+void LayoutViews(int width, int height)
+{
+	int columns = viewCount > 1 ? 2 : 1;
+	int rows = viewCount > 2 ? 2 : 1;
+	int viewWidth = width / columns;
+	int viewHeight = height / rows;
+
+	float distance = glm::length(eye - center);
+	glm::vec3 eyes[4] = {
+		eye,
+		center + glm::vec3(0.0f, 0.0f, distance),
+		center + glm::vec3(distance, 0.0f, 0.0f),
+		center + glm::vec3(0.0f, distance, 0.0f)
+	};
+	glm::vec3 ups[4] = {up, up, up, glm::vec3(0.0f, 0.0f, -1.0f)};
+
+	for (int v = 0; v < viewCount; v++) {
+		// the first row is at the top of the window
+		View &view = views[v];
+		view.x = (v % columns) * viewWidth;
+		view.y = height - (v / columns + 1) * viewHeight;
+		view.width = viewWidth;
+		view.height = viewHeight;
+
+		modelViewProjectionMatrix.loadIdentity();
+		modelViewProjectionMatrix.Perspective(glm::radians(60.0f), float(viewWidth) / float(viewHeight), 0.1f, farPlane);
+		modelViewProjectionMatrix.LookAt(eyes[v], center, ups[v]);
+		viewProjections[v] = modelViewProjectionMatrix.topMatrix();
+	}
+}
 
-			// pop M*A
-            modelViewProjectionMatrix.popMatrix();
+// Draw the sorted render queue into every view
+void SubmitViews(int width, int height)
+{
+	int timer = frameNumber & 1;
+	if (viewTimers[0]) {
+		GLint available = 0;
+		if (viewTimerIssued[timer]) {
+			glGetQueryObjectiv(viewTimers[timer], GL_QUERY_RESULT_AVAILABLE, &available);
+		}
+		if (available) {
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(viewTimers[timer], GL_QUERY_RESULT, &nanoseconds);
+			viewGpuMilliseconds += nanoseconds * 1e-6;
+			viewTimedFrames++;
+		}
+		glBeginQuery(GL_TIME_ELAPSED, viewTimers[timer]);
+	}
 
-			for (int i = 0; i < children.size(); i ++) {
-				children.at(i)->Draw(stack);
+	if (viewCount == 1 || layeredViews) {
+		if (viewCount > 1) {
+			GLfloat rectangles[4 * CommandRecorder::maxViews];
+			for (int v = 0; v < viewCount; v++) {
+				rectangles[4 * v + 0] = (GLfloat)views[v].x;
+				rectangles[4 * v + 1] = (GLfloat)views[v].y;
+				rectangles[4 * v + 2] = (GLfloat)views[v].width;
+				rectangles[4 * v + 3] = (GLfloat)views[v].height;
 			}
+			glViewportArrayv(0, viewCount, rectangles);
+		}
+		GLSubmitter submitter;
+		submitter.viewProjections = viewProjections;
+		submitter.views = viewCount;
+		renderQueue.submit(submitter);
+	} else {
+		for (int v = 0; v < viewCount; v++) {
+			glViewport(views[v].x, views[v].y, views[v].width, views[v].height);
+			GLSubmitter submitter;
+			submitter.viewProjections = &viewProjections[v];
+			// every view redraws the queue, but it is still one frame
+			renderQueue.submit(submitter, v > 0);
+		}
+	}
+	glViewport(0, 0, width, height);
 
-			// pop extra
-			modelViewProjectionMatrix.popMatrix();
+	if (viewTimers[0]) {
+		glEndQuery(GL_TIME_ELAPSED);
+		viewTimerIssued[timer] = true;
+	}
+}
 
-        }
+void PrintViewStats()
+{
+	if (viewCount == 1 && viewTimedFrames == 0) {
+		return;
+	}
+	std::cout << "Views: " << viewCount << (layeredViews || viewCount == 1 ? " drawn in one pass" : " drawn one pass each");
+	if (viewTimedFrames) {
+		std::cout << ", " << viewGpuMilliseconds / viewTimedFrames << " ms GPU time per frame";
+	}
+	std::cout << std::endl;
+}
 
-		// populate traversal vector
-		void populateTraversalVector(std::vector<RobotElement*> &traversalVector) {
-			// add element to the vector
-			traversalVector.push_back(this);
+// robots hidden behind nearer torsos are not drawn (--no-occlusion turns this off)
+OcclusionCuller occlusionCuller;
+bool occlusionEnabled = true;
+const int occlusionBufferWidth = 256;
+uint64_t occlusionFrames = 0;
+uint64_t occlusionTested = 0;
+uint64_t occlusionHidden = 0;
+double occlusionMilliseconds = 0.0;
+
+// world positions of every robot root in robotRoots order, bucketed for
+// neighbour queries; the occlusion culler picks its occluders through the grid
+std::vector<glm::vec3> robotPositions;
+SpatialGrid robotGrid;
+
+// follow the torsos once per frame, only robots that changed cell are re-bucketed
+void UpdateRobotGrid()
+{
+	for (size_t i = 0; i < robotRoots.size(); i++) {
+		robotPositions[i] = scene.getParentTranslation(robotRoots[i]);
+	}
+	robotGrid.update(robotPositions);
+}
 
-			// add children to the vector
-			for (int i = 0; i < children.size(); i++) {
-				children.at(i)->populateTraversalVector(traversalVector);
-			}
-		}
+// Add a part as the last child of parent
+SceneHandle AddPart(SceneHandle parent, const char *name, glm::vec3 scale, glm::vec3 jointTranslation, glm::vec3 rotation, glm::vec3 parentTranslation)
+{
+	SceneHandle part = scene.create(parent, name);
+	scene.setScale(part, scale);
+	scene.setJointTranslation(part, jointTranslation);
+	scene.setRotation(part, rotation);
+	scene.setParentTranslation(part, parentTranslation);
+	return part;
+}
 
-		// select function for traversal
-		void select()
-		{
-			scale = selectedScale;
-		}
+// Build one robot with its torso at position and return the torso
+SceneHandle ConstructRobot(glm::vec3 position)
+{
+	// torso
+	SceneHandle robotTorso = AddPart(sceneNullHandle, "Torso", {1.0f, 2.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, position);
 
-		// deselect function for traversal
-		void deselect()
-		{
-			scale = originalScale;
-		}
+	// left upper arm, left lower arm
+	SceneHandle robotLeftUpperArm = AddPart(robotTorso, "Left Upper Arm", {0.5, 1.0, 0.5}, {0.0f, -0.9f, 0.0f}, {0.0f, 0.0f, glm::radians(90.0f)}, {1.0f, 1.0f, 0.0f});
+	AddPart(robotLeftUpperArm, "Left Lower Arm", {0.25, 0.5, 0.25}, {0.0f, -0.4f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, -2.0f, 0.0f});
 
-		void setName(std::string s) {
-			elementName = s;
-		}
+	// right upper arm, right lower arm
+	SceneHandle robotRightUpperArm = AddPart(robotTorso, "Right Upper Arm", {0.5, 1.0, 0.5}, {0.0f, -0.9f, 0.0f}, {0.0f, 0.0f, glm::radians(-90.0f)}, {-1.0f, 1.0f, 0.0f});
+	AddPart(robotRightUpperArm, "Right Lower Arm", {0.25, 0.5, 0.25}, {0.0f, -0.4f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, -2.0f, 0.0f});
 
-		std::string getName() {
-			return elementName;
-		}
+	// left upper leg, left lower leg
+	SceneHandle robotLeftUpperLeg = AddPart(robotTorso, "Left Upper Leg", {0.5, 1.0, 0.5}, {0.0f, -0.9f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.6f, -2.0f, 0.0f});
+	AddPart(robotLeftUpperLeg, "Left Lower Leg", {0.25, 0.5, 0.25}, {0.0f, -0.4f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, -2.0f, 0.0f});
+
+	// right upper leg, right lower leg
+	SceneHandle robotRightUpperLeg = AddPart(robotTorso, "Right Upper Leg", {0.5, 1.0, 0.5}, {0.0f, -0.9f, 0.0f}, {0.0f, 0.0f, 0.0f}, {-0.6f, -2.0f, 0.0f});
+	AddPart(robotRightUpperLeg, "Right Lower Leg", {0.25, 0.5, 0.25}, {0.0f, -0.4f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, -2.0f, 0.0f});
+
+	// head
+	AddPart(robotTorso, "Head", {0.5, 0.5, 0.5}, {0.0f, 0.4f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 2.0f, 0.0f});
+
+	// register the robot with the neighbour grid
+	robotRoots.push_back(robotTorso);
+	robotPositions.push_back(position);
+
+	return robotTorso;
+}
 
-		void increaseRotation(char c) {
-			float newAngle = 0.0;
-			switch (c) {
+// Build the controlled robot at the origin and the rest of the crowd in rows behind it
+void ConstructScene(int robots)
+{
+	robotTorso = ConstructRobot(glm::vec3(0.0f));
 
-				// z-axis
-				case 'Z':
-					// increment z angle
-					newAngle = rotation[2] + glm::radians(5.0f);
-					
-					// update rotation
-					setRotation({rotation[0], rotation[1], newAngle});
-					break;
+	// construct the traversal vector
+	traversalVector.clear();
+	scene.traverse(robotTorso, traversalVector);
 
-				// y-axis
-				case 'Y':
-					// increment y angle
-					newAngle = rotation[1] + glm::radians(5.0f);
+	// select torso
+	scene.select(robotTorso);
 
-					// update rotation
-					setRotation({rotation[0], newAngle, rotation[2]});
-					break;
+	int columns = (int)std::ceil(std::sqrt((float)std::max(robots - 1, 1)));
+	for (int i = 0; i < robots - 1; i++) {
+		int row = i / columns;
+		int column = i % columns;
+		ConstructRobot({(column - columns / 2) * crowdSpacing, 0.0f, -(row + 1) * crowdSpacing});
+	}
+	farPlane = std::max(farPlane, 2.0f * columns * crowdSpacing);
 
-				case 'X':
-					// increment x angle
-					newAngle = rotation[0] + glm::radians(5.0f);
+	robotGrid.build(robotPositions);
+}
+
+// the X, Y and Z angle of every element in traversal order
+void GatherJointAngles(std::vector<float> &angles)
+{
+	angles.resize(traversalVector.size() * 3);
+	for (size_t i = 0; i < traversalVector.size(); i++) {
+		glm::vec3 rotation = scene.getRotation(traversalVector[i]);
+		angles[3 * i + 0] = rotation[0];
+		angles[3 * i + 1] = rotation[1];
+		angles[3 * i + 2] = rotation[2];
+	}
+}
 
-					// update rotation
-					setRotation({newAngle, rotation[1], rotation[2]});
-					break;
+// Time the SceneGraph traversal against the compile-time specialized
+// TenPartRobot, and check that both produce the same world transforms.
+void BenchmarkForwardKinematics()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int iterations = 2000000;
+
+	// the static table has the unselected scales
+	ConstructScene(1);
+	scene.deselect(robotTorso);
+	std::vector<float> angles;
+	GatherJointAngles(angles);
+
+	std::vector<glm::mat4> generic;
+	generic.reserve(TenPartRobot::partCount);
+	glm::mat4 specialized[TenPartRobot::partCount];
+
+	scene.computeWorldTransforms(robotTorso, glm::mat4(1.0f), generic);
+	StaticForwardKinematics<TenPartRobot>(&angles[0], specialized);
+	float maxError = 0.0f;
+	for (int i = 0; i < TenPartRobot::partCount; i++) {
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				maxError = std::max(maxError, std::abs(generic[i][c][r] - specialized[i][c][r]));
 			}
 		}
+	}
+
+	// nudge the torso every iteration and sum a result so neither loop is optimised away
+	float checksum = 0.0f;
+	Clock::time_point start = Clock::now();
+	for (int n = 0; n < iterations; n++) {
+		scene.setRotation(robotTorso, {0.0f, 0.0f, n * 1e-6f});
+		generic.clear();
+		scene.computeWorldTransforms(robotTorso, glm::mat4(1.0f), generic);
+		checksum += generic[2][3][0];
+	}
+	double genericNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	start = Clock::now();
+	for (int n = 0; n < iterations; n++) {
+		angles[2] = n * 1e-6f;
+		StaticForwardKinematics<TenPartRobot>(&angles[0], specialized);
+		checksum += specialized[2][3][0];
+	}
+	double specializedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	std::cout << "generic SceneGraph traversal\t" << genericNs << " ns/pose" << std::endl;
+	std::cout << "specialized TenPartRobot\t" << specializedNs << " ns/pose" << std::endl;
+	std::cout << "speedup\t" << genericNs / specializedNs << "x" << std::endl;
+	std::cout << "max difference\t" << maxError << " (checksum " << checksum << ")" << std::endl;
+}
 
-		void decreaseRotation(char c) {
-			float newAngle = 0.0;
-			switch (c) {
+// Record a crowd serially and with 1 to N worker threads, and check every
+// threaded recording matches the serial one command for command.
+void BenchmarkCommandRecording(int robots)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int iterations = 20;
+
+	ConstructScene(robots);
+
+	// look down the rows from above the controlled robot so part of the crowd is off screen
+	float depth = std::ceil(std::sqrt((float)robots)) * crowdSpacing;
+	glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 1000.0f) *
+		glm::lookAt(glm::vec3(0.0f, 30.0f, 20.0f), glm::vec3(0.0f, 0.0f, -0.5f * depth), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	CommandRecorder serial;
+	serial.setThreadCount(1);
+	serial.recordSerial(scene, robotRoots, viewProjection);
+	Clock::time_point start = Clock::now();
+	for (int n = 0; n < iterations; n++) {
+		serial.recordSerial(scene, robotRoots, viewProjection);
+	}
+	double serialMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+	const std::vector<RenderCommand> &reference = serial.chunk(0);
+
+	std::cout << robots << " robots, " << serial.visibleRobots() << " visible, " << reference.size() << " draws" << std::endl;
+	std::cout << "threads\trecord(ms)\tspeedup\tidentical" << std::endl;
+	std::cout << "serial\t" << serialMs << "\t1\t-" << std::endl;
+
+	int hardwareThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	for (int threads = 1; ; threads = std::min(threads * 2, hardwareThreads)) {
+		CommandRecorder recorder;
+		recorder.setThreadCount(threads);
+		recorder.record(scene, robotRoots, viewProjection);
+
+		start = Clock::now();
+		for (int n = 0; n < iterations; n++) {
+			recorder.record(scene, robotRoots, viewProjection);
+		}
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+
+		// the chunk lists laid end to end must be the serial list
+		bool identical = recorder.commandCount() == (int)reference.size();
+		size_t offset = 0;
+		for (int chunk = 0; identical && chunk < recorder.chunkCount(); chunk++) {
+			const std::vector<RenderCommand> &commands = recorder.chunk(chunk);
+			if (!commands.empty() && memcmp(&commands[0], &reference[offset], commands.size() * sizeof(RenderCommand)) != 0) {
+				identical = false;
+			}
+			offset += commands.size();
+		}
 
-				// z-axis
-				case 'z':
-					// increment z angle
-					newAngle = rotation[2] - glm::radians(5.0f);
-					
-					// update rotation
-					setRotation({rotation[0], rotation[1], newAngle});
-					break;
+		std::cout << threads << "\t" << ms << "\t" << serialMs / ms << "\t" << (identical ? "yes" : "NO") << std::endl;
+		if (threads == hardwareThreads) {
+			break;
+		}
+	}
+}
 
-				// y-axis
-				case 'y':
-					// increment y angle
-					newAngle = rotation[1] - glm::radians(5.0f);
+// Record a large crowd from near, mid and far cameras with and without levels
+// of detail, and report how robots split between them and what the GPU is sent.
+void BenchmarkLevelOfDetail(int robots)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int iterations = 10;
+
+	ConstructScene(robots);
+	float depth = std::ceil(std::sqrt((float)robots)) * crowdSpacing;
+	glm::vec3 crowdCenter(0.0f, 0.0f, -0.5f * depth);
+	glm::vec3 cameras[3] = {
+		glm::vec3(0.0f, 10.0f, 20.0f),
+		glm::vec3(0.0f, 0.25f * depth, 0.25f * depth),
+		glm::vec3(0.0f, depth, 0.5f * depth)
+	};
+	const char *cameraNames[3] = {"near", "mid", "far"};
+
+	std::cout << robots << " robots" << std::endl;
+	std::cout << "camera\tlod\tvisible\tfull\tmerged\timpostor\tdraws\tvertices\trecord(ms)" << std::endl;
+
+	for (int c = 0; c < 3; c++) {
+		glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 4.0f * depth) *
+			glm::lookAt(cameras[c], crowdCenter, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		for (int enabled = 0; enabled < 2; enabled++) {
+			CommandRecorder recorder;
+			recorder.setThreadCount(0);
+			LodSettings lod;
+			lod.enabled = enabled != 0;
+			lod.projectionScale = WINDOW_HEIGHT / (2.0f * std::tan(glm::radians(30.0f)));
+			recorder.setLodSettings(lod);
+			recorder.setEye(cameras[c]);
+			recorder.record(scene, robotRoots, viewProjection);
+
+			Clock::time_point start = Clock::now();
+			for (int n = 0; n < iterations; n++) {
+				recorder.record(scene, robotRoots, viewProjection);
+			}
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
 
-					// update rotation
-					setRotation({rotation[0], newAngle, rotation[2]});
-					break;
+			// every impostor is six billboard vertices, the merged stream and the billboards are one draw each
+			int impostors = recorder.robotsAtLod(LodImpostor);
+			int draws = recorder.commandCount() + (recorder.mergedVertexCount() > 0) + (impostors > 0);
+			long long vertices = (long long)recorder.commandCount() * cubeVertexCount + recorder.mergedVertexCount() + 6LL * impostors;
 
-				case 'x':
-					// increment x angle
-					newAngle = rotation[0] - glm::radians(5.0f);
+			std::cout << cameraNames[c] << "\t" << (enabled ? "on" : "off") << "\t" << recorder.visibleRobots() << "\t"
+				<< recorder.robotsAtLod(LodFull) << "\t" << recorder.robotsAtLod(LodMerged) << "\t" << impostors << "\t"
+				<< draws << "\t" << vertices << "\t" << ms << std::endl;
+		}
+	}
+}
 
-					// update rotation
-					setRotation({newAngle, rotation[1], rotation[2]});
-					break;
+// Record a crowd for one to four views, once with forward kinematics shared
+// between the views and once recording each view on its own.
+void BenchmarkViews(int robots)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	const int iterations = 10;
+
+	ConstructScene(robots);
+	float depth = std::ceil(std::sqrt((float)robots)) * crowdSpacing;
+	center = glm::vec3(0.0f, 0.0f, -0.25f * depth);
+	eye = center + glm::vec3(0.0f, 0.1f * depth, 0.5f * depth);
+
+	// impostors are only used with a single view, leave them out so every row compares the same work
+	CommandRecorder recorder;
+	recorder.setThreadCount(0);
+	LodSettings lod;
+	lod.impostorPixels = 0.0f;
+	recorder.setLodSettings(lod);
+
+	std::cout << robots << " robots" << std::endl;
+	std::cout << "views\tvisible\tdraws\tshared(ms)\tper view(ms)\tadded view(ms)" << std::endl;
+
+	double oneView = 0.0;
+	for (int n = 1; n <= CommandRecorder::maxViews; n++) {
+		viewCount = n;
+		LayoutViews(WINDOW_WIDTH, WINDOW_HEIGHT);
+		recorder.record(scene, robotRoots, viewProjections, n);
+
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < iterations; i++) {
+			recorder.record(scene, robotRoots, viewProjections, n);
+		}
+		double shared = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+		int visible = recorder.visibleRobots();
+		int draws = recorder.commandCount();
+
+		start = Clock::now();
+		for (int i = 0; i < iterations; i++) {
+			for (int v = 0; v < n; v++) {
+				recorder.record(scene, robotRoots, viewProjections[v]);
 			}
 		}
+		double separate = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+
+		if (n == 1) {
+			oneView = shared;
+		}
+		std::cout << n << "\t" << visible << "\t" << draws << "\t" << shared << "\t" << separate << "\t"
+			<< (n > 1 ? (shared - oneView) / (n - 1) : 0.0) << std::endl;
+	}
+	viewCount = 1;
+}
 
-    private:
-        // child element(s)
-        std::vector<RobotElement*> children;
+// rotate the torso 5 degrees every half second, 20 times
+void startAnimation() {
+	animationStepsLeft = 20;
+	nextAnimationStep = CurrentTime();
+}
+
+// advance the animation by however many steps are due, called once per loop iteration
+void UpdateAnimation() {
+	if (!animationOn) {
+		return;
+	}
 
-		// parent element
-		RobotElement* parent = nullptr;
+	double now = CurrentTime();
+	while (animationStepsLeft > 0 && now >= nextAnimationStep) {
+		scene.addRotation(robotTorso, {0.0f, 0.0f, glm::radians(5.0f)});
+		animationStepsLeft--;
+		nextAnimationStep += 0.5;
+		RequestRedraw();
+	}
 
-        // translation of this component’s joint with respect to the parent component’s joint
-        glm::vec3 moveToParentTranslation{0.0f, 0.0f, 0.0f};
+	if (animationStepsLeft == 0) {
+		animationOn = false;
+	}
+}
 
-        // the current joint angles about the X, Y, and Z axes of the component’s joint.
-        // (You may want to start with Z-rotations only.) ??? why 
-        glm::vec3 rotation{0.0f, 0.0f, 0.0f};
+// Crowd animation (--animate): every robot but the controlled one walks, idles
+// on an additive layer, and every third one waves with its right arm. Poses
+// come from the animation engine and are written into the scene every frame.
+AnimationEngine animationEngine;
+bool crowdAnimation = false;
+// the parts of every animated robot in traversal order, partsPerRobot at a time
+std::vector<SceneHandle> animatedParts;
+double lastCrowdAnimation = -1.0;
+double crowdAnimationSeconds = 0.0;
+uint64_t crowdAnimationFrames = 0;
+
+// first channel of the named part, parts have three channels in traversal order
+int PartChannel(const char *name)
+{
+	for (size_t i = 0; i < traversalVector.size(); i++) {
+		if (strcmp(scene.getName(traversalVector[i]), name) == 0) {
+			return 3 * (int)i;
+		}
+	}
+	return -1;
+}
 
-        // translation of the component with respect to its joint.
-        glm::vec3 moveToJointTranslation{0.0f, 0.0f, 0.0f};
+// Sample the walk, wave and idle clips of the robot at 30 Hz, starting from its rest pose
+void BuildCrowdClips(int &walk, int &wave, int &idle, int &rightArm)
+{
+	const float rate = 30.0f;
+	const float twoPi = 6.28318531f;
+	std::vector<float> rest;
+	GatherJointAngles(rest);
+	int channels = (int)rest.size();
+	animationEngine.setChannelCount(channels);
+	animationEngine.setRestPose(&rest[0]);
+
+	int torso = PartChannel("Torso"), head = PartChannel("Head");
+	int leftArm = PartChannel("Left Upper Arm"), rightUpperArm = PartChannel("Right Upper Arm");
+	int rightLowerArm = PartChannel("Right Lower Arm");
+	int leftLeg = PartChannel("Left Upper Leg"), leftKnee = PartChannel("Left Lower Leg");
+	int rightLeg = PartChannel("Right Upper Leg"), rightKnee = PartChannel("Right Lower Leg");
+
+	// one second stride: legs swing about X, the knees bend on the way forward, the arms swing against the legs
+	std::vector<float> frames;
+	for (int f = 0; f < 30; f++) {
+		float phase = twoPi * f / 30.0f;
+		frames.insert(frames.end(), rest.begin(), rest.end());
+		float *pose = &frames[frames.size() - channels];
+		pose[leftLeg] += 0.5f * std::sin(phase);
+		pose[rightLeg] -= 0.5f * std::sin(phase);
+		pose[leftKnee] += 0.4f * std::max(-std::cos(phase), 0.0f);
+		pose[rightKnee] += 0.4f * std::max(std::cos(phase), 0.0f);
+		pose[leftArm + 1] -= 0.4f * std::sin(phase);
+		pose[rightUpperArm + 1] -= 0.4f * std::sin(phase);
+	}
+	walk = animationEngine.addClip(&frames[0], 30, rate);
+
+	// right arm raised above the shoulder, the forearm waving twice a second
+	frames.clear();
+	for (int f = 0; f < 15; f++) {
+		frames.insert(frames.end(), rest.begin(), rest.end());
+		float *pose = &frames[frames.size() - channels];
+		pose[rightUpperArm + 2] = glm::radians(-150.0f);
+		pose[rightLowerArm + 2] = 0.6f * std::sin(twoPi * f / 15.0f);
+	}
+	wave = animationEngine.addClip(&frames[0], 15, rate);
+
+	// two second sway of the torso and nod of the head, added on top
+	frames.clear();
+	for (int f = 0; f < 60; f++) {
+		float phase = twoPi * f / 60.0f;
+		frames.insert(frames.end(), rest.begin(), rest.end());
+		float *pose = &frames[frames.size() - channels];
+		pose[torso + 1] += 0.15f * std::sin(phase);
+		pose[head] += 0.1f * std::sin(2.0f * phase);
+	}
+	idle = animationEngine.addClip(&frames[0], 60, rate, true);
 
-        // the X, Y, and Z scaling factors for the component.
-        glm::vec3 scale{0.0f, 0.0f, 0.0f};
+	std::vector<float> weights(channels, 0.0f);
+	for (int c = 0; c < 3; c++) {
+		weights[rightUpperArm + c] = 1.0f;
+		weights[rightLowerArm + c] = 1.0f;
+	}
+	rightArm = animationEngine.addMask(&weights[0]);
+}
 
-		glm::vec3 originalScale{0.0f, 0.0f, 0.0f};
+void StartCrowdAnimation()
+{
+	int walk, wave, idle, rightArm;
+	BuildCrowdClips(walk, wave, idle, rightArm);
+	animationEngine.setThreadCount(renderThreads);
+
+	animatedParts.clear();
+	std::vector<SceneHandle> parts;
+	for (size_t robot = 1; robot < robotRoots.size(); robot++) {
+		parts.clear();
+		scene.traverse(robotRoots[robot], parts);
+		animatedParts.insert(animatedParts.end(), parts.begin(), parts.end());
+
+		// spread the robots over the cycle so they do not march in step
+		int instance = animationEngine.addInstance();
+		AnimationLayer layer;
+		layer.clip = walk;
+		layer.time = (robot * 7 % 30) / 30.0f;
+		layer.speed = 0.8f + 0.05f * (robot % 9);
+		animationEngine.setLayer(instance, 0, layer);
+
+		layer.clip = wave;
+		layer.mask = rightArm;
+		layer.speed = 1.0f;
+		layer.weight = robot % 3 == 0 ? 1.0f : 0.0f;
+		animationEngine.setLayer(instance, 1, layer);
+
+		layer.clip = idle;
+		layer.mask = 0;
+		layer.weight = 1.0f;
+		layer.time = (robot % 60) / 30.0f;
+		animationEngine.setLayer(instance, 2, layer);
+	}
+}
 
-		glm::vec3 selectedScale{0.0f, 0.0f, 0.0f};
+// Blend every animated robot's pose for this frame and write it into its parts
+void UpdateCrowdAnimation()
+{
+	if (!crowdAnimation || animationEngine.instanceCount() == 0) {
+		return;
+	}
 
-		std::string elementName = "";
+	double now = CurrentTime();
+	float seconds = lastCrowdAnimation < 0.0 ? 0.0f : (float)(now - lastCrowdAnimation);
+	lastCrowdAnimation = now;
 
-};
-// create the root element globally
-RobotElement* robotTorso = new RobotElement();
-std::vector<RobotElement*> traversalVector;
-int currentIndex = 0;
+	double start = glfwGetTime();
+	animationEngine.evaluate(seconds);
 
-void ConstructRobot()
-{
-	// left lower arm
-	RobotElement* robotLeftLowerArm = new RobotElement();
-	glm::vec3 scale{0.25, 0.5, 0.25};
-	glm::vec3 jointTranslation{0.0f, -0.4f, 0.0f};
-	glm::vec3 rotation{0.0f, 0.0f, 0.0f};
-	glm::vec3 parentTranslation{0.0f, -2.0f, 0.0f};
-	robotLeftLowerArm->setScale(scale);
-	robotLeftLowerArm->setJointTranslation(jointTranslation);
-	robotLeftLowerArm->setRotation(rotation);
-	robotLeftLowerArm->setParentTranslation(parentTranslation);
-	robotLeftLowerArm->setName("Left Lower Arm");
-
-	// left upper arm
-	RobotElement* robotLeftUpperArm = new RobotElement();
-	robotLeftLowerArm->setParent(robotLeftUpperArm);
-	scale = {0.5, 1.0, 0.5};
-	jointTranslation = {0.0f, -0.9f, 0.0f};
-	rotation = {0.0f, 0.0f, glm::radians(90.0f)};
-	parentTranslation = {1.0f, 1.0f, 0.0f};
-	robotLeftUpperArm->setScale(scale);
-	robotLeftUpperArm->setJointTranslation(jointTranslation);
-	robotLeftUpperArm->setRotation(rotation);
-	robotLeftUpperArm->setParentTranslation(parentTranslation);
-	robotLeftUpperArm->addChild(robotLeftLowerArm);
-	robotLeftUpperArm->setName("Left Upper Arm");
-	robotLeftUpperArm->setParent(robotTorso);
-
-	// left lower leg
-	RobotElement* robotLeftLowerLeg = new RobotElement();
-	scale = {0.25, 0.5, 0.25};
-	jointTranslation = {0.0f, -0.4f, 0.0f};
-	rotation = {0.0f, 0.0f, 0.0f};
-	parentTranslation = {0.0f, -2.0f, 0.0f};
-	robotLeftLowerLeg->setScale(scale);
-	robotLeftLowerLeg->setJointTranslation(jointTranslation);
-	robotLeftLowerLeg->setRotation(rotation);
-	robotLeftLowerLeg->setParentTranslation(parentTranslation);
-	robotLeftLowerLeg->setName("Left Lower Leg");
-
-	// left upper leg
-	RobotElement* robotLeftUpperLeg = new RobotElement();
-	robotLeftLowerLeg->setParent(robotLeftUpperLeg);
-	scale = {0.5, 1.0, 0.5};
-	jointTranslation = {0.0f, -0.9f, 0.0f};
-	rotation = {0.0f, 0.0f, 0.0f};
-	parentTranslation = {0.6f, -2.0f, 0.0f};
-	robotLeftUpperLeg->setScale(scale);
-	robotLeftUpperLeg->setJointTranslation(jointTranslation);
-	robotLeftUpperLeg->setRotation(rotation);
-	robotLeftUpperLeg->setParentTranslation(parentTranslation);
-	robotLeftUpperLeg->addChild(robotLeftLowerLeg);
-	robotLeftUpperLeg->setName("Left Upper Leg");
-	robotLeftUpperLeg->setParent(robotTorso);
-
-	// right lower arm
-	RobotElement* robotRightLowerArm = new RobotElement();
-	scale = {0.25, 0.5, 0.25};
-	jointTranslation = {0.0f, -0.4f, 0.0f};
-	rotation = {0.0f, 0.0f, 0.0f};
-	parentTranslation = {0.0f, -2.0f, 0.0f};
-	robotRightLowerArm->setScale(scale);
-	robotRightLowerArm->setJointTranslation(jointTranslation);
-	robotRightLowerArm->setRotation(rotation);
-	robotRightLowerArm->setParentTranslation(parentTranslation);
-	robotRightLowerArm->setName("Right Lower Arm");
-
-	// right upper arm
-	RobotElement* robotRightUpperArm = new RobotElement();
-	robotRightLowerArm->setParent(robotRightUpperArm);
-	scale = {0.5, 1.0, 0.5};
-	jointTranslation = {0.0f, -0.9f, 0.0f};
-	rotation = {0.0f, 0.0f, glm::radians(-90.0f)};
-	parentTranslation = {-1.0f, 1.0f, 0.0f};
-	robotRightUpperArm->setScale(scale);
-	robotRightUpperArm->setJointTranslation(jointTranslation);
-	robotRightUpperArm->setRotation(rotation);
-	robotRightUpperArm->setParentTranslation(parentTranslation);
-	robotRightUpperArm->addChild(robotRightLowerArm);
-	robotRightUpperArm->setName("Right Upper Arm");
-	robotRightUpperArm->setParent(robotTorso);
-	
-
-	// right lower leg
-	RobotElement* robotRightLowerLeg = new RobotElement();
-	scale = {0.25, 0.5, 0.25};
-	jointTranslation = {0.0f, -0.4f, 0.0f};
-	rotation = {0.0f, 0.0f, 0.0f};
-	parentTranslation = {0.0f, -2.0f, 0.0f};
-	robotRightLowerLeg->setScale(scale);
-	robotRightLowerLeg->setJointTranslation(jointTranslation);
-	robotRightLowerLeg->setRotation(rotation);
-	robotRightLowerLeg->setParentTranslation(parentTranslation);
-	robotRightLowerLeg->setName("Right Lower Leg");
-
-	// right upper leg
-	RobotElement* robotRightUpperLeg = new RobotElement();
-	robotRightLowerLeg->setParent(robotRightUpperLeg);
-	scale = {0.5, 1.0, 0.5};
-	jointTranslation = {0.0f, -0.9f, 0.0f};
-	rotation = {0.0f, 0.0f, 0.0f};
-	parentTranslation = {-0.6f, -2.0f, 0.0f};
-	robotRightUpperLeg->setScale(scale);
-	robotRightUpperLeg->setJointTranslation(jointTranslation);
-	robotRightUpperLeg->setRotation(rotation);
-	robotRightUpperLeg->setParentTranslation(parentTranslation);
-	robotRightUpperLeg->addChild(robotRightLowerLeg);
-	robotRightUpperLeg->setName("Right Upper Leg");
-	robotRightUpperLeg->setParent(robotTorso);
+	int partsPerRobot = (int)traversalVector.size();
+	for (int instance = 0; instance < animationEngine.instanceCount(); instance++) {
+		const float *pose = animationEngine.pose(instance);
+		const SceneHandle *parts = &animatedParts[(size_t)instance * partsPerRobot];
+		for (int p = 0; p < partsPerRobot; p++) {
+			scene.setRotation(parts[p], {pose[3 * p + 0], pose[3 * p + 1], pose[3 * p + 2]});
+		}
+	}
+	crowdAnimationSeconds += glfwGetTime() - start;
+	crowdAnimationFrames++;
+}
 
-	// head
-	RobotElement* robotHead = new RobotElement();
-	scale = {0.5, 0.5, 0.5};
-	jointTranslation = {0.0f, 0.4f, 0.0f};
-	rotation = {0.0f, 0.0f, 0.0f};
-	parentTranslation = {0.0f, 2.0f, 0.0f};
-	robotHead->setScale(scale);
-	robotHead->setJointTranslation(jointTranslation);
-	robotHead->setRotation(rotation);
-	robotHead->setParentTranslation(parentTranslation);
-	robotHead->setName("Head");
-	robotHead->setParent(robotTorso);
+void PrintCrowdAnimationStats()
+{
+	if (crowdAnimationFrames == 0 || crowdAnimationSeconds <= 0.0) {
+		return;
+	}
+	std::cout << "Crowd animation: " << animationEngine.instanceCount() << " robots, "
+		<< 1000.0 * crowdAnimationSeconds / crowdAnimationFrames << " ms per frame, "
+		<< animationEngine.instanceCount() * crowdAnimationFrames / crowdAnimationSeconds << " poses per second" << std::endl;
+}
 
-	// torso
-	scale = {1.0f, 2.0f, 1.0f};
-	robotTorso->setScale(scale);
-	robotTorso->addChild(robotLeftUpperArm);
-	robotTorso->addChild(robotRightUpperArm);
-	robotTorso->addChild(robotLeftUpperLeg);
-	robotTorso->addChild(robotRightUpperLeg);
-	robotTorso->addChild(robotHead);
-	robotTorso->setName("Torso");
+// Level of detail: mid-distance robots share one stream of pre-transformed
+// parts, far robots are billboards of pictures cached in the impostor atlas.
+ImpostorAtlas impostorAtlas;
+const int impostorDrawsPerFrame = 32;
+std::vector<float> billboardVertices;
+std::vector<glm::mat4> impostorParts;
+RenderCommand mergedCommand;
+RenderCommand billboardCommand;
+bool lodEnabled = true;
+uint64_t lodFrames = 0;
+uint64_t lodRobots[LodCount] = {};
+
+// Replace the contents of a per-frame vertex stream
+void UploadMergedVertices()
+{
+	Mesh &mesh = meshes[MeshMerged];
+	mesh.vertexCount = commandRecorder.mergedVertexCount();
+	if (mesh.vertexCount == 0) {
+		return;
+	}
 
-	// construct the traversal vector
-	robotTorso->populateTraversalVector(traversalVector);
-	
-	// select torso
-	robotTorso->select();
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * 6 * sizeof(float), 0, GL_STREAM_DRAW);
+	size_t offset = 0;
+	for (int chunk = 0; chunk < commandRecorder.chunkCount(); chunk++) {
+		const std::vector<float> &vertices = commandRecorder.mergedVertices(chunk);
+		if (!vertices.empty()) {
+			glBufferSubData(GL_ARRAY_BUFFER, offset, vertices.size() * sizeof(float), &vertices[0]);
+			offset += vertices.size() * sizeof(float);
+		}
+	}
 }
 
-void startAnimation() {
-	std::chrono::milliseconds timespan(500); // or whatever
-	for(int i = 0; i < 20; i ++) {
-		// start timer
+// Draw a far robot into an atlas cell, seen from the side its key names, with its root at the origin
+void DrawImpostor(int cell, const ImpostorRequest &request, int width, int height)
+{
+	float radius = commandRecorder.getBoundingRadius();
+	float azimuth = (request.key & 0xff) * 6.28318531f / commandRecorder.getLodSettings().impostorDirections;
+	glm::vec3 from(std::sin(azimuth), 0.0f, std::cos(azimuth));
+	glm::mat4 viewProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius) *
+		glm::lookAt(from * radius, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-		// for (int i = 0; i < robotTorso->getChildren().size(); i ++ ) {
-			// leg angle = 90sin(0.5 * glfwGetTime())
+	impostorParts.clear();
+	scene.computeWorldTransforms(robotRoots[request.robot], glm::translate(glm::mat4(1.0f), -request.position), impostorParts);
 
-			// increment z angle
-			// float newAngle = 90*sin(0.5 * glfwGetTime());
-			// std::cout << "angle: " << newAngle << std::endl;
-			
-			// update rotation
-			// robotTorso->setRotation({0.0f, 0.0f, glm::radians(newAngle)});
-			// robotTorso->Draw(modelViewProjectionMatrix);
+	impostorAtlas.beginDrawing(cell);
+	program.Bind();
+	BindMesh(meshes[MeshCube], program);
+	program.SendUniformData(materials[MaterialVertexColor].tint, "tint");
+	program.SendUniformData(viewProjection, "viewProjection");
+	for (size_t i = 0; i < impostorParts.size(); i++) {
+		program.SendUniformData(impostorParts[i], "model");
+		glDrawArrays(GL_TRIANGLES, 0, meshes[MeshCube].vertexCount);
+	}
+	impostorAtlas.endDrawing(width, height);
+}
 
-			robotTorso->increaseRotation('Z');
+// Find or draw the picture of every far robot and stream a camera facing quad for each
+void UploadBillboards(int width, int height)
+{
+	const float corners[6][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, -1}, {1, 1}, {-1, 1}};
+	float radius = commandRecorder.getBoundingRadius();
+	int drawsLeft = impostorDrawsPerFrame;
+
+	billboardVertices.clear();
+	for (int chunk = 0; chunk < commandRecorder.chunkCount(); chunk++) {
+		const std::vector<ImpostorRequest> &requests = commandRecorder.impostors(chunk);
+		for (size_t i = 0; i < requests.size(); i++) {
+			const ImpostorRequest &request = requests[i];
+
+			// new pictures are spread over frames, a robot without one shows up once it is drawn
+			int cell = impostorAtlas.find(request.key, frameNumber);
+			if (cell < 0 && drawsLeft > 0) {
+				cell = impostorAtlas.allocate(request.key, frameNumber);
+				if (cell >= 0) {
+					DrawImpostor(cell, request, width, height);
+					drawsLeft--;
+				}
+			}
+			if (cell < 0) {
+				continue;
+			}
 
-			std::this_thread::sleep_for(timespan);
-		// }
+			// upright quad turned towards the camera
+			glm::vec3 toEye = eye - request.position;
+			toEye.y = 0.0f;
+			glm::vec3 right(radius, 0.0f, 0.0f);
+			if (glm::dot(toEye, toEye) > 1e-6f) {
+				right = glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), toEye)) * radius;
+			}
+			glm::vec3 upward(0.0f, radius, 0.0f);
+			glm::vec4 uv = impostorAtlas.cellTexCoords(cell);
+
+			for (int c = 0; c < 6; c++) {
+				glm::vec3 corner = request.position + right * corners[c][0] + upward * corners[c][1];
+				billboardVertices.push_back(corner.x);
+				billboardVertices.push_back(corner.y);
+				billboardVertices.push_back(corner.z);
+				billboardVertices.push_back(corners[c][0] < 0 ? uv.x : uv.z);
+				billboardVertices.push_back(corners[c][1] < 0 ? uv.y : uv.w);
+			}
+		}
 	}
 
+	Mesh &mesh = meshes[MeshBillboards];
+	mesh.vertexCount = (GLsizei)(billboardVertices.size() / 5);
+	if (mesh.vertexCount > 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.buffer);
+		glBufferData(GL_ARRAY_BUFFER, billboardVertices.size() * sizeof(float), &billboardVertices[0], GL_STREAM_DRAW);
+	}
 }
 
 void Display()
 {	
-	program.Bind();
-
-	modelViewProjectionMatrix.loadIdentity();
+	// the render queue binds the program with the first draw
 	modelViewProjectionMatrix.pushMatrix();
 
-	// Setting the view and Projection matrices
+	// Setting the view and Projection matrices of every view
 	int width, height;
 	glfwGetFramebufferSize(window, &width, &height);
-	modelViewProjectionMatrix.Perspective(glm::radians(60.0f), float(width) / float(height), 0.1f, 100.0f);
-	modelViewProjectionMatrix.LookAt(eye, center, up);
-	
-	robotTorso->Draw(modelViewProjectionMatrix);
+	LayoutViews(width, height);
+
+	// robot sizes on screen follow the view height
+	LodSettings lod = commandRecorder.getLodSettings();
+	lod.projectionScale = views[0].height / (2.0f * std::tan(glm::radians(30.0f)));
+	commandRecorder.setLodSettings(lod);
+	commandRecorder.setEye(eye);
+
+	// cull and record on the workers once for all views, then sort by draw key and submit here
+	UpdateRobotGrid();
+	commandRecorder.record(scene, robotRoots, viewProjections, viewCount);
+	renderQueue.clear();
+	for (int chunk = 0; chunk < commandRecorder.chunkCount(); chunk++) {
+		const std::vector<RenderCommand> &commands = commandRecorder.chunk(chunk);
+		for (size_t i = 0; i < commands.size(); i++) {
+			renderQueue.push(commands[i].key, &commands[i]);
+		}
+	}
+
+	// the merged and billboard streams are already in world space, one draw each
+	UploadMergedVertices();
+	if (meshes[MeshMerged].vertexCount > 0) {
+		mergedCommand.key = MakeDrawKey(ProgramParts, MeshMerged, MaterialVertexColor, 0.0f);
+		mergedCommand.model = glm::mat4(1.0f);
+		renderQueue.push(mergedCommand.key, &mergedCommand);
+	}
+	UploadBillboards(width, height);
+	if (meshes[MeshBillboards].vertexCount > 0) {
+		billboardCommand.key = MakeDrawKey(ProgramImpostors, MeshBillboards, MaterialImpostorAtlas, 0.0f);
+		billboardCommand.model = glm::mat4(1.0f);
+		renderQueue.push(billboardCommand.key, &billboardCommand);
+	}
+
+	renderQueue.sort();
+	SubmitViews(width, height);
 	modelViewProjectionMatrix.popMatrix();
 
+	glBindTexture(GL_TEXTURE_2D, 0);
 	program.Unbind();
-	
-}
 
-// Scroll callback function
-void ScrollCallback(GLFWwindow* lwindow, double xoffset, double yoffset)
-{
-	// ignore xoffset since we are only responding to normal scrolling
+	for (int level = 0; level < LodCount; level++) {
+		lodRobots[level] += commandRecorder.robotsAtLod((RobotLod)level);
+	}
+	lodFrames++;
 
-	// calculate the vector centerToEye
-	glm::vec3 centerToEye = eye - center;
+	if (occlusionEnabled) {
+		occlusionTested += commandRecorder.visibleRobots() + commandRecorder.occludedRobots();
+		occlusionHidden += commandRecorder.occludedRobots();
+		occlusionMilliseconds += occlusionCuller.prepareMilliseconds();
+		occlusionFrames++;
+	}
+}
 
-	// if scroll down
-	if (yoffset < 0) {
-		// zoom out
-		centerToEye = centerToEye * 1.05f; // scale centerToEye
-		eye = center + centerToEye; // update camera position
-	} else {
-		// zoom in
-		centerToEye = centerToEye / 1.05f; // scale centerToEye
-		eye = center + centerToEye; // update camera position
+void PrintLodStats()
+{
+	if (lodFrames == 0) {
+		return;
 	}
+	std::cout << "Robots per frame: " << (double)lodRobots[LodFull] / lodFrames << " full, "
+		<< (double)lodRobots[LodMerged] / lodFrames << " merged, "
+		<< (double)lodRobots[LodImpostor] / lodFrames << " impostor; "
+		<< impostorAtlas.getDraws() << " impostors drawn, " << impostorAtlas.getEvictions() << " evicted" << std::endl;
 }
 
+void PrintOcclusionStats()
+{
+	if (occlusionFrames == 0) {
+		return;
+	}
+	std::cout << "Occlusion culling: " << (occlusionTested ? 100.0 * occlusionHidden / occlusionTested : 0.0)
+		<< "% of robots in the frustum hidden, " << occlusionMilliseconds / occlusionFrames << " ms rasterizing occluders per frame" << std::endl;
+}
 
-// Mouse callback function
-void MouseCallback(GLFWwindow* lWindow, int button, int action, int mods)
+// Zoom the camera by 5% per scroll tick
+void ApplyZoom(int zoomInSteps, int zoomOutSteps)
 {
+	// calculate the vector centerToEye
+	glm::vec3 centerToEye = eye - center;
 
+	// scale centerToEye once by the net number of ticks
+	centerToEye = centerToEye * std::pow(1.05f, (float)(zoomOutSteps - zoomInSteps));
+	eye = center + centerToEye; // update camera position
 }
 
-// store previous mouse positions
-glm::vec2 prevCursorPosition = {0.0f, 0.0f};
-
-// Mouse position callback function
-void CursorPositionCallback(GLFWwindow* lWindow, double xpos, double ypos)
+// Orbit and pan the camera by the cursor movement accumulated over a frame
+void ApplyCursorDelta(glm::vec2 orbitDelta, glm::vec2 panDelta)
 {
-	// get new cursor position
-	glm::vec2 currentCursorPosition = {(float) xpos, (float) ypos};
-
-	// get cursor position delta
-	glm::vec2 cursorPositionDelta = prevCursorPosition - currentCursorPosition;
-	
-	int l_state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-	if (l_state == GLFW_PRESS) {
+	if (orbitDelta.x != 0.0f || orbitDelta.y != 0.0f) {
 
 		// calculate the vector centerToEye
 		glm::vec3 centerToEye = eye - center;
 
 		// calculate horizontal rotation
 		glm::mat4 horizontal_identity_matrix(1.0f);
-		glm::mat3 horizontal_rotation = glm::mat3(glm::rotate(horizontal_identity_matrix, cursorPositionDelta.x * (0.05f), up));
+		glm::mat3 horizontal_rotation = glm::mat3(glm::rotate(horizontal_identity_matrix, orbitDelta.x * (0.05f), up));
 
 		// calculate vertical rotation
 		glm::mat4 vertical_identity_matrix(1.0f);
 		glm::vec3 right = glm::cross(eye, up); // calculate right matrix for the vertical rotation
-		glm::mat3 vertical_rotation = glm::mat3(glm::rotate(vertical_identity_matrix, cursorPositionDelta.y * (0.05f), right));
+		glm::mat3 vertical_rotation = glm::mat3(glm::rotate(vertical_identity_matrix, orbitDelta.y * (0.05f), right));
 
 		// update the new centerToEye vector with new rotations (wrt origin)
 		centerToEye = vertical_rotation * horizontal_rotation * centerToEye;
@@ -493,199 +1068,864 @@ void CursorPositionCallback(GLFWwindow* lWindow, double xpos, double ypos)
 		up = vertical_rotation * up;
 	}
 
-	int r_state = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT);
-	if (r_state == GLFW_PRESS) {
-		eye = {eye[0] - cursorPositionDelta.x * (0.05f), eye[1] + cursorPositionDelta.y * (0.05f), eye[2]};
-		center = {center[0] - cursorPositionDelta.x * (0.05f), center[1] + cursorPositionDelta.y * (0.05f), center[2]};
+	if (panDelta.x != 0.0f || panDelta.y != 0.0f) {
+		eye = {eye[0] - panDelta.x * (0.05f), eye[1] + panDelta.y * (0.05f), eye[2]};
+		center = {center[0] - panDelta.x * (0.05f), center[1] + panDelta.y * (0.05f), center[2]};
+	}
+}
+
+// Pose tracks hold the three joint angles of every element in traversal order.
+PoseTrackWriter poseWriter;
+PoseTrackReader posePlayer;
+float poseSampleRate = 240.0f;
+double nextPoseSample = 0.0;
+double posePlaybackOffset = 0.0;
+std::vector<float> poseValues;
+
+// append a sample for every tick of the pose clock that has passed; the pose only
+// changes when input or animation is applied, so call this before applying them
+void RecordPoseSamples()
+{
+	if (!poseWriter.isOpen()) {
+		return;
+	}
+
+	double now = CurrentTime();
+	if (nextPoseSample > now) {
+		return;
+	}
+
+	GatherJointAngles(poseValues);
+	while (nextPoseSample <= now) {
+		poseWriter.append(&poseValues[0]);
+		nextPoseSample += 1.0 / poseSampleRate;
 	}
+}
 
-	// update prev cursor position
-	prevCursorPosition = currentCursorPosition;
+// set every joint from the playing pose track, looping over the recording
+void ApplyPosePlayback()
+{
+	if (!posePlayer.isOpen()) {
+		return;
+	}
+
+	poseValues.resize(posePlayer.getChannelCount());
+	posePlayer.sampleAt(CurrentTime() + posePlaybackOffset, true, &poseValues[0]);
+	for (size_t i = 0; i < traversalVector.size(); i++) {
+		scene.setRotation(traversalVector[i], {poseValues[3 * i + 0], poseValues[3 * i + 1], poseValues[3 * i + 2]});
+	}
 }
 
+// External controllers drive joints through shared memory (--joint-server)
+JointChannel jointChannel;
+std::vector<JointCommand> jointCommands;
+std::vector<glm::mat4> worldTransforms;
+JointFrameInfo jointFrameInfo = {};
 
-// Keyboard character callback function
-void CharacterCallback(GLFWwindow* lWindow, unsigned int key)
+// apply every joint target queued since the last frame, newest wins
+void ApplyJointCommands()
 {
-	// std::cout << "Key " << (char)key << " is pressed." << std::endl;
+	if (!jointChannel.isOpen()) {
+		return;
+	}
+
+	jointChannel.drain(jointCommands);
+	jointFrameInfo.frame = frameNumber;
+	jointFrameInfo.appliedTimestamp = JointChannelNow();
+	jointFrameInfo.oldestCommandTimestamp = 0;
+	jointFrameInfo.newestCommandTimestamp = 0;
+	if (jointCommands.empty()) {
+		return;
+	}
+
+	for (size_t i = 0; i < jointCommands.size(); i++) {
+		const JointCommand &command = jointCommands[i];
+		if (command.joint < traversalVector.size()) {
+			scene.setRotation(traversalVector[command.joint], {command.rotation[0], command.rotation[1], command.rotation[2]});
+		}
+	}
+	jointFrameInfo.oldestCommandTimestamp = jointCommands.front().timestamp;
+	jointFrameInfo.newestCommandTimestamp = jointCommands.back().timestamp;
+	jointFrameInfo.commandsApplied += jointCommands.size();
+}
+
+// share this frame's world transforms with the controllers
+void PublishJointState()
+{
+	if (!jointChannel.isOpen()) {
+		return;
+	}
+
+	worldTransforms.clear();
+	scene.computeWorldTransforms(robotTorso, glm::mat4(1.0f), worldTransforms);
+	jointChannel.publish(worldTransforms, jointFrameInfo);
+}
 
-	switch (key) {
+// Motion matching (--motion-db): on every tick of the database's sample rate the
+// controlled robot's current pose is looked up in a motion database and the frame
+// after the best match is applied, so nudging a joint carries the robot into
+// whichever recorded motion continues from there.
+MotionDatabase motionDatabase;
+bool motionMatching = false;
+const int motionLeafBudget = 32;
+// hands, feet and head, relative to the torso; the hands and feet also give velocities
+const char *motionPartNames[] = {"Left Lower Arm", "Right Lower Arm", "Left Lower Leg", "Right Lower Leg", "Head"};
+const int motionPartCount = 5;
+const int motionEffectorCount = 4;
+const int motionFeatureCount = 3 * motionPartCount + 3 * motionEffectorCount;
+glm::vec3 motionPrevious[motionPartCount];
+float motionFeatures[motionFeatureCount];
+float motionQuery[MotionDatabase::maxDimensions];
+double nextMotionStep = -1.0;
+uint64_t motionSearches = 0;
+double motionSearchSeconds = 0.0;
+double motionSearchWorst = 0.0;
+
+// positions of the motion parts in the controlled robot's torso space
+void GatherMotionPositions(glm::vec3 *positions)
+{
+	worldTransforms.clear();
+	scene.computeWorldTransforms(robotTorso, glm::mat4(1.0f), worldTransforms);
+	glm::mat4 torsoInverse = glm::inverse(worldTransforms[0]);
+	for (int p = 0; p < motionPartCount; p++) {
+		positions[p] = glm::vec3(torsoInverse * worldTransforms[PartChannel(motionPartNames[p]) / 3][3]);
+	}
+}
 
-		// traverse hierarchy forward
-		case '.':
-			// deselect current
-			traversalVector.at(currentIndex)->deselect();
+// positions, then the velocities of the hands and feet since previous
+void GatherMotionFeatures(const glm::vec3 *positions, const glm::vec3 *previous, float sampleRate, float *features)
+{
+	for (int p = 0; p < motionPartCount; p++) {
+		for (int c = 0; c < 3; c++) {
+			features[3 * p + c] = positions[p][c];
+		}
+	}
+	for (int p = 0; p < motionEffectorCount; p++) {
+		glm::vec3 velocity = (positions[p] - previous[p]) * sampleRate;
+		for (int c = 0; c < 3; c++) {
+			features[3 * motionPartCount + 3 * p + c] = velocity[c];
+		}
+	}
+}
 
-			currentIndex++;
+// Resample pose tracks at 60 Hz into a motion database, one clip per track
+bool BuildMotionDatabase(const char *fileName, int trackCount, char **trackNames)
+{
+	const float rate = 60.0f;
+	ConstructScene(1);
+	int channels = (int)traversalVector.size() * 3;
+
+	MotionDatabase database;
+	database.begin(channels, motionFeatureCount, rate);
+	std::vector<float> angles(channels);
+	glm::vec3 positions[motionPartCount], previous[motionPartCount];
+	for (int t = 0; t < trackCount; t++) {
+		PoseTrackReader track;
+		if (!track.open(trackNames[t])) {
+			return false;
+		}
+		if (track.getChannelCount() != channels) {
+			std::cerr << "The pose track " << trackNames[t] << " does not match this robot" << std::endl;
+			return false;
+		}
 
-			// reset to 0 if over index
-			if (currentIndex == traversalVector.size()) {
-				currentIndex = 0;
+		int frames = (int)(track.getDuration() * rate);
+		for (int f = 0; f < frames; f++) {
+			track.sampleAt(f / rate, false, &angles[0]);
+			for (size_t i = 0; i < traversalVector.size(); i++) {
+				scene.setRotation(traversalVector[i], {angles[3 * i + 0], angles[3 * i + 1], angles[3 * i + 2]});
 			}
+			GatherMotionPositions(positions);
+			GatherMotionFeatures(positions, f == 0 ? positions : previous, rate, motionFeatures);
+			std::copy(positions, positions + motionPartCount, previous);
+			database.addFrame(&angles[0], motionFeatures, f + 1 < frames);
+		}
+	}
 
-			// select the current index
-			traversalVector.at(currentIndex)->select();
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	database.build();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if (!database.write(fileName)) {
+		return false;
+	}
+	std::cout << "Motion database " << fileName << ": " << database.frameCount() << " frames, " << database.rowCount()
+		<< " searchable, tree depth " << database.getTreeDepth() << ", built in " << ms << " ms" << std::endl;
+	return true;
+}
 
-			break;
+// step the controlled robot through the motion database for every tick that has passed
+void ApplyMotionMatching()
+{
+	if (!motionMatching) {
+		return;
+	}
+
+	double now = CurrentTime();
+	if (nextMotionStep < 0.0) {
+		GatherMotionPositions(motionPrevious);
+		nextMotionStep = now;
+	}
 
-		// traverse hierarchy backward
-		case ',':
-			// deselect current
-			traversalVector.at(currentIndex)->deselect();
+	// after a stall (a window drag, a breakpoint) skip the missed ticks rather than searching for each of them in one frame
+	float rate = motionDatabase.getSampleRate();
+	nextMotionStep = std::max(nextMotionStep, now - 1.0 / rate);
+	glm::vec3 positions[motionPartCount];
+	while (nextMotionStep <= now) {
+		GatherMotionPositions(positions);
+		GatherMotionFeatures(positions, motionPrevious, rate, motionFeatures);
+		std::copy(positions, positions + motionPartCount, motionPrevious);
+
+		double start = glfwGetTime();
+		motionDatabase.normalize(motionFeatures, motionQuery);
+		float distance;
+		int row = motionDatabase.search(motionQuery, distance, motionLeafBudget);
+		double seconds = glfwGetTime() - start;
+		motionSearchSeconds += seconds;
+		motionSearchWorst = std::max(motionSearchWorst, seconds);
+		motionSearches++;
+
+		// no match (a NaN query, or a budget spent on empty leaves) keeps the current pose;
+		// every searchable frame has a next frame in its clip
+		if (row >= 0) {
+			const float *angles = motionDatabase.angles(motionDatabase.rowFrame(row) + 1);
+			for (size_t i = 0; i < traversalVector.size(); i++) {
+				scene.setRotation(traversalVector[i], {angles[3 * i + 0], angles[3 * i + 1], angles[3 * i + 2]});
+			}
+		}
+		nextMotionStep += 1.0 / rate;
+	}
+}
+
+void PrintMotionMatchingStats()
+{
+	if (motionSearches == 0) {
+		return;
+	}
+	std::cout << "Motion matching: " << motionDatabase.rowCount() << " frames, " << motionSearches << " searches, "
+		<< 1e6 * motionSearchSeconds / motionSearches << " us average, " << 1e6 * motionSearchWorst << " us worst" << std::endl;
+}
+
+// joint nudges collected over a frame, one entry per element of traversalVector
+std::vector<glm::vec3> pendingRotation;
+std::vector<int> pendingJoints;
+
+// Apply the keys typed during a frame. Selection changes happen in order, but
+// repeated nudges of a joint are summed and applied to it once.
+void ApplyCharacters(const std::vector<unsigned int> &characters)
+{
+	pendingRotation.resize(traversalVector.size(), glm::vec3(0.0f));
+	const float step = glm::radians(5.0f);
+
+	for (size_t i = 0; i < characters.size(); i++) {
+		glm::vec3 nudge(0.0f);
+
+		switch (characters[i]) {
+
+			// traverse hierarchy forward
+			case '.':
+				// deselect current
+				scene.deselect(traversalVector.at(currentIndex));
 
-			currentIndex--;
+				currentIndex++;
+
+				// reset to 0 if over index
+				if (currentIndex == traversalVector.size()) {
+					currentIndex = 0;
+				}
+
+				// select the current index
+				scene.select(traversalVector.at(currentIndex));
+
+				break;
+
+			// traverse hierarchy backward
+			case ',':
+				// deselect current
+				scene.deselect(traversalVector.at(currentIndex));
+
+				currentIndex--;
+
+				// reset to 0 if over index
+				if (currentIndex == -1) {
+					currentIndex = traversalVector.size() - 1;
+				}
+
+				// select the current index
+				scene.select(traversalVector.at(currentIndex));
+
+				break;
+
+			// increase / decrease Z angle
+			case 'Z': nudge[2] = step; break;
+			case 'z': nudge[2] = -step; break;
+
+			// increase / decrease Y angle
+			case 'Y': nudge[1] = step; break;
+			case 'y': nudge[1] = -step; break;
+
+			// increase / decrease X angle
+			case 'X': nudge[0] = step; break;
+			case 'x': nudge[0] = -step; break;
+
+			// toggle animation
+			case 'r':
+				animationOn = !animationOn;
+				if (animationOn) {
+					startAnimation();
+				}
+				break;
+
+			// scrub pose playback back / forward one second
+			case '[':
+				posePlaybackOffset -= 1.0;
+				break;
+			case ']':
+				posePlaybackOffset += 1.0;
+				break;
+		}
 
-			// reset to 0 if over index
-			if (currentIndex == -1) {
-				currentIndex = traversalVector.size() - 1;
+		if (nudge != glm::vec3(0.0f)) {
+			if (pendingRotation[currentIndex] == glm::vec3(0.0f)) {
+				pendingJoints.push_back(currentIndex);
 			}
+			pendingRotation[currentIndex] += nudge;
+		}
+	}
 
-			// select the current index
-			traversalVector.at(currentIndex)->select();
+	for (size_t i = 0; i < pendingJoints.size(); i++) {
+		int joint = pendingJoints[i];
+		scene.addRotation(traversalVector.at(joint), pendingRotation[joint]);
+		pendingRotation[joint] = glm::vec3(0.0f);
+	}
+	pendingJoints.clear();
+}
 
-			break;
-		
-		// increase Z angle
-		case 'Z':
-			traversalVector.at(currentIndex)->increaseRotation('Z');
-			break;
+// Drain the input queue once per frame. Returns the arrival time of the
+// oldest event applied, or a negative value if there was no input.
+double ApplyInput()
+{
+	inputQueue.coalesce(frameInput);
 
-		// decrease Z angle
-		case 'z':
-			traversalVector.at(currentIndex)->decreaseRotation('z');
-			break;
-		
-		// increase Y angle
-		case 'Y':
-			traversalVector.at(currentIndex)->increaseRotation('Y');
-			break;
-		
-		// decrease Y angle
-		case 'y':
-			traversalVector.at(currentIndex)->decreaseRotation('y');
-			break;
+	if (frameInput.zoomInSteps != 0 || frameInput.zoomOutSteps != 0) {
+		ApplyZoom(frameInput.zoomInSteps, frameInput.zoomOutSteps);
+	}
+	ApplyCursorDelta(frameInput.orbitDelta, frameInput.panDelta);
+	if (!frameInput.characters.empty()) {
+		ApplyCharacters(frameInput.characters);
+	}
 
-		// increase X angle
-		case 'X':
-			traversalVector.at(currentIndex)->increaseRotation('X');
-			break;
-		
-		// decrease X angle
-		case 'x':
-			traversalVector.at(currentIndex)->decreaseRotation('x');
-			break;
+	return frameInput.oldestEventTime;
+}
 
-		// toggle animation
-		case 'r':
-			animationOn = !animationOn;
-			startAnimation();
-			break;
+// Scroll callback function
+void ScrollCallback(GLFWwindow* lwindow, double xoffset, double yoffset)
+{
+	// ignore xoffset since we are only responding to normal scrolling
+	InputEvent event = {InputEvent::Scroll, glfwGetTime(), xoffset, yoffset, 0, 0};
+	QueueInput(event);
+	RequestRedraw();
+}
+
+
+// Mouse callback function
+void MouseCallback(GLFWwindow* lWindow, int button, int action, int mods)
+{
+
+}
+
+// Mouse position callback function
+void CursorPositionCallback(GLFWwindow* lWindow, double xpos, double ypos)
+{
+	int buttons = 0;
+	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+		buttons |= 1;
+	}
+	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) {
+		buttons |= 2;
+	}
+
+	// moves without a button still update the previous cursor position
+	InputEvent event = {InputEvent::CursorMove, glfwGetTime(), xpos, ypos, 0, buttons};
+	QueueInput(event);
+
+	// only a drag moves the camera
+	if (buttons != 0) {
+		RequestRedraw();
 	}
 }
 
-void CreateCube()
+
+// Keyboard character callback function
+void CharacterCallback(GLFWwindow* lWindow, unsigned int key)
 {
-	// x, y, z, r, g, b, ...
-	float cubeVerts[] = {
-		// Face x-
-		-1.0f,	+1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
-		-1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
-		-1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
-		-1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
-		-1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
-		-1.0f,	-1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
-		// Face x+
-		+1.0f,	+1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
-		+1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
-		+1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
-		+1.0f,	+1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
-		+1.0f,	-1.0f,	+1.0f,	0.8f,	0.2f,	0.2f,
-		+1.0f,	-1.0f,	-1.0f,	0.8f,	0.2f,	0.2f,
-		// Face y-
-		+1.0f,	-1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
-		-1.0f,	-1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
-		+1.0f,	-1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
-		+1.0f,	-1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
-		-1.0f,	-1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
-		-1.0f,	-1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
-		// Face y+
-		+1.0f,	+1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
-		+1.0f,	+1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
-		-1.0f,	+1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
-		-1.0f,	+1.0f,	+1.0f,	0.2f,	0.8f,	0.2f,
-		+1.0f,	+1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
-		-1.0f,	+1.0f,	-1.0f,	0.2f,	0.8f,	0.2f,
-		// Face z-
-		+1.0f,	+1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
-		+1.0f,	-1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
-		-1.0f,	+1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
-		-1.0f,	+1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
-		+1.0f,	-1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
-		-1.0f,	-1.0f,	-1.0f,	0.2f,	0.2f,	0.8f,
-		// Face z+
-		+1.0f,	+1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
-		-1.0f,	+1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
-		+1.0f,	-1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
-		+1.0f,	-1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
-		-1.0f,	+1.0f,	+1.0f,	0.2f,	0.2f,	0.8f,
-		-1.0f,	-1.0f,	+1.0f,	0.2f,	0.2f,	0.8f
-	};
+	// std::cout << "Key " << (char)key << " is pressed." << std::endl;
+	InputEvent event = {InputEvent::Character, glfwGetTime(), 0.0, 0.0, key, 0};
+	QueueInput(event);
+	RequestRedraw();
+}
 
+void CreateCube()
+{
 	GLuint vertBufferID;
 	glGenBuffers(1, &vertBufferID);
 	glBindBuffer(GL_ARRAY_BUFFER, vertBufferID);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVerts), cubeVerts, GL_STATIC_DRAW);
-	GLint posID = glGetAttribLocation(program.GetPID(), "position");
-	glEnableVertexAttribArray(posID);
-	glVertexAttribPointer(posID, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
-	GLint colID = glGetAttribLocation(program.GetPID(), "color");
-	glEnableVertexAttribArray(colID);
-	glVertexAttribPointer(colID, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
-
+	glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+
+	// every part is mesh 0 drawn with material 0, the untinted vertex colours
+	Mesh cube = {vertBufferID, cubeVertexCount, false};
+	meshes.push_back(cube);
+	Material vertexColor = {glm::vec3(1.0f), 0};
+	materials.push_back(vertexColor);
+
+	// the level of detail streams and the impostor atlas
+	GLuint streamBufferIDs[2];
+	glGenBuffers(2, streamBufferIDs);
+	Mesh merged = {streamBufferIDs[0], 0, false};
+	Mesh billboards = {streamBufferIDs[1], 0, true};
+	meshes.push_back(merged);
+	meshes.push_back(billboards);
+	Material atlas = {glm::vec3(1.0f), impostorAtlas.getTexture()};
+	materials.push_back(atlas);
 }
 
 void FrameBufferSizeCallback(GLFWwindow* lWindow, int width, int height)
 {
 	glViewport(0, 0, width, height);
+	if (width > 0 && height > 0) {
+		occlusionCuller.setResolution(occlusionBufferWidth, occlusionBufferWidth * height / width);
+	}
+	RequestRedraw();
+}
+
+void WindowRefreshCallback(GLFWwindow* lWindow)
+{
+	RequestRedraw();
+}
+
+// Window size, --size WxH
+int windowWidth = WINDOW_WIDTH;
+int windowHeight = WINDOW_HEIGHT;
+
+// Frame capture (--capture PREFIX). Frames are read back through a PBO ring and
+// encoded on writer threads; with --play-pose every sample of the track is
+// rendered once and the program exits.
+const char *capturePrefix = 0;
+CaptureFormat captureFormat = CapturePng;
+FrameWriter frameWriter;
+FrameCapture frameCapture;
+bool capturingPoseTrack = false;
+
+void StartCapture()
+{
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	frameWriter.start(capturePrefix, captureFormat, width, height);
+	if (!frameCapture.init(&frameWriter)) {
+		frameWriter.finish();
+	}
+}
+
+void PrintCaptureStats()
+{
+	if (!frameCapture.isReady()) {
+		return;
+	}
+	frameCapture.finish();
+	frameWriter.finish();
+	frameWriter.printStats();
+	std::cout << "Capture readbacks: " << frameCapture.getReadbacks() << ", " << frameCapture.getGpuWaits()
+		<< " waited on the GPU, " << frameCapture.getSizeMismatches() << " skipped after a resize" << std::endl;
 }
 
 void Init()
 {
 	glfwInit();
 	glfwWindowHint(GLFW_COCOA_RETINA_FRAMEBUFFER, GL_FALSE);
-	window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Moveable Robot - Nathaniel Trujillo", NULL, NULL);
+	if (replaying) {
+		// a replay needs a context but nothing to look at or interact with
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	}
+	window = glfwCreateWindow(windowWidth, windowHeight, "Moveable Robot - Nathaniel Trujillo", NULL, NULL);
 	glfwMakeContextCurrent(window);
 	glewExperimental = GL_TRUE;
 	glewInit();
-	glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-	glfwSetScrollCallback(window, ScrollCallback);
-	glfwSetMouseButtonCallback(window, MouseCallback);
-	glfwSetCursorPosCallback(window, CursorPositionCallback);
-	glfwSetCharCallback(window, CharacterCallback);
+	int framebufferWidth, framebufferHeight;
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	glViewport(0, 0, framebufferWidth, framebufferHeight);
+	if (!replaying) {
+		glfwSetScrollCallback(window, ScrollCallback);
+		glfwSetMouseButtonCallback(window, MouseCallback);
+		glfwSetCursorPosCallback(window, CursorPositionCallback);
+		glfwSetCharCallback(window, CharacterCallback);
+	}
 	glfwSetFramebufferSizeCallback(window, FrameBufferSizeCallback);
+	glfwSetWindowRefreshCallback(window, WindowRefreshCallback);
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glEnable(GL_DEPTH_TEST);
 
 	program.SetShadersFileName(vertShaderPath, fragShaderPath);
 	program.Init();
+	impostorProgram.SetShadersFileName(impostorVertShaderPath, impostorFragShaderPath);
+	impostorProgram.Init();
+
+	// drawing every view in one pass needs viewport arrays, geometry shaders and instancing
+	layeredViews = viewCount > 1 && GLEW_ARB_viewport_array && GLEW_VERSION_3_2;
+	if (layeredViews) {
+		multiviewProgram.SetShadersFileName(multiviewVertShaderPath, multiviewFragShaderPath);
+		multiviewProgram.SetGeometryShaderFileName(multiviewGeomShaderPath);
+		multiviewProgram.Init();
+	}
+	if (GLEW_ARB_timer_query) {
+		glGenQueries(2, viewTimers);
+	}
+
+	// without an atlas far robots keep the merged mesh
+	LodSettings lod;
+	lod.enabled = lodEnabled;
+	if (!impostorAtlas.init()) {
+		lod.impostorPixels = 0.0f;
+	}
+	commandRecorder.setLodSettings(lod);
+	if (occlusionEnabled) {
+		occlusionCuller.setResolution(occlusionBufferWidth, occlusionBufferWidth * framebufferHeight / framebufferWidth);
+		occlusionCuller.setNeighbourGrid(&robotGrid);
+		commandRecorder.setOcclusionCuller(&occlusionCuller);
+	}
 
 	CreateCube();
-	ConstructRobot();
+	ConstructScene(crowdSize);
+	commandRecorder.setThreadCount(renderThreads);
+	if (crowdAnimation) {
+		StartCrowdAnimation();
+	}
+
+	if (capturePrefix) {
+		StartCapture();
+	}
 }
 
+// With --require-zero-alloc every frame after the warm-up must stay off the heap
+bool requireZeroAllocations = false;
+int allocationWarmupFrames = 10;
+int allocationViolations = 0;
+const char *allocationDumpFileName = 0;
+
+void CheckFrameAllocations()
+{
+	if (!requireZeroAllocations || frameNumber < allocationWarmupFrames) {
+		return;
+	}
+
+	const FrameAllocations &frame = AllocationTracker::lastFrame();
+	if (frame.total.allocations == 0) {
+		return;
+	}
+
+	if (allocationViolations++ == 0) {
+		std::cerr << "Frame " << frameNumber << " allocated " << frame.total.allocations << " times:";
+		for (int tag = 0; tag < AllocTagCount; tag++) {
+			if (frame.byTag[tag].allocations) {
+				std::cerr << " " << AllocationTracker::tagName((AllocationTag)tag) << " " << frame.byTag[tag].allocations;
+			}
+		}
+		std::cerr << std::endl;
+	}
+}
+
+// Apply queued input and draw one frame
+void RenderFrame()
+{
+	framePacer.beginFrame();
+	AllocationTracker::beginFrame();
+	redrawRequested = false;
+
+	double oldestInput;
+	{
+		AllocationScope scope(AllocInput);
+		oldestInput = ApplyInput();
+	}
+	{
+		AllocationScope scope(AllocAnimation);
+		UpdateCrowdAnimation();
+	}
+	{
+		AllocationScope scope(AllocPose);
+		RecordPoseSamples();
+		ApplyPosePlayback();
+		ApplyMotionMatching();
+	}
+	{
+		AllocationScope scope(AllocJoints);
+		ApplyJointCommands();
+	}
 
-int main()
-{	
-	Init();
-	while ( glfwWindowShouldClose(window) == 0) 
 	{
+		AllocationScope scope(AllocRender);
+
+		// swapping buffers already flushes the command stream
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		Display();
-		glFlush();
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		frameCapture.capture(frameNumber, width, height);
 		glfwSwapBuffers(window);
+	}
+	{
+		AllocationScope scope(AllocJoints);
+		PublishJointState();
+	}
+
+	// time from the oldest input in this frame until it was handed to the display
+	if (oldestInput >= 0.0 && !replaying) {
+		inputLatency.record(glfwGetTime() - oldestInput);
+	}
+
+	AllocationTracker::endFrame();
+	framePacer.endFrame();
+	CheckFrameAllocations();
+	frameNumber++;
+}
+
+void InteractiveLoop()
+{
+	while ( glfwWindowShouldClose(window) == 0) 
+	{
+		RecordPoseSamples();
+		{
+			AllocationScope scope(AllocAnimation);
+			UpdateAnimation();
+		}
+
+		// a playing pose track, motion matching, the crowd animation or an external controller can change the pose every frame;
+		// while recording, logical time only advances with frames, so an animation keeps them coming
+		bool recordingAnimation = animationOn && inputRecorder.isOpen();
+		if (continuousRendering || crowdAnimation || motionMatching || redrawRequested || recordingAnimation ||
+			posePlayer.isOpen() || jointChannel.isOpen()) {
+			framePacer.waitForNextFrame();
+			RenderFrame();
+			glfwPollEvents();
+		} else if (animationOn) {
+			// sleep until input arrives or the next animation step is due
+			glfwWaitEventsTimeout(std::max(nextAnimationStep - glfwGetTime(), 0.0));
+		} else {
+			// nothing to draw, sleep until input arrives
+			glfwWaitEvents();
+		}
+	}
+}
+
+// Feed a recorded trace back one frame at a time on a fixed timestep, drawing
+// every frame, until the trace and any animation it started have finished.
+void ReplayLoop()
+{
+	while (!inputPlayer.finished() || animationOn) {
+		inputPlayer.feedFrame(frameNumber, CurrentTime(), inputQueue);
+		RecordPoseSamples();
+		{
+			AllocationScope scope(AllocAnimation);
+			UpdateAnimation();
+		}
+		RenderFrame();
+	}
+}
+
+// Render every sample of the playing pose track once, for capturing it to disk
+void PoseCaptureLoop()
+{
+	for (int64_t sample = 0; posePlayer.isOpen() && sample < posePlayer.getSampleCount(); sample++) {
+		if (glfwWindowShouldClose(window)) {
+			break;
+		}
+		RenderFrame();
 		glfwPollEvents();
 	}
+}
+
+int main(int argc, char **argv)
+{	
+	const char *poseFileName = 0;
+	const char *jointChannelName = 0;
+
+	// drive a running viewer's joints from this process
+	if (argc > 2 && strcmp(argv[1], "--joint-client") == 0) {
+		RunJointClient(argv[2], argc > 3 ? atof(argv[3]) : 2.0);
+		return 0;
+	}
+
+	// build a motion database from pose tracks without opening a window
+	if (argc > 3 && strcmp(argv[1], "--build-motion-db") == 0) {
+		return BuildMotionDatabase(argv[2], argc - 3, argv + 3) ? 0 : 1;
+	}
+
+	// benchmarks run without opening a window
+	if (argc > 2 && strcmp(argv[1], "--bench") == 0) {
+		if (strcmp(argv[2], "grid") == 0) {
+			BenchmarkSpatialGrid();
+		} else if (strcmp(argv[2], "pose") == 0) {
+			BenchmarkPoseTrack();
+		} else if (strcmp(argv[2], "fk") == 0) {
+			BenchmarkForwardKinematics();
+		} else if (strcmp(argv[2], "joints") == 0) {
+			BenchmarkJointChannel();
+		} else if (strcmp(argv[2], "crowd") == 0) {
+			BenchmarkCommandRecording(argc > 3 ? atoi(argv[3]) : 10000);
+		} else if (strcmp(argv[2], "queue") == 0) {
+			BenchmarkRenderQueue();
+		} else if (strcmp(argv[2], "occlusion") == 0) {
+			int robots = argc > 3 ? atoi(argv[3]) : 10000;
+			ConstructScene(robots);
+			BenchmarkOcclusionCuller(scene, robotRoots, std::ceil(std::sqrt((float)robots)) * crowdSpacing);
+		} else if (strcmp(argv[2], "capture") == 0) {
+			BenchmarkFrameWriter();
+		} else if (strcmp(argv[2], "animation") == 0) {
+			BenchmarkAnimationEngine();
+		} else if (strcmp(argv[2], "motion") == 0) {
+			BenchmarkMotionDatabase(argc > 3 ? atoi(argv[3]) : 1000000);
+		} else if (strcmp(argv[2], "views") == 0) {
+			BenchmarkViews(argc > 3 ? atoi(argv[3]) : 10000);
+		} else if (strcmp(argv[2], "lod") == 0) {
+			BenchmarkLevelOfDetail(argc > 3 ? atoi(argv[3]) : 100000);
+		} else {
+			std::cerr << "Unknown benchmark: " << argv[2] << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--continuous") == 0) {
+			continuousRendering = true;
+		} else if (strcmp(argv[i], "--crowd") == 0 && i + 1 < argc) {
+			crowdSize = std::max(atoi(argv[++i]), 1);
+		} else if (strcmp(argv[i], "--views") == 0 && i + 1 < argc) {
+			viewCount = std::min(std::max(atoi(argv[++i]), 1), (int)CommandRecorder::maxViews);
+		} else if (strcmp(argv[i], "--animate") == 0) {
+			crowdAnimation = true;
+		} else if (strcmp(argv[i], "--no-occlusion") == 0) {
+			occlusionEnabled = false;
+		} else if (strcmp(argv[i], "--no-lod") == 0) {
+			lodEnabled = false;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			renderThreads = std::max(atoi(argv[++i]), 0);
+		} else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) != 2 || windowWidth <= 0 || windowHeight <= 0) {
+				std::cerr << "Expected --size WIDTHxHEIGHT" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			capturePrefix = argv[++i];
+		} else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) {
+			captureFormat = strcmp(argv[++i], "raw") == 0 ? CaptureRaw : CapturePng;
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			framePacer.setFrameRateCap(atof(argv[++i]));
+		} else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			if (!inputRecorder.open(argv[++i])) {
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--pose-rate") == 0 && i + 1 < argc) {
+			poseSampleRate = (float)atof(argv[++i]);
+		} else if (strcmp(argv[i], "--record-pose") == 0 && i + 1 < argc) {
+			poseFileName = argv[++i];
+		} else if (strcmp(argv[i], "--play-pose") == 0 && i + 1 < argc) {
+			if (!posePlayer.open(argv[++i])) {
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--motion-db") == 0 && i + 1 < argc) {
+			if (!motionDatabase.open(argv[++i])) {
+				return 1;
+			}
+			motionMatching = true;
+		} else if (strcmp(argv[i], "--joint-server") == 0 && i + 1 < argc) {
+			jointChannelName = argv[++i];
+		} else if (strcmp(argv[i], "--alloc-dump") == 0 && i + 1 < argc) {
+			allocationDumpFileName = argv[++i];
+		} else if (strcmp(argv[i], "--require-zero-alloc") == 0) {
+			requireZeroAllocations = true;
+			if (i + 1 < argc && isdigit(argv[i + 1][0])) {
+				allocationWarmupFrames = atoi(argv[++i]);
+			}
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			if (!inputPlayer.open(argv[++i])) {
+				return 1;
+			}
+			replaying = true;
+		}
+	}
+
+	// recorded frames are drawn at the replay rate so logical time keeps up with the clock
+	if (inputRecorder.isOpen() && framePacer.getFrameRateCap() <= 0.0) {
+		framePacer.setFrameRateCap(1.0 / replayTimestep);
+	}
+	// capturing a pose track renders it offline, one frame per sample
+	if (capturePrefix && posePlayer.isOpen() && !replaying) {
+		capturingPoseTrack = true;
+		replaying = true;
+		replayTimestep = 1.0 / posePlayer.getSampleRate();
+	}
+
+	Init();
+	if (posePlayer.isOpen() && posePlayer.getChannelCount() != (int)traversalVector.size() * 3) {
+		std::cerr << "The pose track does not match this robot" << std::endl;
+		posePlayer.close();
+	}
+	if (motionMatching && (motionDatabase.getChannelCount() != (int)traversalVector.size() * 3 ||
+		motionDatabase.getFeatureCount() != motionFeatureCount || motionDatabase.rowCount() == 0)) {
+		std::cerr << "The motion database does not match this robot" << std::endl;
+		motionMatching = false;
+	}
+	if (jointChannelName && jointChannel.create(jointChannelName)) {
+		jointCommands.reserve(jointRingCapacity);
+	}
+	if (poseFileName && poseWriter.open(poseFileName, (int)traversalVector.size() * 3, poseSampleRate)) {
+		nextPoseSample = CurrentTime();
+	}
 
+	if (capturingPoseTrack) {
+		PoseCaptureLoop();
+	} else if (replaying) {
+		ReplayLoop();
+	} else {
+		InteractiveLoop();
+	}
+
+	framePacer.printStats();
+	renderQueue.printStats();
+	PrintLodStats();
+	PrintOcclusionStats();
+	PrintViewStats();
+	PrintCrowdAnimationStats();
+	PrintMotionMatchingStats();
+	PrintCaptureStats();
+	AllocationTracker::printStats();
+	if (allocationDumpFileName) {
+		AllocationTracker::writeDump(allocationDumpFileName);
+	}
+	if (!replaying) {
+		inputLatency.print("Input to swap latency");
+	}
+	if (poseWriter.isOpen()) {
+		RecordPoseSamples();
+		if (!poseWriter.close()) {
+			std::cerr << "The pose track " << poseFileName << " is incomplete" << std::endl;
+		}
+		std::cout << "Recorded " << poseWriter.getSampleCount() << " poses, " << poseWriter.getBytesWritten() << " bytes" << std::endl;
+	}
+	if (inputRecorder.isOpen()) {
+		std::cout << "Recorded " << inputRecorder.eventCount() << " input events over " << frameNumber << " frames" << std::endl;
+		inputRecorder.close();
+	}
+	jointChannel.close();
 	glfwTerminate();
+
+	if (requireZeroAllocations) {
+		if (!AllocationTracker::enabled()) {
+			std::cerr << "--require-zero-alloc needs a build configured with -DROBOT_TRACK_ALLOCATIONS=ON" << std::endl;
+			return 1;
+		}
+		if (allocationViolations > 0) {
+			std::cerr << allocationViolations << " frames allocated after the first " << allocationWarmupFrames << std::endl;
+			return 1;
+		}
+	}
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,200 @@
+// SceneGraph handle lifetimes, reparenting and per-frame allocations.
+// Returns non-zero when a check fails; run with ctest.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <glm/glm.hpp>
+#include "SceneGraph.h"
+
+// every operator new in the process is counted, so a frame can be checked for allocations
+static unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+	allocations++;
+	void *pointer = malloc(size ? size : 1);
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+	free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	free(pointer);
+}
+
+static int failures = 0;
+
+static void Check(bool condition, const char *what)
+{
+	if (!condition) {
+		std::printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+// the ten part robot's shape, with names short enough to stay in std::string's inline buffer
+static SceneHandle AddRobot(SceneGraph &scene)
+{
+	SceneHandle torso = scene.create(sceneNullHandle, "Torso");
+	for (int limb = 0; limb < 4; limb++) {
+		SceneHandle upper = scene.create(torso, "Upper");
+		scene.create(upper, "Lower");
+	}
+	scene.create(torso, "Head");
+	return torso;
+}
+
+static void TestHandles()
+{
+	SceneGraph scene;
+	SceneHandle torso = AddRobot(scene);
+	Check(scene.size() == 10, "a robot has ten parts");
+
+	std::vector<SceneHandle> parts;
+	scene.traverse(torso, parts);
+	Check(parts.size() == 10, "the traversal visits every part");
+
+	// removing an arm frees it and its lower arm
+	SceneHandle arm = parts[1];
+	SceneHandle lowerArm = parts[2];
+	scene.remove(arm);
+	Check(scene.size() == 8, "removing a part removes its subtree");
+	Check(!scene.isValid(arm), "a removed node's handle is invalid");
+	Check(!scene.isValid(lowerArm), "a removed child's handle is invalid");
+	Check(scene.isValid(torso) && scene.isValid(parts[3]), "other handles stay valid");
+
+	// the freed slots are reused with a new generation, the old handles stay dead
+	SceneHandle first = scene.create(torso, "Upper");
+	SceneHandle second = scene.create(first, "Lower");
+	bool reused = (first.index == arm.index || first.index == lowerArm.index) &&
+		(second.index == arm.index || second.index == lowerArm.index);
+	Check(reused, "new nodes reuse freed slots");
+	Check(first.generation != (first.index == arm.index ? arm.generation : lowerArm.generation), "a reused slot bumps its generation");
+	Check(scene.isValid(first) && scene.isValid(second), "new handles are valid");
+	Check(!scene.isValid(arm) && !scene.isValid(lowerArm), "stale handles stay invalid after reuse");
+	Check(scene.getParent(second) == first, "a new child links to its parent");
+	Check(scene.size() == 10, "the robot is whole again");
+
+	// removing twice is harmless
+	scene.remove(arm);
+	Check(scene.size() == 10, "removing a stale handle does nothing");
+}
+
+static void TestReparent()
+{
+	SceneGraph scene;
+	SceneHandle torso = AddRobot(scene);
+	std::vector<SceneHandle> parts;
+	scene.traverse(torso, parts);
+	SceneHandle upper = parts[1];
+	SceneHandle lower = parts[2];
+	SceneHandle head = parts[9];
+
+	Check(!scene.reparent(torso, lower), "a node cannot move under its grandchild");
+	Check(!scene.reparent(upper, lower), "a node cannot move under its child");
+	Check(!scene.reparent(upper, upper), "a node cannot move under itself");
+	Check(scene.getParent(upper) == torso && scene.getParent(lower) == upper, "a refused reparent changes nothing");
+
+	Check(scene.reparent(upper, head), "a node can move under a sibling");
+	Check(scene.getParent(upper) == head, "the moved node has its new parent");
+	Check(scene.getParent(lower) == upper, "the subtree moves with it");
+	parts.clear();
+	scene.traverse(torso, parts);
+	Check(parts.size() == 10, "the traversal still visits every part");
+	parts.clear();
+	scene.traverse(head, parts);
+	Check(parts.size() == 3, "the new parent holds the subtree");
+
+	// a stale parent is refused rather than taken for "no parent"
+	SceneHandle stale = scene.create(torso, "Stale");
+	scene.remove(stale);
+	Check(!scene.reparent(upper, stale), "a node cannot move under a removed node");
+	Check(scene.getParent(upper) == head, "a refused reparent keeps the parent");
+	Check(scene.create(stale, "Orphan") == sceneNullHandle, "a node cannot be created under a removed node");
+	Check(scene.size() == 10, "a refused create adds nothing");
+
+	Check(scene.reparent(upper, sceneNullHandle), "a node can become a root");
+	Check(scene.getParent(upper) == sceneNullHandle, "a root has no parent");
+	parts.clear();
+	scene.traverse(torso, parts);
+	Check(parts.size() == 8, "a detached subtree leaves the traversal");
+}
+
+static void TestNames()
+{
+	SceneGraph scene;
+	SceneHandle torso = AddRobot(scene);
+	const char *name = scene.getName(torso);
+
+	// interning many more names must not move the ones already handed out
+	char buffer[16];
+	for (int i = 0; i < 1000; i++) {
+		std::snprintf(buffer, sizeof(buffer), "Part %d", i);
+		scene.create(torso, buffer);
+	}
+	Check(name == scene.getName(torso) && std::strcmp(name, "Torso") == 0, "name pointers stay valid as names are added");
+}
+
+static void TestFrameAllocations()
+{
+	const int robots = 100;
+	const int frames = 1000;
+
+	SceneGraph scene;
+	std::vector<SceneHandle> roots;
+	for (int i = 0; i < robots; i++) {
+		roots.push_back(AddRobot(scene));
+	}
+	std::vector<glm::mat4> transforms;
+	transforms.reserve(10);
+
+	// a frame animates every robot, rebuilds one and moves a head between two robots
+	for (int frame = -1; frame < frames; frame++) {
+		// the first frame grows the free list once, the rest are measured
+		unsigned long before = allocations;
+		for (int i = 0; i < robots; i++) {
+			scene.addRotation(roots[i], glm::vec3(0.0f, 0.01f, 0.0f));
+			transforms.clear();
+			scene.computeWorldTransforms(roots[i], glm::mat4(1.0f), transforms);
+		}
+
+		int rebuilt = (frame + robots) % robots;
+		scene.remove(roots[rebuilt]);
+		roots[rebuilt] = AddRobot(scene);
+
+		SceneHandle head = sceneNullHandle;
+		for (SceneHandle child : scene.children(roots[0])) {
+			head = child;
+		}
+		scene.reparent(head, roots[1]);
+		scene.reparent(head, roots[0]);
+
+		if (frame >= 0 && allocations != before) {
+			std::printf("frame %d allocated %lu times\n", frame, allocations - before);
+			Check(false, "frames do not allocate");
+			break;
+		}
+	}
+	Check(scene.size() == robots * 10, "every robot is whole after the frames");
+}
+
+int main()
+{
+	TestHandles();
+	TestReparent();
+	TestNames();
+	TestFrameAllocations();
+	if (failures == 0) {
+		std::printf("SceneGraph tests passed\n");
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/* Command-line driver for the kinematics library: solves random poses of the
+ * ten part robot in batches and reports poses per second on 1 to all threads,
+ * for the compile-time specialized robot and for the same skeleton walked as a
+ * table. Written in C to keep the library's interface honest.
+ *
+ * usage: robotfk [POSES] [THREADS]
+ *   POSES    poses to solve per run (default 10000000)
+ *   THREADS  only run with this many threads (default 1, 2, 4, ... and the core count)
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Kinematics.h"
+
+#define BATCH_POSES 65536
+
+static double Seconds(void)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* solve poses in batches of BATCH_POSES, cycling over the prepared angles */
+static double Run(KinematicsContext *context, const float *angles, float *transforms, long long poses)
+{
+	double start = Seconds();
+	long long done;
+	for (done = 0; done < poses; done += BATCH_POSES) {
+		int count = poses - done < BATCH_POSES ? (int)(poses - done) : BATCH_POSES;
+		if (KinematicsSolve(context, angles, count, transforms) != 0) {
+			fprintf(stderr, "KinematicsSolve failed\n");
+			exit(1);
+		}
+	}
+	return Seconds() - start;
+}
+
+/* a whole positive decimal argument, or 0 */
+static long long PositiveArgument(const char *text)
+{
+	char *end;
+	long long value = strtoll(text, &end, 10);
+	return end != text && *end == '\0' && value > 0 ? value : 0;
+}
+
+int main(int argc, char **argv)
+{
+	long long poses = argc > 1 ? PositiveArgument(argv[1]) : 10000000;
+	long long onlyThreads = argc > 2 ? PositiveArgument(argv[2]) : 0;
+	KinematicsContext *probe;
+	int hardwareThreads, partCount;
+	KinematicsPart *parts;
+	float *angles, *transforms, *check;
+	int threads, table, i;
+	float maxDifference = 0.0f;
+
+	if (poses == 0 || (argc > 2 && (onlyThreads == 0 || onlyThreads > 1024))) {
+		fprintf(stderr, "usage: robotfk [POSES] [THREADS], both positive whole numbers\n");
+		return 1;
+	}
+
+	probe = KinematicsCreateRobot(0);
+	if (!probe) {
+		fprintf(stderr, "Cannot create a kinematics context\n");
+		return 1;
+	}
+	hardwareThreads = KinematicsThreadCount(probe);
+	partCount = KinematicsPartCount(probe);
+	parts = (KinematicsPart *)malloc(sizeof(KinematicsPart) * partCount);
+	angles = (float *)malloc(sizeof(float) * 3 * partCount * BATCH_POSES);
+	transforms = (float *)malloc(sizeof(float) * 16 * partCount * BATCH_POSES);
+	check = (float *)malloc(sizeof(float) * 16 * partCount * BATCH_POSES);
+	if (!parts || !angles || !transforms || !check) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	KinematicsGetParts(probe, parts);
+	KinematicsDestroy(probe);
+
+	srand(1234);
+	for (i = 0; i < 3 * partCount * BATCH_POSES; i++) {
+		angles[i] = 6.28318531f * rand() / (float)RAND_MAX - 3.14159265f;
+	}
+
+	/* both paths have to agree before their speed means anything */
+	{
+		KinematicsContext *robot = KinematicsCreateRobot(1);
+		KinematicsContext *walked = KinematicsCreate(parts, partCount, 1);
+		if (KinematicsSolve(robot, angles, BATCH_POSES, transforms) != 0 || KinematicsSolve(walked, angles, BATCH_POSES, check) != 0) {
+			fprintf(stderr, "KinematicsSolve failed\n");
+			return 1;
+		}
+		for (i = 0; i < 16 * partCount * BATCH_POSES; i++) {
+			float difference = (float)fabs(transforms[i] - check[i]);
+			maxDifference = difference > maxDifference ? difference : maxDifference;
+		}
+		KinematicsDestroy(robot);
+		KinematicsDestroy(walked);
+	}
+	printf("%d parts, %lld poses per run, max difference between paths %g\n", partCount, poses, maxDifference);
+
+	printf("skeleton\tthreads\tseconds\tposes/s\ttransforms/s\n");
+	for (table = 0; table <= 1; table++) {
+		/* doubling, then the core count itself when it is not a power of two */
+		for (threads = 1; ; threads = threads * 2 < hardwareThreads ? threads * 2 : hardwareThreads) {
+			int runThreads = onlyThreads ? (int)onlyThreads : threads;
+			KinematicsContext *context = table ? KinematicsCreate(parts, partCount, runThreads) : KinematicsCreateRobot(runThreads);
+			double seconds;
+			if (!context) {
+				fprintf(stderr, "Cannot create a kinematics context with %d threads\n", runThreads);
+				return 1;
+			}
+			Run(context, angles, transforms, BATCH_POSES);
+			seconds = Run(context, angles, transforms, poses);
+			printf("%s\t%d\t%.3f\t%.0f\t%.0f\n", table ? "table" : "static", runThreads, seconds, poses / seconds, poses * partCount / seconds);
+			KinematicsDestroy(context);
+			if (onlyThreads || threads == hardwareThreads) {
+				break;
+			}
+		}
+	}
+
+	free(parts);
+	free(angles);
+	free(transforms);
+	free(check);
+	return 0;
+}
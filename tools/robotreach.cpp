@@ -0,0 +1,82 @@
+// Builds and queries reachability maps of the robot's limbs with the kinematics library.
+//
+// usage: robotreach build FILE [RESOLUTION] [SAMPLES] [THREADS]
+//        robotreach query FILE X Y Z
+//        robotreach bench [RESOLUTION] [SAMPLES]
+//
+// Points are in the torso's joint space. RESOLUTION is the voxels along each
+// side of a limb's grid (default 64), SAMPLES the joint space samples per limb
+// (default 4M) and THREADS the worker threads (default one per core).
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "ReachabilityMap.h"
+
+// the robot's parts in skeleton order, chains are named by their end part
+static const char *partNames[] = {"Torso", "Left Upper Arm", "Left Lower Arm", "Right Upper Arm", "Right Lower Arm",
+	"Left Upper Leg", "Left Lower Leg", "Right Upper Leg", "Right Lower Leg", "Head"};
+static const int partNameCount = sizeof(partNames) / sizeof(partNames[0]);
+
+int main(int argc, char **argv)
+{
+	if (argc > 2 && strcmp(argv[1], "build") == 0) {
+		int resolution = argc > 3 ? atoi(argv[3]) : 64;
+		int64_t samples = argc > 4 ? atoll(argv[4]) : 4 << 20;
+		int threads = argc > 5 ? atoi(argv[5]) : 0;
+
+		ReachabilityMap map;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		if (!BuildRobotReachabilityMap(map, resolution, samples, threads) || !map.write(argv[2])) {
+			return 1;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << "Reachability map " << argv[2] << ": " << map.chainCount() << " limbs of " << resolution << "^3 voxels, "
+			<< samples << " samples each, built in " << ms << " ms" << std::endl;
+		return 0;
+	}
+
+	if (argc > 5 && strcmp(argv[1], "query") == 0) {
+		ReachabilityMap map;
+		if (!map.open(argv[2])) {
+			return 1;
+		}
+
+		glm::vec3 target((float)atof(argv[3]), (float)atof(argv[4]), (float)atof(argv[5]));
+		for (int c = 0; c < map.chainCount(); c++) {
+			float angles[3 * reachMaxChainParts];
+			int reach = map.reachability(c, target);
+			int endPart = map.chain(c).endPart;
+			if (endPart >= 0 && endPart < partNameCount) {
+				std::cout << partNames[endPart];
+			} else {
+				std::cout << "Part " << endPart;
+			}
+			std::cout << ": reachability " << reach;
+			if (map.seed(c, target, angles)) {
+				int iterations = map.solve(c, target, angles);
+				if (iterations >= 0) {
+					std::cout << ", solved in " << iterations << " iterations, angles";
+					for (int a = 0; a < map.angleCount(c); a++) {
+						std::cout << " " << angles[a];
+					}
+				} else {
+					std::cout << ", not solved from the seed";
+				}
+			}
+			std::cout << std::endl;
+		}
+		return 0;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		BenchmarkReachabilityMap(argc > 2 ? atoi(argv[2]) : 64, argc > 3 ? atoll(argv[3]) : 4 << 20);
+		return 0;
+	}
+
+	std::cerr << "usage: robotreach build FILE [RESOLUTION] [SAMPLES] [THREADS]" << std::endl;
+	std::cerr << "       robotreach query FILE X Y Z" << std::endl;
+	std::cerr << "       robotreach bench [RESOLUTION] [SAMPLES]" << std::endl;
+	return 1;
+}